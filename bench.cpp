@@ -0,0 +1,452 @@
+#include "file_format.h"
+#include "kv_cache.h"
+#include "model.h"
+#include "model_file.h"
+#include "model_writer.h"
+#include "sampler.h"
+#include "scratch.h"
+#include "tensor.h"
+#include "thread_pool.h"
+#include "utils.h"
+#include "layers/attention.h"
+#include "layers/rmsnorm.h"
+#include "layers/rope.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Kernel microbenchmarks and end-to-end generation benchmarks.
+//
+// Unless --model is given, a dummy model of the requested size is written to
+// a temporary file first. Results go to stdout (or --out) as one JSON
+// document; progress goes to stderr. Each benchmark is warmed up, then
+// repeated until it has run for --min-time seconds.
+//
+// Usage: daiso_bench [options]
+//   --model PATH            benchmark an existing model file
+//   --dim N, --hidden-dim N, --layers N, --heads N, --kv-heads N,
+//   --vocab N, --seq-len N  dummy model configuration
+//   --weights f32|q8_0|q4_0 storage of the dummy model's projections
+//   --kv-type f32|f16|q8    KV cache storage
+//   --kv-layout head|position  KV cache row order
+//   --prompt N, --gen N     prompt length and decoded tokens (end-to-end)
+//   --batch N               sequences decoded together (end-to-end)
+//   --contexts N,N,...      context lengths for the attention benchmark
+//   --threads N, --min-time F, --only micro|e2e, --out PATH
+
+using namespace DaisoML;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct BenchOptions {
+    std::string model_path;
+    DaisoModelHeader header = {DAISO_MAGIC, DAISO_VERSION_2, 512, 1376, 4, 8, 8, 4096, 1024};
+    DType weights = DType::F32;
+    KVType kv_type = KVType::F32;
+    KVLayout kv_layout = KVLayout::HeadMajor;
+    int prompt = 128;
+    int gen = 32;
+    int batch = 8;
+    std::vector<int> contexts = {128, 512, 1024};
+    int threads = 0;
+    double min_time = 0.2;
+    std::string only;
+    std::string out;
+};
+
+struct Timing {
+    double mean_us;
+    double min_us;
+    long iters;
+};
+
+// Runs fn once to warm up, then repeatedly for at least min_time seconds.
+template <typename F>
+Timing measure(double min_time, F&& fn) {
+    fn();
+    Timing t{0.0, 1e300, 0};
+    double total = 0.0;
+    while (total < min_time * 1e6 || t.iters < 3) {
+        const auto start = Clock::now();
+        fn();
+        const double us = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+        total += us;
+        t.min_us = std::min(t.min_us, us);
+        t.iters++;
+    }
+    t.mean_us = total / t.iters;
+    return t;
+}
+
+// Collects results as a JSON array of flat objects.
+class JsonList {
+public:
+    JsonList& begin() {
+        if (!first) out << ",";
+        out << "\n    {";
+        first = false;
+        first_field = true;
+        return *this;
+    }
+    JsonList& field(const std::string& key, const std::string& value) {
+        return raw(key, "\"" + value + "\"");
+    }
+    JsonList& field(const std::string& key, double value) {
+        char buf[64];
+        std::snprintf(buf, sizeof(buf), "%.6g", value);
+        return raw(key, buf);
+    }
+    JsonList& timing(const Timing& t) {
+        return field("mean_us", t.mean_us).field("min_us", t.min_us).field("iters", (double)t.iters);
+    }
+    void end() { out << "}"; }
+    std::string str() const { return "[" + out.str() + "\n  ]"; }
+
+private:
+    JsonList& raw(const std::string& key, const std::string& value) {
+        if (!first_field) out << ", ";
+        out << "\"" << key << "\": " << value;
+        first_field = false;
+        return *this;
+    }
+    std::ostringstream out;
+    bool first = true;
+    bool first_field = true;
+};
+
+std::vector<float> random_floats(size_t n, std::mt19937& rng, float scale = 0.1f) {
+    std::uniform_real_distribution<float> dist(-scale, scale);
+    std::vector<float> v(n);
+    for (float& x : v) x = dist(rng);
+    return v;
+}
+
+Tensor random_tensor(const std::vector<size_t>& shape, std::mt19937& rng) {
+    Tensor t(shape);
+    std::uniform_real_distribution<float> dist(-0.1f, 0.1f);
+    for (size_t i = 0; i < t.size(); ++i) t.data()[i] = dist(rng);
+    return t;
+}
+
+void write_dummy_model(const BenchOptions& opts, const std::string& path) {
+    std::mt19937 rng(0);
+    ModelWriter writer(opts.header);
+    for (const auto& spec : model_tensor_specs(opts.header, false)) {
+        Tensor t = random_tensor(spec.shape, rng);
+        if (opts.weights != DType::F32 && spec.shape.size() == 2 && spec.name != "tok_embeddings") {
+            t = quantize(t, opts.weights);
+        }
+        writer.add(spec.name, t);
+    }
+    writer.write(path, DAISO_VERSION_2);
+}
+
+void bench_matmul(const BenchOptions& opts, JsonList& results) {
+    std::mt19937 rng(1);
+    const size_t dim = opts.header.dim;
+    const size_t hidden = opts.header.hidden_dim;
+    // The shapes of a layer's projections and of the classifier
+    const std::vector<std::pair<size_t, size_t>> shapes = {
+        {dim, dim}, {hidden, dim}, {dim, hidden}, {(size_t)opts.header.vocab_size, dim}};
+    for (DType dtype : {DType::F32, DType::Q8_0, DType::Q4_0}) {
+        for (const auto& shape : shapes) {
+            Tensor w = random_tensor({shape.first, shape.second}, rng);
+            if (dtype != DType::F32) {
+                if (shape.second % 32 != 0) continue;
+                w = quantize(w, dtype);
+            }
+            const std::string name = std::to_string(shape.first) + "x" + std::to_string(shape.second);
+            std::vector<float> x = random_floats(shape.second * 64, rng);
+            std::vector<float> out(shape.first * 64);
+
+            const Timing gemv = measure(opts.min_time, [&] { matvec(out.data(), w, x.data()); });
+            const double flops = 2.0 * shape.first * shape.second;
+            results.begin()
+                .field("bench", "gemv").field("dtype", dtype_name(dtype)).field("shape", name).timing(gemv)
+                .field("gb_s", w.nbytes() / gemv.mean_us / 1e3).field("gflop_s", flops / gemv.mean_us / 1e3)
+                .end();
+            for (size_t n : {8, 64}) {
+                const Timing g = measure(opts.min_time, [&] { gemm(out.data(), w, x.data(), n); });
+                results.begin()
+                    .field("bench", "gemm").field("dtype", dtype_name(dtype)).field("shape", name)
+                    .field("n", (double)n).timing(g)
+                    .field("gb_s", w.nbytes() / g.mean_us / 1e3).field("gflop_s", n * flops / g.mean_us / 1e3)
+                    .end();
+            }
+        }
+    }
+}
+
+void bench_elementwise(const BenchOptions& opts, ModelFile& file, JsonList& results) {
+    std::mt19937 rng(2);
+    const size_t dim = opts.header.dim;
+    const size_t vocab = opts.header.vocab_size;
+
+    std::vector<float> logit_data = random_floats(vocab, rng, 10.0f);
+    Tensor in({vocab});
+    std::copy(logit_data.begin(), logit_data.end(), in.data());
+    Tensor out({vocab});
+    const Timing sm = measure(opts.min_time, [&] { softmax(out, in); });
+    results.begin().field("bench", "softmax").field("n", (double)vocab).timing(sm).end();
+
+    RMSNorm norm(opts.header.dim);
+    norm.load_weights(file, "norm");
+    for (size_t n : {1, 64}) {
+        Tensor x({n, dim});
+        std::vector<float> data = random_floats(n * dim, rng);
+        std::copy(data.begin(), data.end(), x.data());
+        Tensor y({n, dim});
+        const Timing t = measure(opts.min_time, [&] { norm.forward(y, x); });
+        results.begin().field("bench", "rmsnorm").field("dim", (double)dim).field("n", (double)n).timing(t)
+            .field("gb_s", 2.0 * n * dim * sizeof(float) / t.mean_us / 1e3).end();
+    }
+
+    const int head_dim = opts.header.dim / opts.header.n_heads;
+    RoPE rope(head_dim, opts.header.seq_len, 10000.0f);
+    std::vector<float> q = random_floats(dim, rng);
+    const Timing rt = measure(opts.min_time, [&] { rope.rotate(q.data(), opts.header.n_heads, opts.header.seq_len / 2); });
+    results.begin().field("bench", "rope").field("heads", (double)opts.header.n_heads)
+        .field("head_dim", (double)head_dim).timing(rt).end();
+
+    // Sampler with the default filters (top-k heap) and with top-p alone
+    // (partial selection over the whole vocabulary)
+    SamplerOptions top_k;
+    SamplerOptions top_p;
+    top_p.top_k = 0;
+    SamplerOptions greedy;
+    greedy.temperature = 0.0f;
+    for (const auto& variant : {std::make_pair("top_k", top_k), std::make_pair("top_p", top_p),
+                                std::make_pair("greedy", greedy)}) {
+        Sampler sampler((int)vocab, variant.second);
+        const Timing t = measure(opts.min_time, [&] { sampler.sample(logit_data.data()); });
+        results.begin().field("bench", "sampler").field("variant", variant.first).field("vocab", (double)vocab)
+            .timing(t).end();
+    }
+}
+
+void bench_attention(const BenchOptions& opts, ModelFile& file, JsonList& results) {
+    const DaisoModelHeader& h = opts.header;
+    const int head_dim = h.dim / h.n_heads;
+    std::mt19937 rng(3);
+    RoPE rope(head_dim, h.seq_len, 10000.0f);
+    Attention attention(h.dim, h.n_heads, h.n_kv_heads, h.seq_len, rope);
+    attention.load_weights(file, layer_tensor(0, "attention."));
+    RMSNorm norm(h.dim);
+    norm.load_weights(file, layer_tensor(0, "attention_norm"));
+
+    for (int ctx : opts.contexts) {
+        if (ctx >= h.seq_len) continue;
+        KVCache cache(1, h.n_kv_heads, head_dim, 16, (h.seq_len + 15) / 16, opts.kv_type, opts.kv_layout);
+        ScratchArena scratch(attention.scratch_bytes(ctx));
+        const int seq = cache.create_sequence();
+        cache.resize(seq, ctx + 1);
+
+        // Fill positions 0..ctx-1, then time one decode step at position ctx
+        std::vector<int> positions(ctx);
+        std::vector<int> seqs(ctx, seq);
+        for (int i = 0; i < ctx; ++i) positions[i] = i;
+        std::vector<float> data = random_floats((size_t)ctx * h.dim, rng);
+        attention.forward(data.data(), ctx, norm, positions.data(), seqs.data(), 0, cache, scratch);
+
+        // The residual grows with each timed call; the work does not depend on it
+        std::vector<float> x(data.begin(), data.begin() + h.dim);
+        const Timing t = measure(opts.min_time, [&] {
+            attention.forward(x.data(), 1, norm, &ctx, &seq, 0, cache, scratch);
+        });
+        results.begin().field("bench", "attention").field("context", (double)ctx)
+            .field("kv_type", kv_type_name(opts.kv_type)).timing(t)
+            .field("kv_gb_s", 2.0 * ctx * cache.row_bytes() / t.mean_us / 1e3).end();
+    }
+}
+
+std::string bench_e2e(const BenchOptions& opts, const std::string& path) {
+    ModelOptions model_options;
+    model_options.kv_type = opts.kv_type;
+    model_options.kv_layout = opts.kv_layout;
+    model_options.max_batch = std::max(opts.batch, 1);
+    Model model(path, model_options);
+    const DaisoModelHeader& h = model.getConfig();
+    const int prompt_len = std::min(opts.prompt, h.seq_len - opts.gen - 1);
+    if (prompt_len <= 0) {
+        throw DaisoException("--prompt plus --gen must fit in seq_len.");
+    }
+    std::mt19937 rng(4);
+    std::uniform_int_distribution<int> token(0, h.vocab_size - 1);
+    std::vector<int> prompt(prompt_len);
+    for (int& t : prompt) t = token(rng);
+    SamplerOptions sampling;
+    sampling.temperature = 0.0f;
+
+    // Prefill and time to first token: prompt in, first token sampled
+    Timing prefill{0, 1e300, 0};
+    Timing ttft{0, 1e300, 0};
+    double decode_us = 0.0;
+    int decoded = 0;
+    const int runs = 3;
+    for (int run = 0; run < runs; ++run) {
+        const int seq = model.create_sequence();
+        Sampler sampler(h.vocab_size, sampling);
+        const auto start = Clock::now();
+        Tensor* logits = model.prefill(prompt, 0, seq);
+        const auto prefilled = Clock::now();
+        int next = sampler.sample(*logits);
+        const auto first = Clock::now();
+        const double p_us = std::chrono::duration<double, std::micro>(prefilled - start).count();
+        const double f_us = std::chrono::duration<double, std::micro>(first - start).count();
+        prefill.mean_us += p_us / runs;
+        prefill.min_us = std::min(prefill.min_us, p_us);
+        ttft.mean_us += f_us / runs;
+        ttft.min_us = std::min(ttft.min_us, f_us);
+
+        // Single-sequence decode
+        const auto decode_start = Clock::now();
+        for (int i = 0; i < opts.gen; ++i) {
+            next = sampler.sample(*model.forward(next, prompt_len + i, seq));
+        }
+        decode_us += std::chrono::duration<double, std::micro>(Clock::now() - decode_start).count();
+        decoded += opts.gen;
+        model.free_sequence(seq);
+    }
+
+    // Batched decode: `batch` sequences advance together, sharing weight reads
+    const int batch = std::max(opts.batch, 1);
+    std::vector<int> seqs(batch);
+    for (int& seq : seqs) {
+        seq = model.create_sequence();
+        model.prefill(prompt, 0, seq, Logits::None);
+    }
+    Batch rows;
+    const auto batch_start = Clock::now();
+    for (int i = 0; i < opts.gen; ++i) {
+        rows.clear();
+        for (int b = 0; b < batch; ++b) rows.add(token(rng), prompt_len + i, seqs[b]);
+        model.forward_batch(rows);
+    }
+    const double batch_us = std::chrono::duration<double, std::micro>(Clock::now() - batch_start).count();
+    for (int seq : seqs) model.free_sequence(seq);
+
+    char buf[512];
+    std::snprintf(buf, sizeof(buf),
+                  "{\"prompt_tokens\": %d, \"gen_tokens\": %d, \"prefill_ms\": %.6g, \"prefill_tok_s\": %.6g, "
+                  "\"ttft_ms\": %.6g, \"ttft_min_ms\": %.6g, \"decode_tok_s\": %.6g, \"decode_ms_per_token\": %.6g, "
+                  "\"batch\": %d, \"batch_decode_tok_s\": %.6g}",
+                  prompt_len, opts.gen, prefill.mean_us / 1e3, prompt_len / (prefill.mean_us / 1e6),
+                  ttft.mean_us / 1e3, ttft.min_us / 1e3, decoded / (decode_us / 1e6), decode_us / decoded / 1e3,
+                  batch, (double)batch * opts.gen / (batch_us / 1e6));
+    return buf;
+}
+
+bool parse_args(int argc, char** argv, BenchOptions& opts) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) return false;
+        const std::string value = argv[++i];
+        if (arg == "--model") opts.model_path = value;
+        else if (arg == "--dim") opts.header.dim = std::stoi(value);
+        else if (arg == "--hidden-dim") opts.header.hidden_dim = std::stoi(value);
+        else if (arg == "--layers") opts.header.n_layers = std::stoi(value);
+        else if (arg == "--heads") opts.header.n_heads = opts.header.n_kv_heads = std::stoi(value);
+        else if (arg == "--kv-heads") opts.header.n_kv_heads = std::stoi(value);
+        else if (arg == "--vocab") opts.header.vocab_size = std::stoi(value);
+        else if (arg == "--seq-len") opts.header.seq_len = std::stoi(value);
+        else if (arg == "--prompt") opts.prompt = std::stoi(value);
+        else if (arg == "--gen") opts.gen = std::stoi(value);
+        else if (arg == "--batch") opts.batch = std::stoi(value);
+        else if (arg == "--threads") opts.threads = std::stoi(value);
+        else if (arg == "--min-time") opts.min_time = std::stod(value);
+        else if (arg == "--only") opts.only = value;
+        else if (arg == "--out") opts.out = value;
+        else if (arg == "--kv-type") opts.kv_type = kv_type_from_name(value);
+        else if (arg == "--kv-layout") opts.kv_layout = kv_layout_from_name(value);
+        else if (arg == "--weights") {
+            if (value == "f32") opts.weights = DType::F32;
+            else if (value == "q8_0") opts.weights = DType::Q8_0;
+            else if (value == "q4_0") opts.weights = DType::Q4_0;
+            else return false;
+        } else if (arg == "--contexts") {
+            opts.contexts.clear();
+            std::stringstream ss(value);
+            std::string item;
+            while (std::getline(ss, item, ',')) opts.contexts.push_back(std::stoi(item));
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    BenchOptions opts;
+    try {
+        if (!parse_args(argc, argv, opts)) {
+            std::cerr << "Usage: " << argv[0] << " [--model PATH] [--dim N] [--hidden-dim N] [--layers N]"
+                      << " [--heads N] [--kv-heads N] [--vocab N] [--seq-len N] [--weights f32|q8_0|q4_0]"
+                      << " [--kv-type f32|f16|q8] [--kv-layout head|position] [--prompt N] [--gen N] [--batch N]"
+                      << " [--contexts N,N,...]"
+                      << " [--threads N] [--min-time F] [--only micro|e2e] [--out PATH]" << std::endl;
+            return 1;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    // Model loading logs would interleave with the progress messages
+    set_log_level(LogLevel::Warn);
+
+    int status = 0;
+    const bool temp_model = opts.model_path.empty();
+    const std::string path = temp_model ? "daiso_bench_model.bin" : opts.model_path;
+    try {
+        ThreadPool::set_global_threads(opts.threads);
+        if (temp_model) {
+            std::cerr << "Writing dummy model to " << path << "..." << std::endl;
+            write_dummy_model(opts, path);
+        }
+        ModelFile file(path, true);
+        opts.header = file.header();
+
+        JsonList micro;
+        if (opts.only.empty() || opts.only == "micro") {
+            std::cerr << "Running kernel microbenchmarks..." << std::endl;
+            bench_matmul(opts, micro);
+            bench_elementwise(opts, file, micro);
+            bench_attention(opts, file, micro);
+        }
+        std::string e2e = "null";
+        if (opts.only.empty() || opts.only == "e2e") {
+            std::cerr << "Running end-to-end benchmark..." << std::endl;
+            e2e = bench_e2e(opts, path);
+        }
+
+        const DaisoModelHeader& h = opts.header;
+        std::ostringstream doc;
+        doc << "{\n  \"isa\": \"" << kernel_isa() << "\", \"threads\": " << ThreadPool::global().num_threads()
+            << ",\n  \"model\": {\"dim\": " << h.dim << ", \"hidden_dim\": " << h.hidden_dim
+            << ", \"n_layers\": " << h.n_layers << ", \"n_heads\": " << h.n_heads << ", \"n_kv_heads\": "
+            << h.n_kv_heads << ", \"vocab_size\": " << h.vocab_size << ", \"seq_len\": " << h.seq_len
+            << ", \"weights\": \"" << (temp_model ? dtype_name(opts.weights) : "file") << "\", \"kv_type\": \""
+            << kv_type_name(opts.kv_type) << "\", \"kv_layout\": \"" << kv_layout_name(opts.kv_layout) << "\"},\n  \"micro\": " << micro.str() << ",\n  \"e2e\": " << e2e
+            << "\n}\n";
+        if (opts.out.empty()) {
+            std::cout << doc.str();
+        } else {
+            std::ofstream(opts.out) << doc.str();
+            std::cerr << "Wrote " << opts.out << std::endl;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        status = 1;
+    }
+    if (temp_model) std::remove(path.c_str());
+    return status;
+}
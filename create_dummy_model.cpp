@@ -1,22 +1,55 @@
 #include "file_format.h"
+#include "model_file.h"
+#include "model_writer.h"
 #include "tensor.h"
+#include "tokenizer.h"
 #include <iostream>
-#include <fstream>
+#include <string>
 #include <vector>
 #include <random>
 
 // This utility creates a dummy model file with random weights.
 // It's used for testing the model loading functionality of the main application.
-
-void write_tensor(std::ofstream& file, const DaisoML::Tensor& tensor) {
-    file.write(reinterpret_cast<const char*>(tensor.data()), tensor.size() * sizeof(float));
+//
+// Usage: create_dummy_model [options] [output_path]
+//   --version 1|2      file format version (default: 2)
+//   --tied             share the output projection with the embedding table (v2 only)
+//   --dim N, --hidden-dim N, --layers N, --heads N, --kv-heads N,
+//   --vocab N, --seq-len N, --rope-theta F   model configuration
+//   --rope-scaling none|linear|ntk, --rope-scale F   RoPE context extension (v2 only)
+//
+// v2 files also get a byte-level BPE tokenizer trained on a short built-in
+// text, so encode/decode behave like a real model's (the text generated from
+// random weights is still noise).
+
+// Training text for the dummy tokenizer
+static const char* tokenizer_corpus =
+    "Hello, my name is Daiso. I am a small language model, and my name is easy to remember. "
+    "The quick brown fox jumps over the lazy dog. The dog sleeps in the sun, and the fox runs into the forest. "
+    "A transformer reads a sequence of tokens, and every token attends to the tokens before it. "
+    "The model is made of layers; each layer has an attention block and a feed-forward block. "
+    "Attention uses queries, keys and values. The keys and values of earlier tokens are kept in a cache, "
+    "so generating the next token does not repeat the work done for the previous ones. "
+    "Weights can be stored in 8-bit or 4-bit blocks, which makes the model file smaller and the "
+    "inference faster, because reading memory is the main cost of generating text on a CPU. "
+    "In the beginning there was the word, and the word was tokenized into pieces. "
+    "Numbers such as 1, 2, 3, 10, 100, 2024 and 3.14159 are split into digits and punctuation. "
+    "She said: \"What is the name of the model?\" He answered: \"Its name is Daiso, and it runs on any machine.\"\n"
+    "Once upon a time, in a small town by the sea, there lived an old man who loved to tell stories. "
+    "Every evening the children came to his house, and he told them about ships, storms and distant islands. "
+    "The stories were long, but nobody ever fell asleep before the end.\n";
+
+static void print_usage(const char* argv0) {
+    std::cerr << "Usage: " << argv0 << " [--version 1|2] [--tied] [--dim N] [--hidden-dim N] [--layers N]"
+              << " [--heads N] [--kv-heads N] [--vocab N] [--seq-len N] [--rope-theta F]"
+              << " [--rope-scaling none|linear|ntk] [--rope-scale F] [output_path]" << std::endl;
 }
 
-int main() {
+int main(int argc, char** argv) {
     // 1. Define the model configuration
     DaisoML::DaisoModelHeader header = {
         .magic = DaisoML::DAISO_MAGIC,
-        .version = 1,
+        .version = DaisoML::DAISO_VERSION_2,
         .dim = 288,
         .hidden_dim = 768,
         .n_layers = 6,
@@ -25,9 +58,58 @@ int main() {
         .vocab_size = 1024,
         .seq_len = 256
     };
+    bool tied = false;
+    float rope_theta = 10000.0f;
+    uint32_t rope_scaling = DaisoML::DAISO_ROPE_SCALING_NONE;
+    float rope_scale = 1.0f;
+    std::string filename = "dummy_model.bin";
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--tied") {
+            tied = true;
+        } else if (arg == "--version" && has_value) {
+            header.version = std::stoi(argv[++i]);
+        } else if (arg == "--dim" && has_value) {
+            header.dim = std::stoi(argv[++i]);
+        } else if (arg == "--hidden-dim" && has_value) {
+            header.hidden_dim = std::stoi(argv[++i]);
+        } else if (arg == "--layers" && has_value) {
+            header.n_layers = std::stoi(argv[++i]);
+        } else if (arg == "--heads" && has_value) {
+            header.n_heads = std::stoi(argv[++i]);
+        } else if (arg == "--kv-heads" && has_value) {
+            header.n_kv_heads = std::stoi(argv[++i]);
+        } else if (arg == "--vocab" && has_value) {
+            header.vocab_size = std::stoi(argv[++i]);
+        } else if (arg == "--seq-len" && has_value) {
+            header.seq_len = std::stoi(argv[++i]);
+        } else if (arg == "--rope-theta" && has_value) {
+            rope_theta = std::stof(argv[++i]);
+        } else if (arg == "--rope-scaling" && has_value) {
+            const std::string type = argv[++i];
+            if (type == "linear") {
+                rope_scaling = DaisoML::DAISO_ROPE_SCALING_LINEAR;
+            } else if (type == "ntk") {
+                rope_scaling = DaisoML::DAISO_ROPE_SCALING_NTK;
+            } else if (type != "none") {
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--rope-scale" && has_value) {
+            rope_scale = std::stof(argv[++i]);
+        } else if (!arg.empty() && arg[0] != '-') {
+            filename = arg;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
 
     std::cout << "DaisoML Dummy Model Creator" << std::endl;
     std::cout << "---------------------------" << std::endl;
+    std::cout << "Format version: " << header.version << (tied ? " (tied embeddings)" : "") << std::endl;
     std::cout << "Dimensions:" << std::endl;
     std::cout << "  dim: " << header.dim << std::endl;
     std::cout << "  hidden_dim: " << header.hidden_dim << std::endl;
@@ -37,20 +119,16 @@ int main() {
     std::cout << "  seq_len: " << header.seq_len << std::endl;
     std::cout << "---------------------------" << std::endl;
 
-    // 2. Open the output file
-    const char* filename = "dummy_model.bin";
-    std::ofstream file(filename, std::ios::binary);
-    if (!file) {
-        std::cerr << "Error: Could not open file " << filename << " for writing." << std::endl;
-        return 1;
+    DaisoML::ModelWriter writer(header);
+    if (tied) {
+        writer.meta().flags |= DaisoML::DAISO_FLAG_TIED_EMBEDDINGS;
     }
+    writer.meta().rope_theta = rope_theta;
+    writer.meta().rope_scaling = rope_scaling;
+    writer.meta().rope_scale = rope_scale;
 
-    // 3. Write the header
-    file.write(reinterpret_cast<const char*>(&header), sizeof(DaisoML::DaisoModelHeader));
-    std::cout << "Wrote header to " << filename << std::endl;
-
-    // 4. Write random tensor data in the correct order
-    std::cout << "Writing random tensor data..." << std::endl;
+    // 2. Generate random tensor data in the canonical order (see file_format.h)
+    std::cout << "Generating random tensor data..." << std::endl;
 
     // Use a random number generator to create somewhat realistic weights
     std::mt19937 rng(0); // Seed for reproducibility
@@ -64,49 +142,25 @@ int main() {
         return t;
     };
 
-    // token_embedding_table
-    auto token_embedding_table = create_random_tensor({(size_t)header.vocab_size, (size_t)header.dim});
-    write_tensor(file, token_embedding_table);
-    std::cout << "  - Wrote token_embedding_table" << std::endl;
-
-    // Per-layer weights
-    for (int i = 0; i < header.n_layers; ++i) {
-        auto rms_att_weight = create_random_tensor({(size_t)header.dim});
-        write_tensor(file, rms_att_weight);
-
-        auto wq = create_random_tensor({(size_t)header.dim, (size_t)header.dim});
-        write_tensor(file, wq);
-        auto wk = create_random_tensor({(size_t)header.dim, (size_t)header.dim});
-        write_tensor(file, wk);
-        auto wv = create_random_tensor({(size_t)header.dim, (size_t)header.dim});
-        write_tensor(file, wv);
-        auto wo = create_random_tensor({(size_t)header.dim, (size_t)header.dim});
-        write_tensor(file, wo);
-
-        auto rms_ffn_weight = create_random_tensor({(size_t)header.dim});
-        write_tensor(file, rms_ffn_weight);
-
-        auto w1 = create_random_tensor({(size_t)header.hidden_dim, (size_t)header.dim});
-        write_tensor(file, w1);
-        auto w2 = create_random_tensor({(size_t)header.dim, (size_t)header.hidden_dim});
-        write_tensor(file, w2);
-        auto w3 = create_random_tensor({(size_t)header.hidden_dim, (size_t)header.dim});
-        write_tensor(file, w3);
-        std::cout << "  - Wrote weights for layer " << i << std::endl;
+    for (const auto& spec : DaisoML::model_tensor_specs(header, tied)) {
+        writer.add(spec.name, create_random_tensor(spec.shape));
     }
+    std::cout << "  - Generated " << header.n_layers << " layers" << (tied ? " (output tied to tok_embeddings)" : "") << std::endl;
 
-    // Final weights
-    auto rms_final_weight = create_random_tensor({(size_t)header.dim});
-    write_tensor(file, rms_final_weight);
-    std::cout << "  - Wrote rms_final_weight" << std::endl;
-
-    // Output projection (optional, can be shared with embedding table)
-    auto final_weights = create_random_tensor({(size_t)header.vocab_size, (size_t)header.dim});
-    write_tensor(file, final_weights);
-    std::cout << "  - Wrote final_weights" << std::endl;
-
+    if (header.version == DaisoML::DAISO_VERSION_2 && header.vocab_size >= 256) {
+        const DaisoML::Tokenizer tokenizer = DaisoML::Tokenizer::train(tokenizer_corpus, header.vocab_size);
+        writer.set_tokenizer(tokenizer.serialize());
+        std::cout << "  - Trained tokenizer: " << tokenizer.vocab_size() << " tokens, "
+                  << tokenizer.n_merges() << " merges" << std::endl;
+    }
 
-    file.close();
+    // 3. Write the file
+    try {
+        writer.write(filename, header.version);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
     std::cout << "---------------------------" << std::endl;
     std::cout << "Successfully created dummy model file: " << filename << std::endl;
 
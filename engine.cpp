@@ -0,0 +1,147 @@
+#include "engine.h"
+#include "utils.h"
+#include <algorithm>
+
+namespace DaisoML {
+
+Engine::Engine(Model& model) : model(model) {
+    const size_t capacity = model.max_batch_size();
+    active.reserve(capacity);
+    batch.tokens.reserve(capacity);
+    batch.positions.reserve(capacity);
+    batch.seqs.reserve(capacity);
+}
+
+Engine::~Engine() {
+    for (const Request& r : active) {
+        model.free_sequence(r.seq);
+    }
+}
+
+int Engine::submit(const std::vector<int>& prompt, int max_new_tokens, const Sampler& sampler) {
+    if (prompt.empty()) {
+        throw DaisoException("A request needs at least one prompt token.");
+    }
+    if (max_new_tokens <= 0) {
+        throw DaisoException("A request must generate at least one token.");
+    }
+    if (prompt.size() > (size_t)model.getConfig().seq_len) {
+        throw DaisoException("Prompt exceeds the maximum sequence length.");
+    }
+    Request r{next_id, prompt, max_new_tokens, sampler};
+    // Prompt tokens count towards the repetition penalties
+    for (int token : prompt) {
+        r.sampler.accept(token);
+    }
+    r.blocks = blocks_needed(r);
+    if (r.blocks > model.sequence_blocks()) {
+        throw DaisoException("Request does not fit in the KV cache.");
+    }
+    next_id++;
+    waiting.push_back(std::move(r));
+    return waiting.back().id;
+}
+
+void Engine::cancel(int request) {
+    for (size_t i = 0; i < waiting.size(); ++i) {
+        if (waiting[i].id == request) {
+            waiting.erase(waiting.begin() + i);
+            return;
+        }
+    }
+    for (size_t i = 0; i < active.size(); ++i) {
+        if (active[i].id == request) {
+            finish(i);
+            return;
+        }
+    }
+}
+
+int Engine::blocks_needed(const Request& r) const {
+    const size_t longest = std::min(r.prompt.size() + (size_t)r.max_new_tokens,
+                                    (size_t)model.getConfig().seq_len);
+    const size_t block_size = model.getKVCache().block_size();
+    return (int)((longest + block_size - 1) / block_size);
+}
+
+bool Engine::done(const Request& r) const {
+    // The next step would feed last_token at r.pos; past seq_len there is no room
+    return r.generated >= r.max_new_tokens || r.pos >= model.getConfig().seq_len;
+}
+
+bool Engine::emit(Request& r, int token, std::vector<TokenEvent>& events) {
+    r.last_token = token;
+    r.generated++;
+    events.push_back({r.id, token, done(r)});
+    return done(r);
+}
+
+void Engine::finish(size_t index) {
+    model.free_sequence(active[index].seq);
+    reserved_blocks -= active[index].blocks;
+    // Order does not matter, so fill the hole with the last request
+    if (index + 1 != active.size()) {
+        active[index] = std::move(active.back());
+    }
+    active.pop_back();
+}
+
+void Engine::step(std::vector<TokenEvent>& events) {
+    // Admit queued requests, in order, while there is room in the batch and
+    // the cache. Blocks the prefix cache holds are not counted against
+    // requests; it has its own share of the pool. Prompts are prefilled one
+    // at a time, reusing cached prefixes; the prompt logits give the first
+    // token.
+    const int max_blocks = model.sequence_blocks();
+    while (!waiting.empty() && active.size() < model.max_batch_size() &&
+           reserved_blocks + waiting.front().blocks <= max_blocks) {
+        Request r = std::move(waiting.front());
+        waiting.erase(waiting.begin());
+        r.seq = model.create_sequence();
+        Tensor* logits;
+        try {
+            logits = model.prefill_prompt(r.prompt, r.seq);
+        } catch (...) {
+            model.free_sequence(r.seq);
+            throw;
+        }
+        r.pos = (int)r.prompt.size();
+        reserved_blocks += r.blocks;
+        active.push_back(std::move(r));
+        if (emit(active.back(), active.back().sampler.sample(*logits), events)) {
+            finish(active.size() - 1);
+        }
+    }
+    if (active.empty()) return;
+
+    // One decode step for every running request in a single batch
+    batch.clear();
+    for (const Request& r : active) {
+        batch.add(r.last_token, r.pos, r.seq);
+    }
+    const float* logits = model.forward_batch(batch)->data();
+    const size_t vocab = model.getConfig().vocab_size;
+
+    for (size_t i = 0; i < active.size(); ++i) {
+        active[i].pos++;
+        emit(active[i], active[i].sampler.sample(logits + i * vocab), events);
+    }
+    // Retire finished requests after sampling so batch rows stay aligned
+    for (size_t i = active.size(); i-- > 0;) {
+        if (done(active[i])) finish(i);
+    }
+}
+
+bool Engine::has_work() const {
+    return !waiting.empty() || !active.empty();
+}
+
+size_t Engine::running() const {
+    return active.size();
+}
+
+size_t Engine::queued() const {
+    return waiting.size();
+}
+
+} // namespace DaisoML
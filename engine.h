@@ -0,0 +1,83 @@
+#ifndef DAISOML_ENGINE_H
+#define DAISOML_ENGINE_H
+
+#include <cstddef>
+#include <vector>
+#include "model.h"
+#include "sampler.h"
+
+namespace DaisoML {
+
+// A token produced by Engine::step() for request `request`.
+struct TokenEvent {
+    int request;
+    int token;
+    bool finished; // last token of the request
+};
+
+// Continuous-batching generation engine on top of a Model.
+//
+// Requests join with submit() and leave when they finish or are cancelled.
+// Each step() first prefills the prompts of requests that joined since the
+// last step (up to the batch capacity), then advances every running request
+// by one token in a single Model::forward_batch() pass, so all of them share
+// each weight read. The batch changes between steps only. A request is
+// admitted only when the KV cache pool can hold its longest possible
+// sequence, so running requests never fail for lack of cache blocks. An
+// Engine is not thread-safe; drive it from one thread.
+class Engine {
+public:
+    explicit Engine(Model& model);
+    ~Engine();
+
+    Engine(const Engine&) = delete;
+    Engine& operator=(const Engine&) = delete;
+
+    // Queues a request and returns its id (ids count up from 0). Generation
+    // stops after max_new_tokens tokens or at the model's maximum sequence
+    // length.
+    int submit(const std::vector<int>& prompt, int max_new_tokens, const Sampler& sampler);
+    // Removes a queued or running request; no further events are produced
+    // for it. Unknown or finished ids are ignored.
+    void cancel(int request);
+
+    // Runs one scheduling step and appends the tokens it produced to `events`.
+    void step(std::vector<TokenEvent>& events);
+
+    // True if any request is queued or running.
+    bool has_work() const;
+    // Requests currently holding a KV cache sequence
+    size_t running() const;
+    size_t queued() const;
+
+private:
+    struct Request {
+        int id;
+        std::vector<int> prompt;
+        int max_new_tokens;
+        Sampler sampler;
+        int seq = -1;       // KV cache sequence while running
+        int pos = 0;        // position of last_token
+        int last_token = 0; // sampled but not yet fed to the model
+        int generated = 0;
+        int blocks = 0;     // KV cache blocks reserved for the request
+    };
+
+    // KV cache blocks the request needs at its longest
+    int blocks_needed(const Request& r) const;
+    bool done(const Request& r) const;
+    // Records a sampled token; returns true if the request is done.
+    bool emit(Request& r, int token, std::vector<TokenEvent>& events);
+    void finish(size_t index);
+
+    Model& model;
+    int next_id = 0;
+    int reserved_blocks = 0;
+    std::vector<Request> waiting;
+    std::vector<Request> active;
+    Batch batch;
+};
+
+} // namespace DaisoML
+
+#endif //DAISOML_ENGINE_H
@@ -19,7 +19,7 @@ struct DaisoModelHeader {
     int32_t hidden_dim; // for ffn layers
     int32_t n_layers;   // number of layers
     int32_t n_heads;    // number of query heads
-    int32_t n_kv_heads; // number of key/value heads
+    int32_t n_kv_heads; // number of key/value heads (0 in old files: same as n_heads)
     int32_t vocab_size; // vocabulary size
     int32_t seq_len;    // max sequence length
 
@@ -27,18 +27,139 @@ struct DaisoModelHeader {
     // For example, int32_t shared_weights;
 };
 
-// The layout of the file is:
+// Version 1 layout:
 // 1. DaisoModelHeader
-// 2. Tokenizer vocabulary (if not part of the main model weights)
-// 3. Model weights (Tensors) in a predefined order:
+// 2. Model weights (float32 tensors) in a predefined order:
 //    - token_embedding_table
 //    - rms_att_weight for each layer
-//    - wq, wk, wv, wo for each layer
+//    - wq, wk, wv, wo for each layer (wk, wv are [kv_dim, dim], see below)
 //    - rms_ffn_weight for each layer
 //    - w1, w2, w3 for each layer
 //    - rms_final_weight
 //    - final_weights (output projection)
 
+// Version 2 layout:
+// 1. DaisoModelHeader (version = 2)
+// 2. DaisoModelMetaV2
+// 3. n_tensors x DaisoTensorEntry (the tensor directory)
+// 4. Tensor data. Every tensor starts at a DAISO_ALIGNMENT-aligned file
+//    offset, so a mapped tensor can be fed to aligned SIMD loads directly.
+// 5. Optional tokenizer section (see DaisoTokenizerHeader).
+// Tensors are looked up by name, so their order in the file does not matter.
+
+constexpr int32_t DAISO_VERSION_1 = 1;
+constexpr int32_t DAISO_VERSION_2 = 2;
+constexpr uint64_t DAISO_ALIGNMENT = 64;
+
+// Element type of a tensor in the directory.
+enum DaisoDType : uint32_t {
+    DAISO_DTYPE_F32 = 0,
+    DAISO_DTYPE_Q8_0 = 1, // blocks of 32: fp16 scale + 32 x int8
+    DAISO_DTYPE_Q4_0 = 2, // blocks of 32: fp16 scale + 16 bytes of packed nibbles
+};
+
+// Bits of DaisoModelMetaV2::flags.
+enum DaisoModelFlags : uint32_t {
+    // The output projection reuses tok_embeddings; there is no "output" tensor.
+    DAISO_FLAG_TIED_EMBEDDINGS = 1u << 0,
+};
+
+// RoPE context-extension schemes (DaisoModelMetaV2::rope_scaling).
+enum DaisoRopeScaling : uint32_t {
+    DAISO_ROPE_SCALING_NONE = 0,
+    DAISO_ROPE_SCALING_LINEAR = 1, // positions divided by rope_scale
+    DAISO_ROPE_SCALING_NTK = 2,    // NTK-aware: base frequency stretched by rope_scale
+};
+
+struct DaisoModelMetaV2 {
+    uint32_t flags;       // DaisoModelFlags
+    uint32_t n_tensors;   // number of entries in the tensor directory
+    float rope_theta;     // RoPE base frequency
+    float norm_eps;       // RMSNorm epsilon
+    uint64_t data_offset; // file offset of the first tensor's data
+    uint32_t rope_scaling; // DaisoRopeScaling
+    float rope_scale;      // scaling factor (> 1 extends the context)
+    uint64_t tokenizer_offset; // file offset of the tokenizer section (0: none)
+    uint64_t tokenizer_size;   // its size in bytes
+    uint32_t reserved[20]; // zero; room for future fields
+};
+
+constexpr int DAISO_MAX_DIMS = 4;
+constexpr int DAISO_MAX_NAME = 64;
+
+struct DaisoTensorEntry {
+    char name[DAISO_MAX_NAME]; // NUL-terminated
+    uint32_t dtype;            // DaisoDType
+    uint32_t n_dims;
+    uint64_t shape[DAISO_MAX_DIMS]; // unused dimensions are 0
+    uint64_t offset;           // absolute file offset, DAISO_ALIGNMENT-aligned
+    uint64_t size;             // size of the data in bytes
+    uint64_t reserved;         // zero
+};
+
+// Tokenizer section layout:
+// 1. DaisoTokenizerHeader
+// 2. n_tokens x (uint32_t length, `length` bytes): the bytes of token i
+// 3. n_merges x (int32_t left, int32_t right): merge i (rank i) joins two
+//    adjacent tokens into the token whose bytes are their concatenation,
+//    which must itself be in the vocabulary. Lower ranks merge first.
+// Byte-level BPE: every single byte is a token, so any input can be encoded.
+// n_tokens may be below vocab_size when the embedding table is padded.
+enum DaisoTokenizerType : uint32_t {
+    DAISO_TOKENIZER_BPE = 1,
+};
+
+struct DaisoTokenizerHeader {
+    uint32_t type; // DaisoTokenizerType
+    uint32_t n_tokens;
+    uint32_t n_merges;
+    uint32_t reserved[5]; // zero
+};
+
+// Session snapshot layout (see session.h):
+// 1. DaisoSessionHeader
+// 2. n_tokens x int32_t: the tokens at positions 0 .. n_tokens - 1
+// 3. From data_offset, for each layer its keys, then its values, as one
+//    section of section_size bytes each (DAISO_ALIGNMENT-aligned): n_tokens
+//    x n_kv_heads rows of head_dim elements of kv_type, position-major and
+//    unpadded, followed for q8 by their n_tokens x n_kv_heads float scales.
+// The state is tied to the model it was computed with; the header repeats
+// that model's configuration so mismatched files are rejected.
+constexpr uint32_t DAISO_SESSION_MAGIC = 0x73657373; // "sess" in ASCII
+constexpr int32_t DAISO_SESSION_VERSION = 1;
+
+struct DaisoSessionHeader {
+    uint32_t magic;         // DAISO_SESSION_MAGIC
+    int32_t version;        // DAISO_SESSION_VERSION
+    uint32_t kv_type;       // KVType of the rows: 0 f32, 1 f16, 2 q8
+    uint32_t n_tokens;      // number of stored positions
+    uint64_t data_offset;   // file offset of the first section
+    uint64_t section_size;  // bytes per section, including padding
+    DaisoModelHeader model; // configuration of the model
+    uint32_t reserved[15];  // zero
+};
+
+static_assert(sizeof(DaisoModelHeader) == 36, "DaisoModelHeader layout changed");
+static_assert(sizeof(DaisoModelMetaV2) == 128, "DaisoModelMetaV2 layout changed");
+static_assert(sizeof(DaisoTensorEntry) == 128, "DaisoTensorEntry layout changed");
+static_assert(sizeof(DaisoTokenizerHeader) == 32, "DaisoTokenizerHeader layout changed");
+static_assert(sizeof(DaisoSessionHeader) == 128, "DaisoSessionHeader layout changed");
+
+// Canonical tensor names (v2). Per-layer tensors are prefixed "layers.<i>.".
+//    tok_embeddings                       [vocab_size, dim]
+//    layers.<i>.attention_norm            [dim]
+//    layers.<i>.attention.wq, wo          [dim, dim]
+//    layers.<i>.attention.wk, wv          [kv_dim, dim]
+//    layers.<i>.ffn_norm                  [dim]
+//    layers.<i>.feed_forward.w1, w3       [hidden_dim, dim]
+//    layers.<i>.feed_forward.w2           [dim, hidden_dim]
+//    norm                                 [dim]
+//    output                               [vocab_size, dim] (absent if tied)
+// where kv_dim = n_kv_heads * (dim / n_heads). n_kv_heads must divide
+// n_heads; n_kv_heads < n_heads is grouped-query attention (1 = multi-query).
+// The 2D attention, feed-forward and output matrices may be stored
+// block-quantized; embeddings and norms are always f32.
+
 } // namespace DaisoML
 
 #endif // DAISOML_FILE_FORMAT_H
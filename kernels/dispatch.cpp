@@ -0,0 +1,63 @@
+#include "kernels.h"
+#include "../utils.h"
+#include <cstdlib>
+#include <string>
+
+namespace DaisoML {
+namespace kernels {
+
+static bool cpu_has_avx2() {
+#if defined(DAISO_HAVE_AVX2) && (defined(__GNUC__) || defined(__clang__))
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("f16c");
+#else
+    return false;
+#endif
+}
+
+static bool cpu_has_avx512() {
+#if defined(DAISO_HAVE_AVX512) && (defined(__GNUC__) || defined(__clang__))
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("fma");
+#else
+    return false;
+#endif
+}
+
+// Returns the table named by `isa`, or nullptr if it is unavailable here.
+static const KernelTable* find_table(const std::string& isa) {
+    if (isa == "scalar") return &scalar_table();
+#if defined(DAISO_HAVE_AVX512)
+    if (isa == "avx512" && cpu_has_avx512()) return &avx512_table();
+#endif
+#if defined(DAISO_HAVE_AVX2)
+    if (isa == "avx2" && cpu_has_avx2()) return &avx2_table();
+#endif
+#if defined(DAISO_HAVE_NEON)
+    if (isa == "neon") return &neon_table();
+#endif
+    return nullptr;
+}
+
+static const KernelTable& select_table() {
+    if (const char* forced = std::getenv("DAISO_ISA")) {
+        if (const KernelTable* table = find_table(forced)) {
+            return *table;
+        }
+        log(LogLevel::Warn, std::string("DAISO_ISA=") + forced + " is not available, using autodetection.");
+    }
+    for (const char* isa : {"avx512", "avx2", "neon"}) {
+        if (const KernelTable* table = find_table(isa)) {
+            return *table;
+        }
+    }
+    return scalar_table();
+}
+
+const KernelTable& active() {
+    static const KernelTable& table = select_table();
+    return table;
+}
+
+} // namespace kernels
+} // namespace DaisoML
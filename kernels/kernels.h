@@ -0,0 +1,78 @@
+#ifndef DAISOML_KERNELS_H
+#define DAISOML_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace DaisoML {
+namespace kernels {
+
+// Table of low-level float32 routines. One table exists per instruction set
+// (scalar, AVX2, AVX-512, NEON); the best one supported by the running CPU is
+// selected once at startup. All matrices are row-major and densely packed.
+struct KernelTable {
+    const char* name;
+
+    // Returns sum(a[i] * b[i]) for i in [0, n).
+    float (*dot)(const float* a, const float* b, size_t n);
+
+    // y[i] += alpha * x[i] for i in [0, n).
+    void (*axpy)(float* y, float alpha, const float* x, size_t n);
+
+    // out[r] = dot(w[r, :], x) for r in [0, rows). w is [rows, cols].
+    void (*gemv)(float* out, const float* w, const float* x, size_t rows, size_t cols);
+
+    // out[t, r] = dot(x[t, :], w[r, :]) for t in [0, n), r in [0, rows).
+    // x is [n, cols], w is [rows, cols], out is [n, ldo] with ldo >= rows.
+    void (*gemm_nt)(float* out, size_t ldo, const float* x, size_t n,
+                    const float* w, size_t rows, size_t cols);
+
+    // Fused dequantize-and-dot of one block-quantized row (see quant.h)
+    // against float x. n is a multiple of QK.
+    float (*dot_q8_0)(const void* w, const float* x, size_t n);
+    float (*dot_q4_0)(const void* w, const float* x, size_t n);
+
+    // Mixed-precision dot / axpy against a compressed KV cache row stored as
+    // IEEE half or as int8 (the caller applies the int8 scale).
+    float (*dot_f16)(const float* a, const uint16_t* b, size_t n);
+    void (*axpy_f16)(float* y, float alpha, const uint16_t* x, size_t n);
+    float (*dot_i8)(const float* a, const int8_t* b, size_t n);
+    void (*axpy_i8)(float* y, float alpha, const int8_t* x, size_t n);
+
+    // Rotates the n / 2 interleaved pairs (x[2i], x[2i + 1]) of x:
+    //   x[2i]     = x[2i] * cos[2i]         + x[2i + 1] * sin[2i]
+    //   x[2i + 1] = x[2i + 1] * cos[2i + 1] + x[2i] * sin[2i + 1]
+    // with tables laid out {c, c} and {-s, s} per pair (see layers/rope.h).
+    void (*rope)(float* x, const float* cos, const float* sin, size_t n);
+};
+
+// The table selected for this process. Setting the environment variable
+// DAISO_ISA to "scalar", "avx2", "avx512" or "neon" forces a specific
+// implementation (if it was compiled in and the CPU supports it).
+const KernelTable& active();
+
+// Per-ISA tables; only the ones compiled for the target architecture exist.
+const KernelTable& scalar_table();
+#if defined(DAISO_HAVE_AVX2)
+const KernelTable& avx2_table();
+#endif
+#if defined(DAISO_HAVE_AVX512)
+const KernelTable& avx512_table();
+#endif
+#if defined(DAISO_HAVE_NEON)
+const KernelTable& neon_table();
+#endif
+
+// Rows of w processed per cache block by gemm_nt, so that the block of weights
+// stays resident in L2 while every activation row is streamed against it.
+inline size_t gemm_row_block(size_t cols) {
+    const size_t l2_budget = 256 * 1024 / sizeof(float);
+    size_t rows = cols ? l2_budget / cols : 64;
+    if (rows < 4) rows = 4;
+    return rows & ~static_cast<size_t>(3);
+}
+
+} // namespace kernels
+} // namespace DaisoML
+
+#endif //DAISOML_KERNELS_H
@@ -0,0 +1,296 @@
+#include "kernels.h"
+#include "quant.h"
+#include <immintrin.h>
+
+// This translation unit is compiled with -mavx2 -mfma -mf16c and must only be entered
+// after the dispatcher has confirmed CPU support.
+
+namespace DaisoML {
+namespace kernels {
+
+static inline float hsum256(__m256 v) {
+    __m128 lo = _mm256_castps256_ps128(v);
+    __m128 hi = _mm256_extractf128_ps(v, 1);
+    lo = _mm_add_ps(lo, hi);
+    __m128 shuf = _mm_movehdup_ps(lo);
+    __m128 sums = _mm_add_ps(lo, shuf);
+    shuf = _mm_movehl_ps(shuf, sums);
+    sums = _mm_add_ss(sums, shuf);
+    return _mm_cvtss_f32(sums);
+}
+
+static float dot_avx2(const float* a, const float* b, size_t n) {
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+    }
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+    }
+    float sum = hsum256(_mm256_add_ps(acc0, acc1));
+    for (; i < n; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+static void axpy_avx2(float* y, float alpha, const float* x, size_t n) {
+    const __m256 va = _mm256_set1_ps(alpha);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(y + i, _mm256_fmadd_ps(va, _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i)));
+    }
+    for (; i < n; ++i) {
+        y[i] += alpha * x[i];
+    }
+}
+
+// Computes four rows of w against x; each x load feeds four FMAs.
+static inline void gemv_4rows(float* out, const float* w, const float* x, size_t cols) {
+    const float* w0 = w;
+    const float* w1 = w + cols;
+    const float* w2 = w + 2 * cols;
+    const float* w3 = w + 3 * cols;
+    __m256 a0 = _mm256_setzero_ps(), a1 = _mm256_setzero_ps();
+    __m256 a2 = _mm256_setzero_ps(), a3 = _mm256_setzero_ps();
+    __m256 b0 = _mm256_setzero_ps(), b1 = _mm256_setzero_ps();
+    __m256 b2 = _mm256_setzero_ps(), b3 = _mm256_setzero_ps();
+    size_t j = 0;
+    for (; j + 16 <= cols; j += 16) {
+        const __m256 x0 = _mm256_loadu_ps(x + j);
+        const __m256 x1 = _mm256_loadu_ps(x + j + 8);
+        a0 = _mm256_fmadd_ps(_mm256_loadu_ps(w0 + j), x0, a0);
+        a1 = _mm256_fmadd_ps(_mm256_loadu_ps(w1 + j), x0, a1);
+        a2 = _mm256_fmadd_ps(_mm256_loadu_ps(w2 + j), x0, a2);
+        a3 = _mm256_fmadd_ps(_mm256_loadu_ps(w3 + j), x0, a3);
+        b0 = _mm256_fmadd_ps(_mm256_loadu_ps(w0 + j + 8), x1, b0);
+        b1 = _mm256_fmadd_ps(_mm256_loadu_ps(w1 + j + 8), x1, b1);
+        b2 = _mm256_fmadd_ps(_mm256_loadu_ps(w2 + j + 8), x1, b2);
+        b3 = _mm256_fmadd_ps(_mm256_loadu_ps(w3 + j + 8), x1, b3);
+    }
+    for (; j + 8 <= cols; j += 8) {
+        const __m256 x0 = _mm256_loadu_ps(x + j);
+        a0 = _mm256_fmadd_ps(_mm256_loadu_ps(w0 + j), x0, a0);
+        a1 = _mm256_fmadd_ps(_mm256_loadu_ps(w1 + j), x0, a1);
+        a2 = _mm256_fmadd_ps(_mm256_loadu_ps(w2 + j), x0, a2);
+        a3 = _mm256_fmadd_ps(_mm256_loadu_ps(w3 + j), x0, a3);
+    }
+    float s0 = hsum256(_mm256_add_ps(a0, b0));
+    float s1 = hsum256(_mm256_add_ps(a1, b1));
+    float s2 = hsum256(_mm256_add_ps(a2, b2));
+    float s3 = hsum256(_mm256_add_ps(a3, b3));
+    for (; j < cols; ++j) {
+        s0 += w0[j] * x[j];
+        s1 += w1[j] * x[j];
+        s2 += w2[j] * x[j];
+        s3 += w3[j] * x[j];
+    }
+    out[0] = s0;
+    out[1] = s1;
+    out[2] = s2;
+    out[3] = s3;
+}
+
+static void gemv_avx2(float* out, const float* w, const float* x, size_t rows, size_t cols) {
+    size_t r = 0;
+    for (; r + 4 <= rows; r += 4) {
+        gemv_4rows(out + r, w + r * cols, x, cols);
+    }
+    for (; r < rows; ++r) {
+        out[r] = dot_avx2(w + r * cols, x, cols);
+    }
+}
+
+// 4 weight rows x 2 activation rows register tile: 8 accumulators, and every
+// weight load is shared by both activation rows.
+static inline void gemm_tile_4x2(float* out0, float* out1, const float* w,
+                                 const float* x0, const float* x1, size_t cols) {
+    const float* w0 = w;
+    const float* w1 = w + cols;
+    const float* w2 = w + 2 * cols;
+    const float* w3 = w + 3 * cols;
+    __m256 a00 = _mm256_setzero_ps(), a10 = _mm256_setzero_ps();
+    __m256 a20 = _mm256_setzero_ps(), a30 = _mm256_setzero_ps();
+    __m256 a01 = _mm256_setzero_ps(), a11 = _mm256_setzero_ps();
+    __m256 a21 = _mm256_setzero_ps(), a31 = _mm256_setzero_ps();
+    size_t j = 0;
+    for (; j + 8 <= cols; j += 8) {
+        const __m256 xa = _mm256_loadu_ps(x0 + j);
+        const __m256 xb = _mm256_loadu_ps(x1 + j);
+        __m256 wv = _mm256_loadu_ps(w0 + j);
+        a00 = _mm256_fmadd_ps(wv, xa, a00);
+        a01 = _mm256_fmadd_ps(wv, xb, a01);
+        wv = _mm256_loadu_ps(w1 + j);
+        a10 = _mm256_fmadd_ps(wv, xa, a10);
+        a11 = _mm256_fmadd_ps(wv, xb, a11);
+        wv = _mm256_loadu_ps(w2 + j);
+        a20 = _mm256_fmadd_ps(wv, xa, a20);
+        a21 = _mm256_fmadd_ps(wv, xb, a21);
+        wv = _mm256_loadu_ps(w3 + j);
+        a30 = _mm256_fmadd_ps(wv, xa, a30);
+        a31 = _mm256_fmadd_ps(wv, xb, a31);
+    }
+    float s[8] = {
+        hsum256(a00), hsum256(a10), hsum256(a20), hsum256(a30),
+        hsum256(a01), hsum256(a11), hsum256(a21), hsum256(a31)
+    };
+    for (; j < cols; ++j) {
+        s[0] += w0[j] * x0[j]; s[1] += w1[j] * x0[j];
+        s[2] += w2[j] * x0[j]; s[3] += w3[j] * x0[j];
+        s[4] += w0[j] * x1[j]; s[5] += w1[j] * x1[j];
+        s[6] += w2[j] * x1[j]; s[7] += w3[j] * x1[j];
+    }
+    out0[0] = s[0]; out0[1] = s[1]; out0[2] = s[2]; out0[3] = s[3];
+    out1[0] = s[4]; out1[1] = s[5]; out1[2] = s[6]; out1[3] = s[7];
+}
+
+static void gemm_nt_avx2(float* out, size_t ldo, const float* x, size_t n,
+                         const float* w, size_t rows, size_t cols) {
+    const size_t block = gemm_row_block(cols);
+    for (size_t r0 = 0; r0 < rows; r0 += block) {
+        const size_t r1 = r0 + block < rows ? r0 + block : rows;
+        size_t t = 0;
+        for (; t + 2 <= n; t += 2) {
+            const float* x0 = x + t * cols;
+            const float* x1 = x0 + cols;
+            float* o0 = out + t * ldo;
+            float* o1 = o0 + ldo;
+            size_t r = r0;
+            for (; r + 4 <= r1; r += 4) {
+                gemm_tile_4x2(o0 + r, o1 + r, w + r * cols, x0, x1, cols);
+            }
+            for (; r < r1; ++r) {
+                o0[r] = dot_avx2(w + r * cols, x0, cols);
+                o1[r] = dot_avx2(w + r * cols, x1, cols);
+            }
+        }
+        for (; t < n; ++t) {
+            gemv_avx2(out + t * ldo + r0, w + r0 * cols, x + t * cols, r1 - r0, cols);
+        }
+    }
+}
+
+// Widens 8 signed bytes to 8 floats.
+static inline __m256 i8x8_to_ps(__m128i bytes) {
+    return _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(bytes));
+}
+
+static float dot_q8_0_avx2(const void* w, const float* x, size_t n) {
+    const BlockQ8_0* blocks = static_cast<const BlockQ8_0*>(w);
+    __m256 acc = _mm256_setzero_ps();
+    for (size_t b = 0; b < n / QK; ++b) {
+        const float* xb = x + b * QK;
+        const __m128i q_lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(blocks[b].qs));
+        const __m128i q_hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(blocks[b].qs + 16));
+        __m256 s = _mm256_mul_ps(i8x8_to_ps(q_lo), _mm256_loadu_ps(xb));
+        s = _mm256_fmadd_ps(i8x8_to_ps(_mm_srli_si128(q_lo, 8)), _mm256_loadu_ps(xb + 8), s);
+        s = _mm256_fmadd_ps(i8x8_to_ps(q_hi), _mm256_loadu_ps(xb + 16), s);
+        s = _mm256_fmadd_ps(i8x8_to_ps(_mm_srli_si128(q_hi, 8)), _mm256_loadu_ps(xb + 24), s);
+        acc = _mm256_fmadd_ps(s, _mm256_set1_ps(fp16_to_fp32(blocks[b].d)), acc);
+    }
+    return hsum256(acc);
+}
+
+static float dot_q4_0_avx2(const void* w, const float* x, size_t n) {
+    const BlockQ4_0* blocks = static_cast<const BlockQ4_0*>(w);
+    const __m128i mask = _mm_set1_epi8(0x0F);
+    const __m128i eight = _mm_set1_epi8(8);
+    __m256 acc = _mm256_setzero_ps();
+    for (size_t b = 0; b < n / QK; ++b) {
+        const float* xb = x + b * QK;
+        const __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(blocks[b].qs));
+        const __m128i lo = _mm_sub_epi8(_mm_and_si128(packed, mask), eight);
+        const __m128i hi = _mm_sub_epi8(_mm_and_si128(_mm_srli_epi16(packed, 4), mask), eight);
+        __m256 s = _mm256_mul_ps(i8x8_to_ps(lo), _mm256_loadu_ps(xb));
+        s = _mm256_fmadd_ps(i8x8_to_ps(_mm_srli_si128(lo, 8)), _mm256_loadu_ps(xb + 8), s);
+        s = _mm256_fmadd_ps(i8x8_to_ps(hi), _mm256_loadu_ps(xb + 16), s);
+        s = _mm256_fmadd_ps(i8x8_to_ps(_mm_srli_si128(hi, 8)), _mm256_loadu_ps(xb + 24), s);
+        acc = _mm256_fmadd_ps(s, _mm256_set1_ps(fp16_to_fp32(blocks[b].d)), acc);
+    }
+    return hsum256(acc);
+}
+
+static float dot_f16_avx2(const float* a, const uint16_t* b, size_t n) {
+    __m256 acc = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256 bv = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+        acc = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), bv, acc);
+    }
+    float sum = hsum256(acc);
+    for (; i < n; ++i) {
+        sum += a[i] * fp16_to_fp32(b[i]);
+    }
+    return sum;
+}
+
+static void axpy_f16_avx2(float* y, float alpha, const uint16_t* x, size_t n) {
+    const __m256 va = _mm256_set1_ps(alpha);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256 xv = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i)));
+        _mm256_storeu_ps(y + i, _mm256_fmadd_ps(va, xv, _mm256_loadu_ps(y + i)));
+    }
+    for (; i < n; ++i) {
+        y[i] += alpha * fp16_to_fp32(x[i]);
+    }
+}
+
+static float dot_i8_avx2(const float* a, const int8_t* b, size_t n) {
+    __m256 acc = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256 bv = i8x8_to_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(b + i)));
+        acc = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), bv, acc);
+    }
+    float sum = hsum256(acc);
+    for (; i < n; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+static void axpy_i8_avx2(float* y, float alpha, const int8_t* x, size_t n) {
+    const __m256 va = _mm256_set1_ps(alpha);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256 xv = i8x8_to_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(x + i)));
+        _mm256_storeu_ps(y + i, _mm256_fmadd_ps(va, xv, _mm256_loadu_ps(y + i)));
+    }
+    for (; i < n; ++i) {
+        y[i] += alpha * x[i];
+    }
+}
+
+static void rope_avx2(float* x, const float* cos, const float* sin, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256 xv = _mm256_loadu_ps(x + i);
+        const __m256 swapped = _mm256_permute_ps(xv, 0xB1); // x1, x0, x3, x2, ...
+        const __m256 r = _mm256_fmadd_ps(swapped, _mm256_loadu_ps(sin + i),
+                                         _mm256_mul_ps(xv, _mm256_loadu_ps(cos + i)));
+        _mm256_storeu_ps(x + i, r);
+    }
+    for (; i + 1 < n; i += 2) {
+        const float x0 = x[i];
+        const float x1 = x[i + 1];
+        x[i] = x0 * cos[i] + x1 * sin[i];
+        x[i + 1] = x1 * cos[i + 1] + x0 * sin[i + 1];
+    }
+}
+
+const KernelTable& avx2_table() {
+    static const KernelTable table = {
+        "avx2", dot_avx2, axpy_avx2, gemv_avx2, gemm_nt_avx2,
+        dot_q8_0_avx2, dot_q4_0_avx2,
+        dot_f16_avx2, axpy_f16_avx2, dot_i8_avx2, axpy_i8_avx2,
+        rope_avx2
+    };
+    return table;
+}
+
+} // namespace kernels
+} // namespace DaisoML
@@ -0,0 +1,258 @@
+#include "kernels.h"
+#include "quant.h"
+#include <immintrin.h>
+
+// This translation unit is compiled with -mavx512f -mfma and must only be
+// entered after the dispatcher has confirmed CPU support. Column tails are
+// handled with masked loads instead of scalar loops.
+
+namespace DaisoML {
+namespace kernels {
+
+static inline __mmask16 tail_mask(size_t remaining) {
+    return static_cast<__mmask16>((1u << remaining) - 1u);
+}
+
+static float dot_avx512(const float* a, const float* b, size_t n) {
+    __m512 acc0 = _mm512_setzero_ps();
+    __m512 acc1 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc0);
+        acc1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16), acc1);
+    }
+    for (; i + 16 <= n; i += 16) {
+        acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc0);
+    }
+    if (i < n) {
+        const __mmask16 m = tail_mask(n - i);
+        acc1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, a + i), _mm512_maskz_loadu_ps(m, b + i), acc1);
+    }
+    return _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1));
+}
+
+static void axpy_avx512(float* y, float alpha, const float* x, size_t n) {
+    const __m512 va = _mm512_set1_ps(alpha);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        _mm512_storeu_ps(y + i, _mm512_fmadd_ps(va, _mm512_loadu_ps(x + i), _mm512_loadu_ps(y + i)));
+    }
+    if (i < n) {
+        const __mmask16 m = tail_mask(n - i);
+        const __m512 r = _mm512_fmadd_ps(va, _mm512_maskz_loadu_ps(m, x + i), _mm512_maskz_loadu_ps(m, y + i));
+        _mm512_mask_storeu_ps(y + i, m, r);
+    }
+}
+
+// Four rows of w against x; each x load feeds four FMAs.
+static inline void gemv_4rows(float* out, const float* w, const float* x, size_t cols) {
+    const float* w0 = w;
+    const float* w1 = w + cols;
+    const float* w2 = w + 2 * cols;
+    const float* w3 = w + 3 * cols;
+    __m512 a0 = _mm512_setzero_ps(), a1 = _mm512_setzero_ps();
+    __m512 a2 = _mm512_setzero_ps(), a3 = _mm512_setzero_ps();
+    size_t j = 0;
+    for (; j + 16 <= cols; j += 16) {
+        const __m512 xv = _mm512_loadu_ps(x + j);
+        a0 = _mm512_fmadd_ps(_mm512_loadu_ps(w0 + j), xv, a0);
+        a1 = _mm512_fmadd_ps(_mm512_loadu_ps(w1 + j), xv, a1);
+        a2 = _mm512_fmadd_ps(_mm512_loadu_ps(w2 + j), xv, a2);
+        a3 = _mm512_fmadd_ps(_mm512_loadu_ps(w3 + j), xv, a3);
+    }
+    if (j < cols) {
+        const __mmask16 m = tail_mask(cols - j);
+        const __m512 xv = _mm512_maskz_loadu_ps(m, x + j);
+        a0 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, w0 + j), xv, a0);
+        a1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, w1 + j), xv, a1);
+        a2 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, w2 + j), xv, a2);
+        a3 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, w3 + j), xv, a3);
+    }
+    out[0] = _mm512_reduce_add_ps(a0);
+    out[1] = _mm512_reduce_add_ps(a1);
+    out[2] = _mm512_reduce_add_ps(a2);
+    out[3] = _mm512_reduce_add_ps(a3);
+}
+
+static void gemv_avx512(float* out, const float* w, const float* x, size_t rows, size_t cols) {
+    size_t r = 0;
+    for (; r + 4 <= rows; r += 4) {
+        gemv_4rows(out + r, w + r * cols, x, cols);
+    }
+    for (; r < rows; ++r) {
+        out[r] = dot_avx512(w + r * cols, x, cols);
+    }
+}
+
+// 4 weight rows x 4 activation rows register tile (16 accumulators out of the
+// 32 available zmm registers).
+static inline void gemm_tile_4x4(float* out, size_t ldo, const float* w, const float* x, size_t cols) {
+    __m512 acc[4][4];
+    for (int r = 0; r < 4; ++r) {
+        for (int t = 0; t < 4; ++t) {
+            acc[r][t] = _mm512_setzero_ps();
+        }
+    }
+    size_t j = 0;
+    for (; j < cols; j += 16) {
+        const __mmask16 m = cols - j >= 16 ? static_cast<__mmask16>(0xFFFF) : tail_mask(cols - j);
+        __m512 xv[4];
+        for (int t = 0; t < 4; ++t) {
+            xv[t] = _mm512_maskz_loadu_ps(m, x + t * cols + j);
+        }
+        for (int r = 0; r < 4; ++r) {
+            const __m512 wv = _mm512_maskz_loadu_ps(m, w + r * cols + j);
+            for (int t = 0; t < 4; ++t) {
+                acc[r][t] = _mm512_fmadd_ps(wv, xv[t], acc[r][t]);
+            }
+        }
+    }
+    for (int t = 0; t < 4; ++t) {
+        for (int r = 0; r < 4; ++r) {
+            out[t * ldo + r] = _mm512_reduce_add_ps(acc[r][t]);
+        }
+    }
+}
+
+static void gemm_nt_avx512(float* out, size_t ldo, const float* x, size_t n,
+                           const float* w, size_t rows, size_t cols) {
+    const size_t block = gemm_row_block(cols);
+    for (size_t r0 = 0; r0 < rows; r0 += block) {
+        const size_t r1 = r0 + block < rows ? r0 + block : rows;
+        size_t t = 0;
+        for (; t + 4 <= n; t += 4) {
+            size_t r = r0;
+            for (; r + 4 <= r1; r += 4) {
+                gemm_tile_4x4(out + t * ldo + r, ldo, w + r * cols, x + t * cols, cols);
+            }
+            for (; r < r1; ++r) {
+                for (size_t u = t; u < t + 4; ++u) {
+                    out[u * ldo + r] = dot_avx512(w + r * cols, x + u * cols, cols);
+                }
+            }
+        }
+        for (; t < n; ++t) {
+            gemv_avx512(out + t * ldo + r0, w + r0 * cols, x + t * cols, r1 - r0, cols);
+        }
+    }
+}
+
+// Widens 16 signed bytes to 16 floats.
+static inline __m512 i8x16_to_ps(__m128i bytes) {
+    return _mm512_cvtepi32_ps(_mm512_cvtepi8_epi32(bytes));
+}
+
+static float dot_q8_0_avx512(const void* w, const float* x, size_t n) {
+    const BlockQ8_0* blocks = static_cast<const BlockQ8_0*>(w);
+    __m512 acc = _mm512_setzero_ps();
+    for (size_t b = 0; b < n / QK; ++b) {
+        const float* xb = x + b * QK;
+        const __m128i q_lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(blocks[b].qs));
+        const __m128i q_hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(blocks[b].qs + 16));
+        __m512 s = _mm512_mul_ps(i8x16_to_ps(q_lo), _mm512_loadu_ps(xb));
+        s = _mm512_fmadd_ps(i8x16_to_ps(q_hi), _mm512_loadu_ps(xb + 16), s);
+        acc = _mm512_fmadd_ps(s, _mm512_set1_ps(fp16_to_fp32(blocks[b].d)), acc);
+    }
+    return _mm512_reduce_add_ps(acc);
+}
+
+static float dot_q4_0_avx512(const void* w, const float* x, size_t n) {
+    const BlockQ4_0* blocks = static_cast<const BlockQ4_0*>(w);
+    const __m128i mask = _mm_set1_epi8(0x0F);
+    const __m128i eight = _mm_set1_epi8(8);
+    __m512 acc = _mm512_setzero_ps();
+    for (size_t b = 0; b < n / QK; ++b) {
+        const float* xb = x + b * QK;
+        const __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(blocks[b].qs));
+        const __m128i lo = _mm_sub_epi8(_mm_and_si128(packed, mask), eight);
+        const __m128i hi = _mm_sub_epi8(_mm_and_si128(_mm_srli_epi16(packed, 4), mask), eight);
+        __m512 s = _mm512_mul_ps(i8x16_to_ps(lo), _mm512_loadu_ps(xb));
+        s = _mm512_fmadd_ps(i8x16_to_ps(hi), _mm512_loadu_ps(xb + 16), s);
+        acc = _mm512_fmadd_ps(s, _mm512_set1_ps(fp16_to_fp32(blocks[b].d)), acc);
+    }
+    return _mm512_reduce_add_ps(acc);
+}
+
+static float dot_f16_avx512(const float* a, const uint16_t* b, size_t n) {
+    __m512 acc = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m512 bv = _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i)));
+        acc = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), bv, acc);
+    }
+    float sum = _mm512_reduce_add_ps(acc);
+    for (; i < n; ++i) {
+        sum += a[i] * fp16_to_fp32(b[i]);
+    }
+    return sum;
+}
+
+static void axpy_f16_avx512(float* y, float alpha, const uint16_t* x, size_t n) {
+    const __m512 va = _mm512_set1_ps(alpha);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m512 xv = _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(x + i)));
+        _mm512_storeu_ps(y + i, _mm512_fmadd_ps(va, xv, _mm512_loadu_ps(y + i)));
+    }
+    for (; i < n; ++i) {
+        y[i] += alpha * fp16_to_fp32(x[i]);
+    }
+}
+
+static float dot_i8_avx512(const float* a, const int8_t* b, size_t n) {
+    __m512 acc = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m512 bv = i8x16_to_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+        acc = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), bv, acc);
+    }
+    float sum = _mm512_reduce_add_ps(acc);
+    for (; i < n; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+static void axpy_i8_avx512(float* y, float alpha, const int8_t* x, size_t n) {
+    const __m512 va = _mm512_set1_ps(alpha);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m512 xv = i8x16_to_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i)));
+        _mm512_storeu_ps(y + i, _mm512_fmadd_ps(va, xv, _mm512_loadu_ps(y + i)));
+    }
+    for (; i < n; ++i) {
+        y[i] += alpha * x[i];
+    }
+}
+
+static void rope_avx512(float* x, const float* cos, const float* sin, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m512 xv = _mm512_loadu_ps(x + i);
+        const __m512 swapped = _mm512_permute_ps(xv, 0xB1); // x1, x0, x3, x2, ...
+        const __m512 r = _mm512_fmadd_ps(swapped, _mm512_loadu_ps(sin + i),
+                                         _mm512_mul_ps(xv, _mm512_loadu_ps(cos + i)));
+        _mm512_storeu_ps(x + i, r);
+    }
+    if (i + 1 < n) {
+        const __mmask16 m = tail_mask((n - i) & ~static_cast<size_t>(1));
+        const __m512 xv = _mm512_maskz_loadu_ps(m, x + i);
+        const __m512 swapped = _mm512_permute_ps(xv, 0xB1);
+        const __m512 r = _mm512_fmadd_ps(swapped, _mm512_maskz_loadu_ps(m, sin + i),
+                                         _mm512_mul_ps(xv, _mm512_maskz_loadu_ps(m, cos + i)));
+        _mm512_mask_storeu_ps(x + i, m, r);
+    }
+}
+
+const KernelTable& avx512_table() {
+    static const KernelTable table = {
+        "avx512", dot_avx512, axpy_avx512, gemv_avx512, gemm_nt_avx512,
+        dot_q8_0_avx512, dot_q4_0_avx512,
+        dot_f16_avx512, axpy_f16_avx512, dot_i8_avx512, axpy_i8_avx512,
+        rope_avx512
+    };
+    return table;
+}
+
+} // namespace kernels
+} // namespace DaisoML
@@ -0,0 +1,207 @@
+#include "kernels.h"
+#include "quant.h"
+#include <arm_neon.h>
+
+// AArch64 Advanced SIMD implementation. NEON is part of the base ARMv8-A
+// profile, so no runtime check is needed once this file is compiled in.
+
+namespace DaisoML {
+namespace kernels {
+
+static float dot_neon(const float* a, const float* b, size_t n) {
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        acc0 = vfmaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+        acc1 = vfmaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+    for (; i + 4 <= n; i += 4) {
+        acc0 = vfmaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+    }
+    float sum = vaddvq_f32(vaddq_f32(acc0, acc1));
+    for (; i < n; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+static void axpy_neon(float* y, float alpha, const float* x, size_t n) {
+    const float32x4_t va = vdupq_n_f32(alpha);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        vst1q_f32(y + i, vfmaq_f32(vld1q_f32(y + i), va, vld1q_f32(x + i)));
+    }
+    for (; i < n; ++i) {
+        y[i] += alpha * x[i];
+    }
+}
+
+static void gemv_neon(float* out, const float* w, const float* x, size_t rows, size_t cols) {
+    size_t r = 0;
+    for (; r + 4 <= rows; r += 4) {
+        const float* w0 = w + (r + 0) * cols;
+        const float* w1 = w + (r + 1) * cols;
+        const float* w2 = w + (r + 2) * cols;
+        const float* w3 = w + (r + 3) * cols;
+        float32x4_t a0 = vdupq_n_f32(0.0f), a1 = vdupq_n_f32(0.0f);
+        float32x4_t a2 = vdupq_n_f32(0.0f), a3 = vdupq_n_f32(0.0f);
+        size_t j = 0;
+        for (; j + 4 <= cols; j += 4) {
+            const float32x4_t xv = vld1q_f32(x + j);
+            a0 = vfmaq_f32(a0, vld1q_f32(w0 + j), xv);
+            a1 = vfmaq_f32(a1, vld1q_f32(w1 + j), xv);
+            a2 = vfmaq_f32(a2, vld1q_f32(w2 + j), xv);
+            a3 = vfmaq_f32(a3, vld1q_f32(w3 + j), xv);
+        }
+        float s0 = vaddvq_f32(a0), s1 = vaddvq_f32(a1);
+        float s2 = vaddvq_f32(a2), s3 = vaddvq_f32(a3);
+        for (; j < cols; ++j) {
+            s0 += w0[j] * x[j];
+            s1 += w1[j] * x[j];
+            s2 += w2[j] * x[j];
+            s3 += w3[j] * x[j];
+        }
+        out[r + 0] = s0;
+        out[r + 1] = s1;
+        out[r + 2] = s2;
+        out[r + 3] = s3;
+    }
+    for (; r < rows; ++r) {
+        out[r] = dot_neon(w + r * cols, x, cols);
+    }
+}
+
+static void gemm_nt_neon(float* out, size_t ldo, const float* x, size_t n,
+                         const float* w, size_t rows, size_t cols) {
+    const size_t block = gemm_row_block(cols);
+    for (size_t r0 = 0; r0 < rows; r0 += block) {
+        const size_t r1 = r0 + block < rows ? r0 + block : rows;
+        for (size_t t = 0; t < n; ++t) {
+            gemv_neon(out + t * ldo + r0, w + r0 * cols, x + t * cols, r1 - r0, cols);
+        }
+    }
+}
+
+// Multiplies 16 signed bytes by 16 floats of x and accumulates into acc.
+static inline float32x4_t fma_i8x16(float32x4_t acc, int8x16_t q, const float* x) {
+    const int16x8_t lo = vmovl_s8(vget_low_s8(q));
+    const int16x8_t hi = vmovl_s8(vget_high_s8(q));
+    acc = vfmaq_f32(acc, vcvtq_f32_s32(vmovl_s16(vget_low_s16(lo))), vld1q_f32(x));
+    acc = vfmaq_f32(acc, vcvtq_f32_s32(vmovl_s16(vget_high_s16(lo))), vld1q_f32(x + 4));
+    acc = vfmaq_f32(acc, vcvtq_f32_s32(vmovl_s16(vget_low_s16(hi))), vld1q_f32(x + 8));
+    acc = vfmaq_f32(acc, vcvtq_f32_s32(vmovl_s16(vget_high_s16(hi))), vld1q_f32(x + 12));
+    return acc;
+}
+
+static float dot_q8_0_neon(const void* w, const float* x, size_t n) {
+    const BlockQ8_0* blocks = static_cast<const BlockQ8_0*>(w);
+    float32x4_t acc = vdupq_n_f32(0.0f);
+    for (size_t b = 0; b < n / QK; ++b) {
+        const float* xb = x + b * QK;
+        float32x4_t s = vdupq_n_f32(0.0f);
+        s = fma_i8x16(s, vld1q_s8(blocks[b].qs), xb);
+        s = fma_i8x16(s, vld1q_s8(blocks[b].qs + 16), xb + 16);
+        acc = vfmaq_n_f32(acc, s, fp16_to_fp32(blocks[b].d));
+    }
+    return vaddvq_f32(acc);
+}
+
+static float dot_q4_0_neon(const void* w, const float* x, size_t n) {
+    const BlockQ4_0* blocks = static_cast<const BlockQ4_0*>(w);
+    const uint8x16_t mask = vdupq_n_u8(0x0F);
+    const int8x16_t eight = vdupq_n_s8(8);
+    float32x4_t acc = vdupq_n_f32(0.0f);
+    for (size_t b = 0; b < n / QK; ++b) {
+        const float* xb = x + b * QK;
+        const uint8x16_t packed = vld1q_u8(blocks[b].qs);
+        const int8x16_t lo = vsubq_s8(vreinterpretq_s8_u8(vandq_u8(packed, mask)), eight);
+        const int8x16_t hi = vsubq_s8(vreinterpretq_s8_u8(vshrq_n_u8(packed, 4)), eight);
+        float32x4_t s = vdupq_n_f32(0.0f);
+        s = fma_i8x16(s, lo, xb);
+        s = fma_i8x16(s, hi, xb + 16);
+        acc = vfmaq_n_f32(acc, s, fp16_to_fp32(blocks[b].d));
+    }
+    return vaddvq_f32(acc);
+}
+
+static float dot_f16_neon(const float* a, const uint16_t* b, size_t n) {
+    float32x4_t acc = vdupq_n_f32(0.0f);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const float32x4_t bv = vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(b + i)));
+        acc = vfmaq_f32(acc, vld1q_f32(a + i), bv);
+    }
+    float sum = vaddvq_f32(acc);
+    for (; i < n; ++i) {
+        sum += a[i] * fp16_to_fp32(b[i]);
+    }
+    return sum;
+}
+
+static void axpy_f16_neon(float* y, float alpha, const uint16_t* x, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const float32x4_t xv = vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(x + i)));
+        vst1q_f32(y + i, vfmaq_n_f32(vld1q_f32(y + i), xv, alpha));
+    }
+    for (; i < n; ++i) {
+        y[i] += alpha * fp16_to_fp32(x[i]);
+    }
+}
+
+static float dot_i8_neon(const float* a, const int8_t* b, size_t n) {
+    float32x4_t acc = vdupq_n_f32(0.0f);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        acc = fma_i8x16(acc, vld1q_s8(b + i), a + i);
+    }
+    float sum = vaddvq_f32(acc);
+    for (; i < n; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+static void axpy_i8_neon(float* y, float alpha, const int8_t* x, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const int16x8_t w = vmovl_s8(vld1_s8(x + i));
+        const float32x4_t x0 = vcvtq_f32_s32(vmovl_s16(vget_low_s16(w)));
+        const float32x4_t x1 = vcvtq_f32_s32(vmovl_s16(vget_high_s16(w)));
+        vst1q_f32(y + i, vfmaq_n_f32(vld1q_f32(y + i), x0, alpha));
+        vst1q_f32(y + i + 4, vfmaq_n_f32(vld1q_f32(y + i + 4), x1, alpha));
+    }
+    for (; i < n; ++i) {
+        y[i] += alpha * x[i];
+    }
+}
+
+static void rope_neon(float* x, const float* cos, const float* sin, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const float32x4_t xv = vld1q_f32(x + i);
+        const float32x4_t swapped = vrev64q_f32(xv); // x1, x0, x3, x2
+        const float32x4_t r = vfmaq_f32(vmulq_f32(xv, vld1q_f32(cos + i)), swapped, vld1q_f32(sin + i));
+        vst1q_f32(x + i, r);
+    }
+    for (; i + 1 < n; i += 2) {
+        const float x0 = x[i];
+        const float x1 = x[i + 1];
+        x[i] = x0 * cos[i] + x1 * sin[i];
+        x[i + 1] = x1 * cos[i + 1] + x0 * sin[i + 1];
+    }
+}
+
+const KernelTable& neon_table() {
+    static const KernelTable table = {
+        "neon", dot_neon, axpy_neon, gemv_neon, gemm_nt_neon,
+        dot_q8_0_neon, dot_q4_0_neon,
+        dot_f16_neon, axpy_f16_neon, dot_i8_neon, axpy_i8_neon,
+        rope_neon
+    };
+    return table;
+}
+
+} // namespace kernels
+} // namespace DaisoML
@@ -0,0 +1,151 @@
+#include "kernels.h"
+#include "quant.h"
+
+namespace DaisoML {
+namespace kernels {
+
+// Portable fallback. Uses several independent accumulators so the compiler can
+// overlap the floating point adds even without explicit vector intrinsics.
+
+static float dot_scalar(const float* a, const float* b, size_t n) {
+    float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        s0 += a[i] * b[i];
+        s1 += a[i + 1] * b[i + 1];
+        s2 += a[i + 2] * b[i + 2];
+        s3 += a[i + 3] * b[i + 3];
+    }
+    for (; i < n; ++i) {
+        s0 += a[i] * b[i];
+    }
+    return (s0 + s1) + (s2 + s3);
+}
+
+static void axpy_scalar(float* y, float alpha, const float* x, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        y[i] += alpha * x[i];
+    }
+}
+
+static void gemv_scalar(float* out, const float* w, const float* x, size_t rows, size_t cols) {
+    size_t r = 0;
+    // Four rows at a time: every load of x is reused four times.
+    for (; r + 4 <= rows; r += 4) {
+        const float* w0 = w + (r + 0) * cols;
+        const float* w1 = w + (r + 1) * cols;
+        const float* w2 = w + (r + 2) * cols;
+        const float* w3 = w + (r + 3) * cols;
+        float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+        for (size_t j = 0; j < cols; ++j) {
+            const float xj = x[j];
+            s0 += w0[j] * xj;
+            s1 += w1[j] * xj;
+            s2 += w2[j] * xj;
+            s3 += w3[j] * xj;
+        }
+        out[r + 0] = s0;
+        out[r + 1] = s1;
+        out[r + 2] = s2;
+        out[r + 3] = s3;
+    }
+    for (; r < rows; ++r) {
+        out[r] = dot_scalar(w + r * cols, x, cols);
+    }
+}
+
+static void gemm_nt_scalar(float* out, size_t ldo, const float* x, size_t n,
+                           const float* w, size_t rows, size_t cols) {
+    const size_t block = gemm_row_block(cols);
+    for (size_t r0 = 0; r0 < rows; r0 += block) {
+        const size_t r1 = r0 + block < rows ? r0 + block : rows;
+        for (size_t t = 0; t < n; ++t) {
+            gemv_scalar(out + t * ldo + r0, w + r0 * cols, x + t * cols, r1 - r0, cols);
+        }
+    }
+}
+
+static float dot_q8_0_scalar(const void* w, const float* x, size_t n) {
+    const BlockQ8_0* blocks = static_cast<const BlockQ8_0*>(w);
+    float sum = 0.0f;
+    for (size_t b = 0; b < n / QK; ++b) {
+        const float* xb = x + b * QK;
+        float s0 = 0.0f, s1 = 0.0f;
+        for (size_t i = 0; i < QK; i += 2) {
+            s0 += blocks[b].qs[i] * xb[i];
+            s1 += blocks[b].qs[i + 1] * xb[i + 1];
+        }
+        sum += (s0 + s1) * fp16_to_fp32(blocks[b].d);
+    }
+    return sum;
+}
+
+static float dot_q4_0_scalar(const void* w, const float* x, size_t n) {
+    const BlockQ4_0* blocks = static_cast<const BlockQ4_0*>(w);
+    float sum = 0.0f;
+    for (size_t b = 0; b < n / QK; ++b) {
+        const float* xb = x + b * QK;
+        float s0 = 0.0f, s1 = 0.0f;
+        for (size_t i = 0; i < QK / 2; ++i) {
+            s0 += ((int)(blocks[b].qs[i] & 0x0F) - 8) * xb[i];
+            s1 += ((int)(blocks[b].qs[i] >> 4) - 8) * xb[i + QK / 2];
+        }
+        sum += (s0 + s1) * fp16_to_fp32(blocks[b].d);
+    }
+    return sum;
+}
+
+static float dot_f16_scalar(const float* a, const uint16_t* b, size_t n) {
+    float sum = 0.0f;
+    for (size_t i = 0; i < n; ++i) {
+        sum += a[i] * fp16_to_fp32(b[i]);
+    }
+    return sum;
+}
+
+static void axpy_f16_scalar(float* y, float alpha, const uint16_t* x, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        y[i] += alpha * fp16_to_fp32(x[i]);
+    }
+}
+
+static float dot_i8_scalar(const float* a, const int8_t* b, size_t n) {
+    float s0 = 0.0f, s1 = 0.0f;
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        s0 += a[i] * b[i];
+        s1 += a[i + 1] * b[i + 1];
+    }
+    for (; i < n; ++i) {
+        s0 += a[i] * b[i];
+    }
+    return s0 + s1;
+}
+
+static void axpy_i8_scalar(float* y, float alpha, const int8_t* x, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        y[i] += alpha * x[i];
+    }
+}
+
+static void rope_scalar(float* x, const float* cos, const float* sin, size_t n) {
+    for (size_t i = 0; i + 1 < n; i += 2) {
+        const float x0 = x[i];
+        const float x1 = x[i + 1];
+        x[i] = x0 * cos[i] + x1 * sin[i];
+        x[i + 1] = x1 * cos[i + 1] + x0 * sin[i + 1];
+    }
+}
+
+const KernelTable& scalar_table() {
+    static const KernelTable table = {
+        "scalar", dot_scalar, axpy_scalar, gemv_scalar, gemm_nt_scalar,
+        dot_q8_0_scalar, dot_q4_0_scalar,
+        dot_f16_scalar, axpy_f16_scalar, dot_i8_scalar, axpy_i8_scalar,
+        rope_scalar
+    };
+    return table;
+}
+
+} // namespace kernels
+} // namespace DaisoML
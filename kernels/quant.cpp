@@ -0,0 +1,73 @@
+#include "quant.h"
+#include <cmath>
+
+namespace DaisoML {
+namespace kernels {
+
+void quantize_row_q8_0(const float* x, void* dst, size_t n) {
+    BlockQ8_0* blocks = static_cast<BlockQ8_0*>(dst);
+    for (size_t b = 0; b < n / QK; ++b) {
+        const float* xb = x + b * QK;
+        float amax = 0.0f;
+        for (size_t i = 0; i < QK; ++i) {
+            amax = std::fmax(amax, std::fabs(xb[i]));
+        }
+        const float d = amax / 127.0f;
+        const float id = d != 0.0f ? 1.0f / d : 0.0f;
+        blocks[b].d = fp32_to_fp16(d);
+        for (size_t i = 0; i < QK; ++i) {
+            blocks[b].qs[i] = (int8_t)std::lround(xb[i] * id);
+        }
+    }
+}
+
+void quantize_row_q4_0(const float* x, void* dst, size_t n) {
+    BlockQ4_0* blocks = static_cast<BlockQ4_0*>(dst);
+    for (size_t b = 0; b < n / QK; ++b) {
+        const float* xb = x + b * QK;
+        // Use the signed value with the largest magnitude so it maps to -8,
+        // which gives the 4-bit grid one extra step on that side.
+        float amax = 0.0f;
+        float max = 0.0f;
+        for (size_t i = 0; i < QK; ++i) {
+            if (std::fabs(xb[i]) > amax) {
+                amax = std::fabs(xb[i]);
+                max = xb[i];
+            }
+        }
+        const float d = max / -8.0f;
+        const float id = d != 0.0f ? 1.0f / d : 0.0f;
+        blocks[b].d = fp32_to_fp16(d);
+        for (size_t i = 0; i < QK / 2; ++i) {
+            int q0 = (int)std::lround(xb[i] * id) + 8;
+            int q1 = (int)std::lround(xb[i + QK / 2] * id) + 8;
+            q0 = q0 < 0 ? 0 : (q0 > 15 ? 15 : q0);
+            q1 = q1 < 0 ? 0 : (q1 > 15 ? 15 : q1);
+            blocks[b].qs[i] = (uint8_t)(q0 | (q1 << 4));
+        }
+    }
+}
+
+void dequantize_row_q8_0(const void* src, float* y, size_t n) {
+    const BlockQ8_0* blocks = static_cast<const BlockQ8_0*>(src);
+    for (size_t b = 0; b < n / QK; ++b) {
+        const float d = fp16_to_fp32(blocks[b].d);
+        for (size_t i = 0; i < QK; ++i) {
+            y[b * QK + i] = blocks[b].qs[i] * d;
+        }
+    }
+}
+
+void dequantize_row_q4_0(const void* src, float* y, size_t n) {
+    const BlockQ4_0* blocks = static_cast<const BlockQ4_0*>(src);
+    for (size_t b = 0; b < n / QK; ++b) {
+        const float d = fp16_to_fp32(blocks[b].d);
+        for (size_t i = 0; i < QK / 2; ++i) {
+            y[b * QK + i] = ((int)(blocks[b].qs[i] & 0x0F) - 8) * d;
+            y[b * QK + i + QK / 2] = ((int)(blocks[b].qs[i] >> 4) - 8) * d;
+        }
+    }
+}
+
+} // namespace kernels
+} // namespace DaisoML
@@ -0,0 +1,98 @@
+#ifndef DAISOML_QUANT_H
+#define DAISOML_QUANT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace DaisoML {
+namespace kernels {
+
+// Block-quantized weight formats. A row of `cols` weights is stored as
+// cols / QK consecutive blocks, each with its own scale, so a matrix row can
+// be dequantized (or dotted) independently of the others.
+constexpr size_t QK = 32;
+
+// 8-bit: value = qs[i] * d
+struct BlockQ8_0 {
+    uint16_t d;      // scale, IEEE half precision
+    int8_t qs[QK];
+};
+
+// 4-bit: value = (nibble - 8) * d. Element i (< 16) is the low nibble of
+// qs[i], element i + 16 the high nibble.
+struct BlockQ4_0 {
+    uint16_t d;      // scale, IEEE half precision
+    uint8_t qs[QK / 2];
+};
+
+static_assert(sizeof(BlockQ8_0) == 34, "BlockQ8_0 must be packed");
+static_assert(sizeof(BlockQ4_0) == 18, "BlockQ4_0 must be packed");
+
+// Portable IEEE half <-> float conversion.
+inline float fp16_to_fp32(uint16_t h) {
+    const uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exp = (h >> 10) & 0x1F;
+    uint32_t mant = h & 0x3FF;
+    uint32_t bits;
+    if (exp == 0) {
+        if (mant == 0) {
+            bits = sign;
+        } else {
+            // Subnormal: renormalize
+            exp = 127 - 15 + 1;
+            while ((mant & 0x400) == 0) {
+                mant <<= 1;
+                --exp;
+            }
+            bits = sign | (exp << 23) | ((mant & 0x3FF) << 13);
+        }
+    } else if (exp == 0x1F) {
+        bits = sign | 0x7F800000 | (mant << 13);
+    } else {
+        bits = sign | ((exp + 127 - 15) << 23) | (mant << 13);
+    }
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+inline uint16_t fp32_to_fp16(float f) {
+    uint32_t bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    const uint16_t sign = (bits >> 16) & 0x8000;
+    const int32_t exp = (int32_t)((bits >> 23) & 0xFF) - 127 + 15;
+    uint32_t mant = bits & 0x7FFFFF;
+    if (((bits >> 23) & 0xFF) == 0xFF) {
+        return sign | 0x7C00 | (mant ? 0x200 : 0); // Inf / NaN
+    }
+    if (exp >= 0x1F) {
+        return sign | 0x7C00; // Overflow to infinity
+    }
+    if (exp <= 0) {
+        if (exp < -10) return sign; // Underflow to zero
+        mant |= 0x800000;
+        const uint32_t shift = (uint32_t)(14 - exp);
+        uint32_t half = mant >> shift;
+        const uint32_t rem = mant & ((1u << shift) - 1);
+        const uint32_t halfway = 1u << (shift - 1);
+        if (rem > halfway || (rem == halfway && (half & 1))) ++half;
+        return sign | (uint16_t)half;
+    }
+    uint32_t half = ((uint32_t)exp << 10) | (mant >> 13);
+    const uint32_t rem = mant & 0x1FFF;
+    if (rem > 0x1000 || (rem == 0x1000 && (half & 1))) ++half; // Round to nearest even
+    return sign | (uint16_t)half;
+}
+
+// Offline quantization and reference dequantization of one row. `n` must be
+// a multiple of QK.
+void quantize_row_q8_0(const float* x, void* dst, size_t n);
+void quantize_row_q4_0(const float* x, void* dst, size_t n);
+void dequantize_row_q8_0(const void* src, float* y, size_t n);
+void dequantize_row_q4_0(const void* src, float* y, size_t n);
+
+} // namespace kernels
+} // namespace DaisoML
+
+#endif //DAISOML_QUANT_H
@@ -0,0 +1,391 @@
+#include "kv_cache.h"
+#include "utils.h"
+#include "kernels/quant.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <new>
+
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#endif
+
+namespace DaisoML {
+
+const char* kv_type_name(KVType type) {
+    switch (type) {
+        case KVType::F32: return "f32";
+        case KVType::F16: return "f16";
+        case KVType::Q8: return "q8";
+    }
+    return "unknown";
+}
+
+KVType kv_type_from_name(const std::string& name) {
+    if (name == "f32") return KVType::F32;
+    if (name == "f16") return KVType::F16;
+    if (name == "q8") return KVType::Q8;
+    throw DaisoException("Unknown KV cache type: " + name);
+}
+
+const char* kv_layout_name(KVLayout layout) {
+    switch (layout) {
+        case KVLayout::HeadMajor: return "head";
+        case KVLayout::PositionMajor: return "position";
+    }
+    return "unknown";
+}
+
+KVLayout kv_layout_from_name(const std::string& name) {
+    if (name == "head") return KVLayout::HeadMajor;
+    if (name == "position") return KVLayout::PositionMajor;
+    throw DaisoException("Unknown KV cache layout: " + name);
+}
+
+size_t kv_element_bytes(KVType type) {
+    switch (type) {
+        case KVType::F32: return sizeof(float);
+        case KVType::F16: return sizeof(uint16_t);
+        case KVType::Q8: return sizeof(int8_t);
+    }
+    return sizeof(float);
+}
+
+void kv_encode_row(KVType type, const float* src, int n, uint8_t* dst, float* scale) {
+    switch (type) {
+        case KVType::F32:
+            std::memcpy(dst, src, (size_t)n * sizeof(float));
+            break;
+        case KVType::F16: {
+            uint16_t* out = reinterpret_cast<uint16_t*>(dst);
+            for (int i = 0; i < n; ++i) {
+                out[i] = kernels::fp32_to_fp16(src[i]);
+            }
+            break;
+        }
+        case KVType::Q8: {
+            // Symmetric scale: the largest magnitude maps to 127
+            int8_t* out = reinterpret_cast<int8_t*>(dst);
+            float amax = 0.0f;
+            for (int i = 0; i < n; ++i) {
+                amax = std::max(amax, std::fabs(src[i]));
+            }
+            const float d = amax / 127.0f;
+            const float id = d > 0.0f ? 1.0f / d : 0.0f;
+            for (int i = 0; i < n; ++i) {
+                out[i] = (int8_t)std::lround(src[i] * id);
+            }
+            *scale = d;
+            break;
+        }
+    }
+}
+
+void kv_decode_row(KVType type, const uint8_t* src, float scale, int n, float* dst) {
+    switch (type) {
+        case KVType::F32:
+            std::memcpy(dst, src, (size_t)n * sizeof(float));
+            break;
+        case KVType::F16: {
+            const uint16_t* in = reinterpret_cast<const uint16_t*>(src);
+            for (int i = 0; i < n; ++i) {
+                dst[i] = kernels::fp16_to_fp32(in[i]);
+            }
+            break;
+        }
+        case KVType::Q8: {
+            const int8_t* in = reinterpret_cast<const int8_t*>(src);
+            for (int i = 0; i < n; ++i) {
+                dst[i] = (float)in[i] * scale;
+            }
+            break;
+        }
+    }
+}
+
+KVCache::KVCache(int n_layers, int n_kv_heads, int head_dim, int block_size, int max_blocks, KVType type,
+                 KVLayout layout)
+    : n_layers(n_layers), n_heads(n_kv_heads), head_len(head_dim), block_len(block_size),
+      block_limit(max_blocks), kv_type(type), kv_layout(layout) {
+    if (n_layers <= 0 || n_kv_heads <= 0 || head_dim <= 0 || block_size <= 0 || max_blocks <= 0) {
+        throw DaisoException("Invalid KV cache configuration.");
+    }
+    head_bytes = (size_t)head_dim * kv_element_bytes(type);
+    if (layout == KVLayout::HeadMajor) {
+        // Every head row starts on a cache line
+        pos_stride = (head_bytes + 63) / 64 * 64;
+        head_offset = (size_t)block_size * pos_stride;
+    } else {
+        pos_stride = (size_t)n_kv_heads * head_bytes;
+        head_offset = head_bytes;
+    }
+    // Keep the scales (and the next layer) 64-byte aligned
+    scales_offset = ((size_t)block_size * row_bytes() + 63) / 64 * 64;
+    const size_t scales_len = type == KVType::Q8 ? (size_t)block_size * n_kv_heads * sizeof(float) : 0;
+    layer_len = scales_offset + (scales_len + 63) / 64 * 64;
+
+    // The layer offsets are multiples of 64, so aligning the pool aligns
+    // every head row and scale array in it
+    block_bytes = 2 * (size_t)n_layers * layer_len;
+    pool_bytes = (size_t)max_blocks * block_bytes;
+#if defined(_WIN32)
+    storage = new (std::nothrow) uint8_t[pool_bytes + 64];
+    if (!storage) {
+        throw DaisoException("Cannot allocate the KV cache pool (" + std::to_string(pool_bytes >> 20) +
+                             " MiB); lower the number of cached tokens.");
+    }
+    const uintptr_t p = reinterpret_cast<uintptr_t>(storage);
+    pool = storage + ((p + 63) / 64 * 64 - p);
+#else
+    // Only address space is reserved: pages are committed as blocks are
+    // first written, so a large pool costs nothing until it is used
+    void* addr = mmap(nullptr, pool_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1,
+                      0);
+    if (addr == MAP_FAILED) {
+        throw DaisoException("Cannot reserve the KV cache pool (" + std::to_string(pool_bytes >> 20) +
+                             " MiB); lower the number of cached tokens.");
+    }
+    storage = static_cast<uint8_t*>(addr);
+    pool = storage; // page aligned
+#endif
+    refs.assign(max_blocks, 0);
+    free_blocks.reserve(max_blocks);
+}
+
+KVCache::~KVCache() {
+#if defined(_WIN32)
+    delete[] storage;
+#else
+    munmap(storage, pool_bytes);
+#endif
+}
+
+int KVCache::create_sequence() {
+    size_t i = 0;
+    while (i < sequences.size() && sequences[i].active) {
+        ++i;
+    }
+    if (i == sequences.size()) sequences.emplace_back();
+    // A block table never grows past the pool, so growing a sequence
+    // during decode does not reallocate it
+    sequences[i].blocks.reserve(block_limit);
+    sequences[i].active = true;
+    return (int)i;
+}
+
+void KVCache::free_sequence(int seq) {
+    Sequence& s = sequence(seq);
+    for (int block : s.blocks) {
+        release_block(block);
+    }
+    // Keep the block table's capacity for the next sequence in this slot
+    s.blocks.clear();
+    s.length = 0;
+    s.active = false;
+}
+
+void KVCache::attach(int seq, const std::vector<int>& shared) {
+    Sequence& s = sequence(seq);
+    if (s.length != 0) {
+        throw DaisoException("Shared blocks can only start an empty sequence.");
+    }
+    for (int block : shared) {
+        retain_block(block);
+    }
+    s.blocks = shared;
+    s.length = (int)shared.size() * block_len;
+}
+
+void KVCache::resize(int seq, int n_positions) {
+    if (n_positions < 0) {
+        throw DaisoException("KV cache length must not be negative.");
+    }
+    Sequence& s = sequence(seq);
+    const size_t needed = ((size_t)n_positions + block_len - 1) / block_len;
+    while (s.blocks.size() < needed) {
+        s.blocks.push_back(allocate_block());
+    }
+    while (s.blocks.size() > needed) {
+        release_block(s.blocks.back());
+        s.blocks.pop_back();
+    }
+    s.length = n_positions;
+}
+
+int KVCache::length(int seq) const {
+    return sequence(seq).length;
+}
+
+const std::vector<int>& KVCache::block_table(int seq) const {
+    return sequence(seq).blocks;
+}
+
+int KVCache::writable_block(int seq, int pos) const {
+    const Sequence& s = sequence(seq);
+    if (pos < 0 || pos >= s.length) {
+        throw DaisoException("KV cache position out of range.");
+    }
+    const int block = s.blocks[pos / block_len];
+    if (refs[block] > 1) {
+        throw DaisoException("Cannot write to a shared KV cache block.");
+    }
+    return block;
+}
+
+void KVCache::store(int seq, int layer, int pos, const float* k, const float* v) {
+    const int block = writable_block(seq, pos);
+    const int row = pos % block_len;
+    store_row(rows(block, 0, layer), row, k);
+    store_row(rows(block, 1, layer), row, v);
+}
+
+void KVCache::store_encoded(int seq, int layer, int pos, const uint8_t* k, const uint8_t* v, const float* k_scales,
+                            const float* v_scales) {
+    const int block = writable_block(seq, pos);
+    const int row = pos % block_len;
+    store_encoded_row(rows(block, 0, layer), row, k, k_scales);
+    store_encoded_row(rows(block, 1, layer), row, v, v_scales);
+}
+
+void KVCache::store_row(uint8_t* layer_rows, int row, const float* src) const {
+    // Q8 keeps one scale per head
+    float* scales = reinterpret_cast<float*>(layer_rows + scales_offset);
+    for (int h = 0; h < n_heads; ++h) {
+        float* scale = kv_type == KVType::Q8 ? &scales[h * scale_head_offset() + row * scale_stride()] : nullptr;
+        kv_encode_row(kv_type, src + (size_t)h * head_len, head_len, layer_rows + h * head_offset + row * pos_stride,
+                      scale);
+    }
+}
+
+void KVCache::store_encoded_row(uint8_t* layer_rows, int row, const uint8_t* src, const float* src_scales) const {
+    float* scales = reinterpret_cast<float*>(layer_rows + scales_offset);
+    for (int h = 0; h < n_heads; ++h) {
+        std::memcpy(layer_rows + h * head_offset + row * pos_stride, src + h * head_bytes, head_bytes);
+        if (kv_type == KVType::Q8) {
+            scales[h * scale_head_offset() + row * scale_stride()] = src_scales[h];
+        }
+    }
+}
+
+uint8_t* KVCache::rows(int block, int kind, int layer) {
+    return pool + (size_t)block * block_bytes + ((size_t)kind * n_layers + layer) * layer_len;
+}
+
+const uint8_t* KVCache::rows(int block, int kind, int layer) const {
+    return pool + (size_t)block * block_bytes + ((size_t)kind * n_layers + layer) * layer_len;
+}
+
+const uint8_t* KVCache::keys(int block, int layer, int head) const {
+    return rows(block, 0, layer) + head * head_offset;
+}
+
+const uint8_t* KVCache::values(int block, int layer, int head) const {
+    return rows(block, 1, layer) + head * head_offset;
+}
+
+const float* KVCache::key_scales(int block, int layer, int head) const {
+    return reinterpret_cast<const float*>(rows(block, 0, layer) + scales_offset) + head * scale_head_offset();
+}
+
+const float* KVCache::value_scales(int block, int layer, int head) const {
+    return reinterpret_cast<const float*>(rows(block, 1, layer) + scales_offset) + head * scale_head_offset();
+}
+
+size_t KVCache::position_stride() const {
+    return pos_stride;
+}
+
+size_t KVCache::scale_stride() const {
+    return kv_layout == KVLayout::HeadMajor ? 1 : (size_t)n_heads;
+}
+
+size_t KVCache::scale_head_offset() const {
+    return kv_layout == KVLayout::HeadMajor ? (size_t)block_len : 1;
+}
+
+KVType KVCache::type() const {
+    return kv_type;
+}
+
+KVLayout KVCache::layout() const {
+    return kv_layout;
+}
+
+int KVCache::block_size() const {
+    return block_len;
+}
+
+int KVCache::n_kv_heads() const {
+    return n_heads;
+}
+
+int KVCache::head_dim() const {
+    return head_len;
+}
+
+size_t KVCache::row_bytes() const {
+    return kv_layout == KVLayout::HeadMajor ? (size_t)n_heads * pos_stride : pos_stride;
+}
+
+size_t KVCache::head_row_bytes() const {
+    return head_bytes;
+}
+
+int KVCache::used_blocks() const {
+    return next_block - (int)free_blocks.size();
+}
+
+int KVCache::max_blocks() const {
+    return block_limit;
+}
+
+int KVCache::block_refs(int block) const {
+    return refs.at(block);
+}
+
+void KVCache::retain_block(int block) {
+    if (refs.at(block) <= 0) {
+        throw DaisoException("Cannot share a free KV cache block.");
+    }
+    refs[block]++;
+}
+
+void KVCache::release_block(int block) {
+    if (refs.at(block) <= 0) {
+        throw DaisoException("KV cache block released twice.");
+    }
+    if (--refs[block] == 0) {
+        free_blocks.push_back(block);
+    }
+}
+
+int KVCache::allocate_block() {
+    // Reuse released blocks before touching new ones
+    int block;
+    if (!free_blocks.empty()) {
+        block = free_blocks.back();
+        free_blocks.pop_back();
+    } else if (next_block < block_limit) {
+        block = next_block++;
+    } else {
+        throw DaisoException("KV cache is full.");
+    }
+    refs[block] = 1;
+    return block;
+}
+
+KVCache::Sequence& KVCache::sequence(int seq) {
+    if (seq < 0 || (size_t)seq >= sequences.size() || !sequences[seq].active) {
+        throw DaisoException("Unknown KV cache sequence: " + std::to_string(seq));
+    }
+    return sequences[seq];
+}
+
+const KVCache::Sequence& KVCache::sequence(int seq) const {
+    if (seq < 0 || (size_t)seq >= sequences.size() || !sequences[seq].active) {
+        throw DaisoException("Unknown KV cache sequence: " + std::to_string(seq));
+    }
+    return sequences[seq];
+}
+
+} // namespace DaisoML
@@ -0,0 +1,177 @@
+#ifndef DAISOML_KV_CACHE_H
+#define DAISOML_KV_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace DaisoML {
+
+// Storage type of cached keys and values.
+enum class KVType {
+    F32,
+    F16, // IEEE half
+    Q8,  // int8 with one float scale per (position, KV head)
+};
+
+const char* kv_type_name(KVType type);
+// Parses "f32", "f16" or "q8"; throws otherwise.
+KVType kv_type_from_name(const std::string& name);
+// Bytes of one element of `type`
+size_t kv_element_bytes(KVType type);
+// Converts n floats to one row of `type` and back. Q8 rows have one scale,
+// written to / read from `scale`.
+void kv_encode_row(KVType type, const float* src, int n, uint8_t* dst, float* scale);
+void kv_decode_row(KVType type, const uint8_t* src, float scale, int n, float* dst);
+
+// Order of the cached rows within a block.
+enum class KVLayout {
+    // [kv_head][position][head_dim]: the rows one head attends over are
+    // contiguous, each padded to a 64-byte multiple
+    HeadMajor,
+    // [position][kv_head * head_dim]: one position's heads are contiguous
+    PositionMajor,
+};
+
+const char* kv_layout_name(KVLayout layout);
+// Parses "head" or "position"; throws otherwise.
+KVLayout kv_layout_from_name(const std::string& name);
+
+// Paged key/value cache shared by all sequences of a model.
+//
+// Memory is handed out in fixed-size blocks of `block_size` positions. A
+// block holds the keys and values of those positions for every layer; within
+// a layer the rows are ordered by KVLayout. With the default head-major
+// layout, attention for one KV head reads a single contiguous, aligned run
+// per block instead of striding over the other heads. Each sequence owns a block table mapping
+// logical block i (positions i * block_size ...) to a physical block, so a
+// sequence only uses memory for the positions it has, and blocks released by
+// one sequence are reused by the next. The pool of `max_blocks` blocks is one
+// cache-line aligned region whose address space is reserved up front, so
+// handing out a block never touches the heap. Blocks are handed out lowest
+// first and released ones are reused before new ones, and the OS commits a
+// block's pages when it is first written, so memory grows with use.
+//
+// Blocks are reference counted so that several sequences (and the prefix
+// cache, see prefix_cache.h) can share the blocks of a common prefix. Shared
+// blocks are read-only: a sequence only writes positions past them.
+//
+// Rows may be stored compressed (see KVType). Writers go through store(),
+// which converts; readers get the raw rows and use the matching
+// dot_f16/dot_i8/... routines from tensor.h, so the history is never
+// expanded back to f32.
+class KVCache {
+public:
+    KVCache(int n_layers, int n_kv_heads, int head_dim, int block_size, int max_blocks,
+            KVType type = KVType::F32, KVLayout layout = KVLayout::HeadMajor);
+
+    ~KVCache();
+
+    KVCache(const KVCache&) = delete;
+    KVCache& operator=(const KVCache&) = delete;
+
+    // Creates an empty sequence and returns its id.
+    int create_sequence();
+    // Releases the sequence and all its blocks.
+    void free_sequence(int seq);
+    // Starts the empty sequence `seq` with already filled `blocks`, which it
+    // then shares: its length becomes blocks.size() * block_size.
+    void attach(int seq, const std::vector<int>& blocks);
+
+    // Sets the number of cached positions of `seq`, allocating blocks as it
+    // grows and releasing them as it shrinks. Throws if the pool is exhausted.
+    void resize(int seq, int n_positions);
+    int length(int seq) const;
+
+    // Physical blocks of `seq`, in position order.
+    const std::vector<int>& block_table(int seq) const;
+
+    // Stores the keys and values ([kv_dim] floats each) of `layer` at
+    // position `pos` of `seq`, converting them to the cache type.
+    void store(int seq, int layer, int pos, const float* k, const float* v);
+    // Like store(), for keys and values already in the cache type:
+    // n_kv_heads rows of head_row_bytes() each, back to back, and for Q8
+    // their scales (nullptr otherwise).
+    void store_encoded(int seq, int layer, int pos, const uint8_t* k, const uint8_t* v, const float* k_scales,
+                       const float* v_scales);
+
+    // Keys / values of KV head `head` of `layer` in `block`: block_size rows
+    // of head_dim elements, position_stride() bytes apart.
+    const uint8_t* keys(int block, int layer, int head) const;
+    const uint8_t* values(int block, int layer, int head) const;
+    // Q8 only: the scales of those rows, scale_stride() floats apart.
+    const float* key_scales(int block, int layer, int head) const;
+    const float* value_scales(int block, int layer, int head) const;
+    size_t position_stride() const;
+    size_t scale_stride() const;
+
+    KVType type() const;
+    KVLayout layout() const;
+    int block_size() const;
+    int n_kv_heads() const;
+    int head_dim() const;
+    // Bytes one cached position takes (all KV heads, including padding)
+    size_t row_bytes() const;
+    // Bytes of one head's elements at one position
+    size_t head_row_bytes() const;
+    // Blocks currently owned by some sequence, and the pool limit.
+    int used_blocks() const;
+    int max_blocks() const;
+
+    // Holders of `block` (sequences and prefix caches). A block returns to
+    // the pool when its last reference is released.
+    int block_refs(int block) const;
+    void retain_block(int block);
+    void release_block(int block);
+
+private:
+    struct Sequence {
+        bool active = false;
+        int length = 0;
+        std::vector<int> blocks;
+    };
+
+    int allocate_block();
+    Sequence& sequence(int seq);
+    const Sequence& sequence(int seq) const;
+    // Start of the rows of `layer` for keys (kind 0) or values (kind 1)
+    uint8_t* rows(int block, int kind, int layer);
+    const uint8_t* rows(int block, int kind, int layer) const;
+    // Stores the heads of one position at `row` of a block's layer rows
+    void store_row(uint8_t* layer_rows, int row, const float* src) const;
+    void store_encoded_row(uint8_t* layer_rows, int row, const uint8_t* src, const float* scales) const;
+    // Block holding `pos` of `seq`, checked for writing
+    int writable_block(int seq, int pos) const;
+    // Floats between the Q8 scales of consecutive heads
+    size_t scale_head_offset() const;
+
+    int n_layers;
+    int n_heads; // KV heads
+    int head_len;
+    int block_len;
+    int block_limit;
+    KVType kv_type;
+    KVLayout kv_layout;
+    size_t head_bytes;    // bytes of one head's elements
+    size_t pos_stride;    // bytes between consecutive positions of one head
+    size_t head_offset;   // bytes between the rows of consecutive heads
+    size_t scales_offset; // offset of the Q8 scales within a layer
+    size_t layer_len;  // bytes per layer and kind: rows, then Q8 scales
+
+    // Block b is [2][n_layers][layer_len] (keys, then values) at
+    // pool + b * block_bytes. `storage` is the reserved region, with room to
+    // align `pool` to 64 bytes where it is not mapped.
+    uint8_t* storage;
+    uint8_t* pool;
+    size_t pool_bytes;
+    size_t block_bytes;
+    int next_block = 0; // blocks below it have been handed out before
+    std::vector<int> free_blocks;
+    std::vector<int> refs; // per block
+    std::vector<Sequence> sequences;
+};
+
+} // namespace DaisoML
+
+#endif //DAISOML_KV_CACHE_H
@@ -1,48 +1,59 @@
 #include "attention.h"
 #include "../utils.h"
-#include <fstream>
+#include "../model_file.h"
+#include "../thread_pool.h"
+#include "../kv_cache.h"
+#include "../profile.h"
+#include "../scratch.h"
+#include "rmsnorm.h"
+#include <algorithm>
 #include <vector>
 #include <cmath>
+#include <limits>
 #include <cstring> // For memcpy
 
 namespace DaisoML {
 
-// Helper to read a tensor from a file stream
-static void read_tensor(std::ifstream& file, Tensor* tensor) {
-    file.read(reinterpret_cast<char*>(tensor->data()), tensor->size() * sizeof(float));
+namespace {
+
+// Cached positions read by a pass, for the profiler's byte and flop counts
+inline uint64_t attended_positions(const int* positions, size_t n_tokens) {
+    uint64_t total = 0;
+    for (size_t t = 0; t < n_tokens; ++t) total += (uint64_t)positions[t] + 1;
+    return total;
 }
 
-// Helper to apply Rotary Position Embedding
-void apply_rope(float* q, float* k, int pos, int head_dim) {
-    for (int i = 0; i < head_dim; i += 2) {
-        float freq = 1.0f / std::pow(10000.0f, (float)i / head_dim);
-        float val = pos * freq;
-        float fcr = std::cos(val);
-        float fci = std::sin(val);
-
-        float q0 = q[i];
-        float q1 = q[i+1];
-        q[i]   = q0 * fcr - q1 * fci;
-        q[i+1] = q0 * fci + q1 * fcr;
-
-        float k0 = k[i];
-        float k1 = k[i+1];
-        k[i]   = k0 * fcr - k1 * fci;
-        k[i+1] = k0 * fci + k1 * fcr;
+// Asks for `rows` rows of `bytes` each, `stride` apart, to be brought into
+// cache ahead of use
+inline void prefetch_rows(const uint8_t* p, int rows, size_t stride, size_t bytes) {
+#if defined(__GNUC__) || defined(__clang__)
+    for (int r = 0; r < rows; ++r) {
+        for (size_t b = 0; b < bytes; b += 64) __builtin_prefetch(p + r * stride + b);
     }
+#else
+    (void)p; (void)rows; (void)stride; (void)bytes;
+#endif
 }
 
-Attention::Attention(int dim, int n_heads, int n_kv_heads, int seq_len)
-    : dim(dim), n_heads(n_heads), n_kv_heads(n_kv_heads), seq_len(seq_len) {
+} // namespace
+
+Attention::Attention(int dim, int n_heads, int n_kv_heads, int seq_len, const RoPE& rope)
+    : dim(dim), n_heads(n_heads), n_kv_heads(n_kv_heads), seq_len(seq_len), rope(rope) {
     
+    if (n_kv_heads <= 0 || n_heads % n_kv_heads != 0) {
+        throw DaisoException("n_heads must be a multiple of n_kv_heads.");
+    }
     head_dim = dim / n_heads;
+    kv_dim = n_kv_heads * head_dim;
+    kv_group = n_heads / n_kv_heads;
+    if (rope.head_dim() != head_dim || rope.max_positions() < seq_len) {
+        throw DaisoException("RoPE tables do not match the attention layer.");
+    }
 
-    wq = new Tensor({(size_t)dim, (size_t)dim});
-    wk = new Tensor({(size_t)dim, (size_t)dim});
-    wv = new Tensor({(size_t)dim, (size_t)dim});
-    wo = new Tensor({(size_t)dim, (size_t)dim});
+    // Weights are created by load_weights()
+    wq = wk = wv = wo = nullptr;
 
-    log("Initialized Attention Layer.");
+    log(LogLevel::Debug, "Initialized Attention Layer.");
 }
 
 Attention::~Attention() {
@@ -52,102 +63,249 @@ Attention::~Attention() {
     delete wo;
 }
 
-void Attention::read_weights(std::ifstream& file) {
-    read_tensor(file, wq);
-    read_tensor(file, wk);
-    read_tensor(file, wv);
-    read_tensor(file, wo);
+void Attention::load_weights(ModelFile& file, const std::string& prefix) {
+    wq = new Tensor(file.get(prefix + "wq", {(size_t)dim, (size_t)dim}));
+    wk = new Tensor(file.get(prefix + "wk", {(size_t)kv_dim, (size_t)dim}));
+    wv = new Tensor(file.get(prefix + "wv", {(size_t)kv_dim, (size_t)dim}));
+    wo = new Tensor(file.get(prefix + "wo", {(size_t)dim, (size_t)dim}));
+}
+
+size_t Attention::scratch_bytes(size_t n_tokens) const {
+    return ScratchArena::bytes_for({n_tokens * dim, n_tokens * dim, n_tokens * kv_dim, n_tokens * kv_dim,
+                                    n_tokens * dim, n_tokens + 1});
 }
 
-void Attention::forward(Tensor& out, const Tensor& input, int pos, int layer_idx, Tensor& full_k_cache, Tensor& full_v_cache) {
-    const float* x = input.data();
-    float* out_data = out.data();
-
-    // Buffers for Q, K, V and the concatenated head outputs
-    std::vector<float> q(dim);
-    std::vector<float> k(dim);
-    std::vector<float> v(dim);
-    std::vector<float> y(dim); // Buffer for concatenated head outputs
-
-    // 1. Calculate Q, K, V
-    // q = wq @ x
-    for (int i = 0; i < dim; ++i) {
-        float val = 0.0f;
-        for (int j = 0; j < dim; ++j) { val += wq->data()[i * dim + j] * x[j]; }
-        q[i] = val;
+void Attention::forward(float* x, size_t n_tokens, const RMSNorm& norm, const int* positions, const int* seqs,
+                        int layer_idx, KVCache& cache, ScratchArena& scratch) {
+    const size_t x_size = n_tokens * dim;
+    for (size_t t = 0; t < n_tokens; ++t) {
+        if (positions[t] < 0 || positions[t] >= seq_len) {
+            throw DaisoException("Attention input exceeds the maximum sequence length.");
+        }
+        if (positions[t] >= cache.length(seqs[t])) {
+            throw DaisoException("Attention input extends past the reserved KV cache.");
+        }
     }
-    // k = wk @ x
-    for (int i = 0; i < dim; ++i) {
-        float val = 0.0f;
-        for (int j = 0; j < dim; ++j) { val += wk->data()[i * dim + j] * x[j]; }
-        k[i] = val;
+
+    // Buffers for the normalized input, Q, K, V and the concatenated head
+    // outputs
+    ScratchArena::Scope scope(scratch);
+    float* xn = scratch.alloc_floats(n_tokens * dim);
+    float* q = scratch.alloc_floats(n_tokens * dim);
+    float* k = scratch.alloc_floats(n_tokens * kv_dim);
+    float* v = scratch.alloc_floats(n_tokens * kv_dim);
+    float* y = scratch.alloc_floats(n_tokens * dim);
+
+    // 1. Normalize, then calculate Q, K, V for every row. The three
+    // projections are split across the pool as one stacked matrix, so the
+    // normalized rows are shared by a single pass over all their weights.
+    {
+        DAISO_PROFILE_SCOPE(ProfileOp::AttnNorm, layer_idx, 2 * x_size * sizeof(float), 4 * (uint64_t)x_size);
+        norm.forward(xn, x, n_tokens);
     }
-    // v = wv @ x
-    for (int i = 0; i < dim; ++i) {
-        float val = 0.0f;
-        for (int j = 0; j < dim; ++j) { val += wv->data()[i * dim + j] * x[j]; }
-        v[i] = val;
+    {
+        DAISO_PROFILE_SCOPE(ProfileOp::AttnQKV, layer_idx,
+                            matmul_bytes(wq->nbytes() + wk->nbytes() + wv->nbytes(), dim + 2 * kv_dim, dim, n_tokens),
+                            matmul_flops(dim + 2 * kv_dim, dim, n_tokens));
+        float* const outs[] = {q, k, v};
+        const Tensor* const ws[] = {wq, wk, wv};
+        gemm_multi(outs, ws, 3, xn, n_tokens);
     }
 
-    // 2. Apply RoPE to Q and K heads
-    for (int h = 0; h < n_heads; ++h) {
-        float* q_head = &q[h * head_dim];
-        float* k_head = &k[h * head_dim];
-        apply_rope(q_head, k_head, pos, head_dim);
+    // 2. Apply RoPE to Q and K heads, and save K and V to the cache blocks of
+    // each row's sequence. All rows are stored before any is attended, so
+    // consecutive rows of one sequence see each other.
+    {
+        DAISO_PROFILE_SCOPE(ProfileOp::AttnRope, layer_idx,
+                            n_tokens * ((2 * dim + 4 * kv_dim) * sizeof(float) + 2 * cache.row_bytes()),
+                            n_tokens * 3 * (uint64_t)(dim + kv_dim));
+        for (size_t t = 0; t < n_tokens; ++t) {
+            rope.rotate(q + t * dim, n_heads, positions[t]);
+            rope.rotate(k + t * kv_dim, n_kv_heads, positions[t]);
+            cache.store(seqs[t], layer_idx, positions[t], &k[t * kv_dim], &v[t * kv_dim]);
+        }
     }
 
-    // 3. Save K and V to cache
-    // Cache layout: [n_layers, seq_len, dim]
-    size_t k_cache_offset = layer_idx * (seq_len * dim) + pos * dim;
-    size_t v_cache_offset = layer_idx * (seq_len * dim) + pos * dim;
-
-    std::memcpy(full_k_cache.data() + k_cache_offset, k.data(), dim * sizeof(float));
-    std::memcpy(full_v_cache.data() + v_cache_offset, v.data(), dim * sizeof(float));
-
-    // 4. Multi-head attention
-    std::vector<float> scores(seq_len); // Max possible scores
-    for (int h = 0; h < n_heads; ++h) {
-        float* q_head = &q[h * head_dim];
-        float* y_head = &y[h * head_dim];
-
-        // Calculate attention scores
-        for (int t = 0; t <= pos; ++t) {
-            float* k_head_cached = (full_k_cache.data() + layer_idx * (seq_len * dim) + t * dim) + h * head_dim;
-            float score = 0.0f;
-            for (int i = 0; i < head_dim; ++i) {
-                score += q_head[i] * k_head_cached[i];
-            }
-            scores[t] = score / std::sqrt((float)head_dim);
+    // 3. Causal attention with an online softmax. Rows are grouped into
+    // query tiles of up to kQueryTile consecutive rows of one sequence, and
+    // each (query tile, KV head) item streams its sequence's cached keys and
+    // values one cache block at a time: every block is scored against all
+    // rows and grouped query heads of the tile while it is in L1, the running
+    // max and sum of each head are updated, and the head outputs are
+    // rescaled and accumulated before the next block is read. The working
+    // set is one block of scores per item whatever the context length, and a
+    // prefill chunk reads each block once per tile rather than once per row.
+    // Query heads kv_group * g .. kv_group * (g + 1) - 1 share KV head g.
+    // Compressed rows are read in place by the mixed-precision dot/axpy
+    // kernels. Items are split across the thread pool.
+    int* tile_start = scratch.alloc_ints(n_tokens + 1);
+    size_t n_tiles = 0;
+    for (size_t t = 0; t < n_tokens; ++t) {
+        if (n_tiles == 0 || seqs[t] != seqs[tile_start[n_tiles - 1]] ||
+            t - tile_start[n_tiles - 1] >= kQueryTile) {
+            tile_start[n_tiles++] = (int)t;
         }
+    }
+    tile_start[n_tiles] = (int)n_tokens;
 
-        // Softmax the scores
-        float max_score = scores[0];
-        for (int t = 1; t <= pos; ++t) { if (scores[t] > max_score) max_score = scores[t]; }
-        float score_sum = 0.0f;
-        for (int t = 0; t <= pos; ++t) {
-            scores[t] = std::exp(scores[t] - max_score);
-            score_sum += scores[t];
-        }
-        for (int t = 0; t <= pos; ++t) { scores[t] /= score_sum; }
-
-        // Weighted sum of values
-        std::fill(y_head, y_head + head_dim, 0.0f);
-        for (int t = 0; t <= pos; ++t) {
-            float* v_head_cached = (full_v_cache.data() + layer_idx * (seq_len * dim) + t * dim) + h * head_dim;
-            for (int i = 0; i < head_dim; ++i) {
-                y_head[i] += scores[t] * v_head_cached[i];
+    const int block_size = cache.block_size();
+    const KVType type = cache.type();
+    const size_t stride = cache.position_stride();
+    const size_t scale_stride = cache.scale_stride();
+    const size_t head_bytes = cache.head_row_bytes();
+    const float scale = 1.0f / std::sqrt((float)head_dim);
+    {
+        // Each row reads the cached keys and values of all its positions once and
+        // does a dot product and an axpy per query head and position.
+        DAISO_PROFILE_SCOPE(ProfileOp::AttnCore, layer_idx,
+                            attended_positions(positions, n_tokens) * 2 * cache.row_bytes() + n_tokens * 2 * dim * sizeof(float),
+                            attended_positions(positions, n_tokens) * 4 * (uint64_t)dim);
+        parallel_for(n_tiles * n_kv_heads, 1, [&](size_t begin, size_t end) {
+            // Scores of one block and the running max / sum per (row, head).
+            // Sized once per thread.
+            thread_local std::vector<float> scores;
+            thread_local std::vector<float> run_max;
+            thread_local std::vector<float> run_sum;
+            const size_t states = kQueryTile * kv_group;
+            if (scores.size() < states * block_size) scores.resize(states * block_size);
+            if (run_max.size() < states) {
+                run_max.resize(states);
+                run_sum.resize(states);
             }
-        }
-    }
+            for (size_t item = begin; item < end; ++item) {
+                const size_t tile = item / n_kv_heads;
+                const int g = (int)(item % n_kv_heads);
+                const size_t t0 = tile_start[tile];
+                const size_t n_rows = tile_start[tile + 1] - t0;
+                const std::vector<int>& blocks = cache.block_table(seqs[t0]);
+                int max_pos = 0;
+                for (size_t i = 0; i < n_rows; ++i) max_pos = std::max(max_pos, positions[t0 + i] + 1);
 
-    // 5. Final projection
-    for (int i = 0; i < dim; ++i) {
-        float val = 0.0f;
-        for (int j = 0; j < dim; ++j) {
-            val += wo->data()[i * dim + j] * y[j];
-        }
-        out_data[i] = val;
+                for (size_t i = 0; i < n_rows; ++i) {
+                    float* y_group = &y[(t0 + i) * dim + (size_t)g * kv_group * head_dim];
+                    std::fill(y_group, y_group + (size_t)kv_group * head_dim, 0.0f);
+                }
+                std::fill(run_max.begin(), run_max.begin() + n_rows * kv_group, -std::numeric_limits<float>::infinity());
+                std::fill(run_sum.begin(), run_sum.begin() + n_rows * kv_group, 0.0f);
+
+                for (int p0 = 0; p0 < max_pos; p0 += block_size) {
+                    const int block = blocks[p0 / block_size];
+                    const uint8_t* k_block = cache.keys(block, layer_idx, g);
+                    const float* k_scales = cache.key_scales(block, layer_idx, g);
+                    const uint8_t* v_block = cache.values(block, layer_idx, g);
+                    const float* v_scales = cache.value_scales(block, layer_idx, g);
+                    const int rows = std::min(block_size, max_pos - p0);
+                    // The next block's rows for this head sit in other pages;
+                    // start loading them while this one is processed
+                    if (p0 + block_size < max_pos) {
+                        const int next = blocks[p0 / block_size + 1];
+                        prefetch_rows(cache.keys(next, layer_idx, g), block_size, stride, head_bytes);
+                        prefetch_rows(cache.values(next, layer_idx, g), block_size, stride, head_bytes);
+                    }
+
+                    // Scores of the block's positions each row may see
+                    for (int r = 0; r < rows; ++r) {
+                        const uint8_t* k_head_cached = k_block + r * stride;
+                        for (size_t i = 0; i < n_rows; ++i) {
+                            if (p0 + r > positions[t0 + i]) continue;
+                            const float* q_group = &q[(t0 + i) * dim + (size_t)g * kv_group * head_dim];
+                            float* s = &scores[i * kv_group * block_size + r];
+                            for (int j = 0; j < kv_group; ++j) {
+                                const float* q_head = q_group + j * head_dim;
+                                float score;
+                                switch (type) {
+                                    case KVType::F16:
+                                        score = dot_f16(q_head, reinterpret_cast<const uint16_t*>(k_head_cached),
+                                                        head_dim);
+                                        break;
+                                    case KVType::Q8:
+                                        score = dot_i8(q_head, reinterpret_cast<const int8_t*>(k_head_cached),
+                                                       head_dim) *
+                                                k_scales[r * scale_stride];
+                                        break;
+                                    default:
+                                        score = dot(q_head, reinterpret_cast<const float*>(k_head_cached), head_dim);
+                                        break;
+                                }
+                                s[(size_t)j * block_size] = score * scale;
+                            }
+                        }
+                    }
+
+                    // Online softmax: fold the block into each head's running
+                    // max and sum, rescaling what was accumulated so far, and
+                    // turn the scores into weights relative to the new max
+                    for (size_t i = 0; i < n_rows; ++i) {
+                        const int visible = std::min(rows, positions[t0 + i] + 1 - p0);
+                        if (visible <= 0) continue;
+                        float* y_group = &y[(t0 + i) * dim + (size_t)g * kv_group * head_dim];
+                        for (int j = 0; j < kv_group; ++j) {
+                            float* s = &scores[(i * kv_group + j) * block_size];
+                            const size_t state = i * kv_group + j;
+                            float block_max = s[0];
+                            for (int r = 1; r < visible; ++r) block_max = std::max(block_max, s[r]);
+                            const float new_max = std::max(run_max[state], block_max);
+                            const float correction = std::exp(run_max[state] - new_max);
+                            if (correction != 1.0f) {
+                                float* y_head = y_group + j * head_dim;
+                                for (int d = 0; d < head_dim; ++d) y_head[d] *= correction;
+                            }
+                            float block_sum = 0.0f;
+                            for (int r = 0; r < visible; ++r) {
+                                s[r] = std::exp(s[r] - new_max);
+                                block_sum += s[r];
+                            }
+                            run_sum[state] = run_sum[state] * correction + block_sum;
+                            run_max[state] = new_max;
+                        }
+                    }
+
+                    // Weighted sum of the block's values
+                    for (int r = 0; r < rows; ++r) {
+                        const uint8_t* v_head_cached = v_block + r * stride;
+                        for (size_t i = 0; i < n_rows; ++i) {
+                            if (p0 + r > positions[t0 + i]) continue;
+                            float* y_group = &y[(t0 + i) * dim + (size_t)g * kv_group * head_dim];
+                            const float* s = &scores[i * kv_group * block_size + r];
+                            for (int j = 0; j < kv_group; ++j) {
+                                float* y_head = y_group + j * head_dim;
+                                const float weight = s[(size_t)j * block_size];
+                                switch (type) {
+                                    case KVType::F16:
+                                        axpy_f16(y_head, weight, reinterpret_cast<const uint16_t*>(v_head_cached),
+                                                 head_dim);
+                                        break;
+                                    case KVType::Q8:
+                                        axpy_i8(y_head, weight * v_scales[r * scale_stride],
+                                                reinterpret_cast<const int8_t*>(v_head_cached), head_dim);
+                                        break;
+                                    default:
+                                        axpy(y_head, weight, reinterpret_cast<const float*>(v_head_cached), head_dim);
+                                        break;
+                                }
+                            }
+                        }
+                    }
+                }
+
+                // Normalize by the softmax denominators
+                for (size_t i = 0; i < n_rows; ++i) {
+                    float* y_group = &y[(t0 + i) * dim + (size_t)g * kv_group * head_dim];
+                    for (int j = 0; j < kv_group; ++j) {
+                        const float inv_sum = 1.0f / run_sum[i * kv_group + j];
+                        float* y_head = y_group + j * head_dim;
+                        for (int d = 0; d < head_dim; ++d) y_head[d] *= inv_sum;
+                    }
+                }
+            }
+        });
     }
+
+    // 4. Output projection, added straight into the residual stream
+    DAISO_PROFILE_SCOPE(ProfileOp::AttnOut, layer_idx,
+                        matmul_bytes(wo->nbytes(), dim, dim, n_tokens) + x_size * sizeof(float),
+                        matmul_flops(dim, dim, n_tokens) + x_size);
+    gemm_add(x, *wo, y, n_tokens);
 }
 
 } // namespace DaisoML
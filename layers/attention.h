@@ -2,25 +2,52 @@
 #define DAISOML_ATTENTION_H
 
 #include "../tensor.h"
+#include "rope.h"
+#include <string>
 
 namespace DaisoML {
 
+class ModelFile;
+class KVCache;
+class RMSNorm;
+class ScratchArena;
+
 class Attention {
 public:
-    Attention(int dim, int n_heads, int n_kv_heads, int seq_len);
+    // `rope` is shared between layers and must outlive this one.
+    Attention(int dim, int n_heads, int n_kv_heads, int seq_len, const RoPE& rope);
     ~Attention();
 
-    void forward(Tensor& out, const Tensor& input, int pos, int layer_idx, Tensor& full_k_cache, Tensor& full_v_cache);
-    void read_weights(std::ifstream& file);
+    // Adds attention over norm(x) to the residual stream x in place. `x` is
+    // [n_tokens, dim], one row per token; row t is at position
+    // positions[t] of KV cache sequence seqs[t]. Rows may belong to
+    // different sequences (batched decode) or be a run of one sequence
+    // (prefill). Their keys and values are stored in the cache, which must
+    // already cover them, and each row attends causally to its sequence up
+    // to itself. Temporaries come from `scratch`, which needs
+    // scratch_bytes(n) free.
+    void forward(float* x, size_t n_tokens, const RMSNorm& norm, const int* positions, const int* seqs,
+                 int layer_idx, KVCache& cache, ScratchArena& scratch);
+    size_t scratch_bytes(size_t n_tokens) const;
+    // Takes wq, wk, wv, wo from the file; names are `prefix` + "wq" etc.
+    void load_weights(ModelFile& file, const std::string& prefix);
 
 private:
+    // Consecutive rows of one sequence that share each pass over its cached
+    // keys and values
+    static constexpr size_t kQueryTile = 8;
+
     int dim;
     int n_heads;
     int n_kv_heads;
     int head_dim;
+    int kv_dim;     // n_kv_heads * head_dim
+    int kv_group;   // query heads sharing one KV head
     int seq_len;
+    const RoPE& rope;
 
-    // Weight matrices for Q, K, V and the output projection
+    // Weight matrices for Q, K, V and the output projection. wk and wv are
+    // [kv_dim, dim].
     Tensor* wq;
     Tensor* wk;
     Tensor* wv;
@@ -1,13 +1,14 @@
 #include "embedding.h"
 #include "../utils.h"
+#include "../model_file.h"
 #include <cstring>
 
 
 namespace DaisoML {
 
-Embedding::Embedding(int vocab_size, int dim) {
-    weights = new Tensor({(size_t)vocab_size, (size_t)dim});
-    log("Initialized Embedding Layer.");
+Embedding::Embedding(int vocab_size, int dim) : vocab_size(vocab_size), dim(dim) {
+    weights = nullptr; // Created by load_weights()
+    log(LogLevel::Debug, "Initialized Embedding Layer.");
 }
 
 Embedding::~Embedding() {
@@ -44,6 +45,24 @@ void Embedding::forward(Tensor& out, const Tensor& tokens) {
     std::memcpy(dest, source, dim * sizeof(float));
 }
 
+void Embedding::forward(float* out, const int* tokens, size_t n_tokens) {
+    const float* table = weights->data();
+    float* dest = out;
+    for (size_t i = 0; i < n_tokens; ++i) {
+        if (tokens[i] < 0 || tokens[i] >= vocab_size) {
+            throw DaisoException("Token ID out of vocabulary bounds.");
+        }
+        std::memcpy(dest + i * dim, table + (size_t)tokens[i] * dim, dim * sizeof(float));
+    }
+}
+
+
+void Embedding::load_weights(ModelFile& file, const std::string& name) {
+    weights = new Tensor(file.get(name, {(size_t)vocab_size, (size_t)dim}));
+    if (weights->dtype() != DType::F32) {
+        throw DaisoException("Embedding weights must be f32: " + name);
+    }
+}
 
 Tensor* Embedding::get_weights() {
     return weights;
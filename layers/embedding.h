@@ -2,9 +2,12 @@
 #define DAISOML_EMBEDDING_H
 
 #include "../tensor.h"
+#include <string>
 
 namespace DaisoML {
 
+class ModelFile;
+
 class Embedding {
 public:
     Embedding(int vocab_size, int dim);
@@ -12,11 +15,18 @@ public:
 
     // Perform the embedding lookup
     void forward(Tensor& out, const Tensor& tokens);
+    // Look up a batch of tokens; `out` is [n_tokens, dim]
+    void forward(float* out, const int* tokens, size_t n_tokens);
+
+    // Take the weights from the model file
+    void load_weights(ModelFile& file, const std::string& name);
 
     // Get a pointer to the weights tensor
     Tensor* get_weights();
 
 private:
+    int vocab_size;
+    int dim;
     Tensor* weights;
 
 };
@@ -1,22 +1,19 @@
 #include "feed_forward.h"
 #include "../utils.h"
-#include <fstream>
+#include "../model_file.h"
+#include "../profile.h"
+#include "../scratch.h"
+#include "rmsnorm.h"
 #include <vector>
 #include <cmath>
 
 
 namespace DaisoML {
 
-// Helper to read a tensor from a file stream
-static void read_tensor(std::ifstream& file, Tensor* tensor) {
-    file.read(reinterpret_cast<char*>(tensor->data()), tensor->size() * sizeof(float));
-}
-
-FeedForward::FeedForward(int dim, int hidden_dim) {
-    w1 = new Tensor({(size_t)hidden_dim, (size_t)dim});
-    w2 = new Tensor({(size_t)dim, (size_t)hidden_dim});
-    w3 = new Tensor({(size_t)hidden_dim, (size_t)dim});
-    log("Initialized FeedForward (SwiGLU) Layer.");
+FeedForward::FeedForward(int dim, int hidden_dim) : dim(dim), hidden_dim(hidden_dim) {
+    // Weights are created by load_weights()
+    w1 = w2 = w3 = nullptr;
+    log(LogLevel::Debug, "Initialized FeedForward (SwiGLU) Layer.");
 }
 
 FeedForward::~FeedForward() {
@@ -25,72 +22,52 @@ FeedForward::~FeedForward() {
     delete w3;
 }
 
-void FeedForward::read_weights(std::ifstream& file) {
-    read_tensor(file, w1);
-    read_tensor(file, w2);
-    read_tensor(file, w3);
+void FeedForward::load_weights(ModelFile& file, const std::string& prefix) {
+    w1 = new Tensor(file.get(prefix + "w1", {(size_t)hidden_dim, (size_t)dim}));
+    w2 = new Tensor(file.get(prefix + "w2", {(size_t)dim, (size_t)hidden_dim}));
+    w3 = new Tensor(file.get(prefix + "w3", {(size_t)hidden_dim, (size_t)dim}));
 }
 
 
-#include <vector>
-#include <cmath>
+size_t FeedForward::scratch_bytes(size_t n_tokens) const {
+    return ScratchArena::bytes_for({n_tokens * dim, n_tokens * hidden_dim});
+}
 
-void FeedForward::forward(Tensor& out, const Tensor& input) {
+void FeedForward::forward(float* x, size_t n_tokens, const RMSNorm& norm, ScratchArena& scratch) {
     // This implements the SwiGLU logic: F(x) = (Swish(x @ w1) * (x @ w3)) @ w2
     // where Swish(x) = x * sigmoid(x)
     // The weights are transposed compared to some implementations.
     // Here: w1, w3 are (hidden_dim, dim), w2 is (dim, hidden_dim)
-    // input is (dim), output is (dim)
+    // x is (n_tokens, dim)
 
-    const auto& x = input.data();
-    const auto& w1_data = w1->data();
-    const auto& w2_data = w2->data();
-    const auto& w3_data = w3->data();
-    auto out_data = out.data();
+    const size_t x_size = n_tokens * dim;
 
-    const int dim = input.shape()[0];
-    const int hidden_dim = w1->shape()[0];
+    // Temporary buffers for the normalized input and the hidden state
+    ScratchArena::Scope scope(scratch);
+    float* xn = scratch.alloc_floats(n_tokens * dim);
+    const size_t n_hidden = n_tokens * hidden_dim;
+    float* h = scratch.alloc_floats(n_hidden);
 
-    // Temporary buffer for the hidden state
-    std::vector<float> h(hidden_dim);
-    std::vector<float> h_gate(hidden_dim);
-
-    // 1. Calculate h = w1 @ x
-    for (int i = 0; i < hidden_dim; ++i) {
-        float val = 0.0f;
-        for (int j = 0; j < dim; ++j) {
-            val += w1_data[i * dim + j] * x[j];
-        }
-        h[i] = val;
-    }
-
-    // 2. Calculate h_gate = w3 @ x
-    for (int i = 0; i < hidden_dim; ++i) {
-        float val = 0.0f;
-        for (int j = 0; j < dim; ++j) {
-            val += w3_data[i * dim + j] * x[j];
-        }
-        h_gate[i] = val;
+    // 1. Normalize
+    {
+        DAISO_PROFILE_SCOPE(ProfileOp::FfnNorm, -1, 2 * x_size * sizeof(float), 4 * (uint64_t)x_size);
+        norm.forward(xn, x, n_tokens);
     }
 
-    // 3. Apply SwiGLU activation
-    for (int i = 0; i < hidden_dim; ++i) {
-        float val = h[i];
-        // Swish
-        val *= (1.0f / (1.0f + std::exp(-val)));
-        // Multiply by gate
-        val *= h_gate[i];
-        h[i] = val;
+    // 2. h = Swish(w1 @ x) * (w3 @ x), with w1 and w3 read side by side and
+    // the activation applied to each block of rows as it is produced
+    {
+        DAISO_PROFILE_SCOPE(ProfileOp::FfnGateUp, -1,
+                            matmul_bytes(w1->nbytes() + w3->nbytes(), 2 * (size_t)hidden_dim, dim, n_tokens),
+                            matmul_flops(2 * (size_t)hidden_dim, dim, n_tokens) + 6 * (uint64_t)n_hidden);
+        gemm_swiglu(h, *w1, *w3, xn, n_tokens);
     }
 
-    // 4. Project back down: out = w2 @ h
-    for (int i = 0; i < dim; ++i) {
-        float val = 0.0f;
-        for (int j = 0; j < hidden_dim; ++j) {
-            val += w2_data[i * hidden_dim + j] * h[j];
-        }
-        out_data[i] = val;
-    }
+    // 3. Project back down and add to the residual: x += w2 @ h
+    DAISO_PROFILE_SCOPE(ProfileOp::FfnDown, -1,
+                        matmul_bytes(w2->nbytes(), dim, hidden_dim, n_tokens) + x_size * sizeof(float),
+                        matmul_flops(dim, hidden_dim, n_tokens) + x_size);
+    gemm_add(x, *w2, h, n_tokens);
 }
 
 
@@ -2,19 +2,32 @@
 #define DAISOML_FEED_FORWARD_H
 
 #include "../tensor.h"
+#include <string>
 
 namespace DaisoML {
 
+class ModelFile;
+class RMSNorm;
+class ScratchArena;
+
 // Also known as the SwiGLU layer in Llama models.
 class FeedForward {
 public:
     FeedForward(int dim, int hidden_dim);
     ~FeedForward();
 
-    void forward(Tensor& out, const Tensor& input);
-    void read_weights(std::ifstream& file);
+    // Adds the SwiGLU output for norm(x) to the residual stream x in place.
+    // `x` is [n_tokens, dim], one row per token. Temporaries come from
+    // `scratch`, which needs scratch_bytes(n_tokens) free.
+    void forward(float* x, size_t n_tokens, const RMSNorm& norm, ScratchArena& scratch);
+    size_t scratch_bytes(size_t n_tokens) const;
+    // Takes w1, w2, w3 from the file; names are `prefix` + "w1" etc.
+    void load_weights(ModelFile& file, const std::string& prefix);
 
 private:
+    int dim;
+    int hidden_dim;
+
     Tensor* w1; // Corresponds to the gate projection
     Tensor* w2; // Corresponds to the down projection
     Tensor* w3; // Corresponds to the up projection
@@ -1,13 +1,14 @@
 #include "rmsnorm.h"
 #include "../utils.h"
+#include "../model_file.h"
 #include <cmath>
 
 
 namespace DaisoML {
 
-RMSNorm::RMSNorm(int dim) {
-    weights = new Tensor({(size_t)dim});
-    log("Initialized RMSNorm Layer.");
+RMSNorm::RMSNorm(int dim, float epsilon) : dim(dim), epsilon(epsilon) {
+    weights = nullptr; // Created by load_weights()
+    log(LogLevel::Debug, "Initialized RMSNorm Layer.");
 }
 
 RMSNorm::~RMSNorm() {
@@ -16,33 +17,46 @@ RMSNorm::~RMSNorm() {
 
 #include <cmath>
 
-void RMSNorm::forward(Tensor& out, const Tensor& input) {
-    if (input.shape() != out.shape() || input.size() != weights->size()) {
+void RMSNorm::forward(Tensor& out, const Tensor& input) const {
+    if (input.shape() != out.shape() || input.shape().back() != weights->size()) {
         throw DaisoException("RMSNorm shape mismatch.");
     }
+    forward(out.data(), input.data(), input.size() / weights->size());
+}
 
-    const float* x = input.data();
-    float* y = out.data();
+void RMSNorm::forward(float* out, const float* input, size_t n_rows) const {
     const float* w = weights->data();
-    size_t size = input.size();
-    const float epsilon = 1e-5f;
+    const size_t size = weights->size();
 
-    // 1. Calculate sum of squares
-    float ss = 0.0f;
-    for (size_t i = 0; i < size; ++i) {
-        ss += x[i] * x[i];
-    }
-    ss /= size;
-    ss += epsilon;
-    ss = 1.0f / std::sqrt(ss);
+    // Each row is normalized independently
+    for (size_t r = 0; r < n_rows; ++r) {
+        const float* x = input + r * size;
+        float* y = out + r * size;
+
+        // 1. Calculate sum of squares
+        float ss = 0.0f;
+        for (size_t i = 0; i < size; ++i) {
+            ss += x[i] * x[i];
+        }
+        ss /= size;
+        ss += epsilon;
+        ss = 1.0f / std::sqrt(ss);
 
-    // 2. Normalize and scale
-    for (size_t i = 0; i < size; ++i) {
-        y[i] = w[i] * (ss * x[i]);
+        // 2. Normalize and scale
+        for (size_t i = 0; i < size; ++i) {
+            y[i] = w[i] * (ss * x[i]);
+        }
     }
 }
 
 
+void RMSNorm::load_weights(ModelFile& file, const std::string& name) {
+    weights = new Tensor(file.get(name, {(size_t)dim}));
+    if (weights->dtype() != DType::F32) {
+        throw DaisoException("RMSNorm weights must be f32: " + name);
+    }
+}
+
 Tensor* RMSNorm::get_weights() {
     return weights;
 }
@@ -2,21 +2,31 @@
 #define DAISOML_RMSNORM_H
 
 #include "../tensor.h"
+#include <string>
 
 namespace DaisoML {
 
+class ModelFile;
+
 class RMSNorm {
 public:
-    explicit RMSNorm(int dim);
+    explicit RMSNorm(int dim, float epsilon = 1e-5f);
     ~RMSNorm();
 
-    // Perform the normalization
-    void forward(Tensor& out, const Tensor& input);
+    // Perform the normalization; 2D inputs [n, dim] are normalized per row
+    void forward(Tensor& out, const Tensor& input) const;
+    // The same on raw rows: out and input are [n_rows, dim], may alias
+    void forward(float* out, const float* input, size_t n_rows) const;
+
+    // Take the weights from the model file
+    void load_weights(ModelFile& file, const std::string& name);
 
     // Get a pointer to the weights tensor
     Tensor* get_weights();
 
 private:
+    int dim;
+    float epsilon;
     Tensor* weights; // aka "gamma"
 
 };
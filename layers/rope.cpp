@@ -0,0 +1,74 @@
+#include "rope.h"
+#include "../utils.h"
+#include "../kernels/kernels.h"
+#include <cmath>
+
+namespace DaisoML {
+
+RoPE::RoPE(int head_dim, int seq_len, float theta, DaisoRopeScaling scaling, float scale)
+    : head_len(head_dim), n_positions(seq_len) {
+    if (head_dim <= 0 || head_dim % 2 != 0) {
+        throw DaisoException("RoPE needs an even head dimension.");
+    }
+    if (scale <= 0.0f) {
+        scale = 1.0f; // Files written before scaling existed store 0
+    }
+
+    // Linear scaling interpolates positions; NTK-aware scaling instead
+    // stretches the base so low frequencies are interpolated and high
+    // frequencies kept.
+    double base = theta;
+    double pos_scale = 1.0;
+    switch (scaling) {
+        case DAISO_ROPE_SCALING_NONE:
+            break;
+        case DAISO_ROPE_SCALING_LINEAR:
+            pos_scale = 1.0 / scale;
+            break;
+        case DAISO_ROPE_SCALING_NTK:
+            base = theta * std::pow((double)scale, (double)head_dim / (head_dim - 2));
+            break;
+        default:
+            throw DaisoException("Unknown RoPE scaling type: " + std::to_string((int)scaling));
+    }
+
+    cos_table.resize((size_t)seq_len * head_dim);
+    sin_table.resize((size_t)seq_len * head_dim);
+    for (int i = 0; i < head_dim; i += 2) {
+        const double freq = 1.0 / std::pow(base, (double)i / head_dim);
+        for (int pos = 0; pos < seq_len; ++pos) {
+            const double val = pos * pos_scale * freq;
+            const float c = (float)std::cos(val);
+            const float s = (float)std::sin(val);
+            float* cos_row = &cos_table[(size_t)pos * head_dim];
+            float* sin_row = &sin_table[(size_t)pos * head_dim];
+            cos_row[i] = c;
+            cos_row[i + 1] = c;
+            sin_row[i] = -s;
+            sin_row[i + 1] = s;
+        }
+    }
+    log(LogLevel::Debug, "Initialized RoPE tables.");
+}
+
+void RoPE::rotate(float* x, int n_heads, int pos) const {
+    if (pos < 0 || pos >= n_positions) {
+        throw DaisoException("RoPE position out of range.");
+    }
+    const auto rope = kernels::active().rope;
+    const float* c = &cos_table[(size_t)pos * head_len];
+    const float* s = &sin_table[(size_t)pos * head_len];
+    for (int h = 0; h < n_heads; ++h) {
+        rope(x + (size_t)h * head_len, c, s, head_len);
+    }
+}
+
+int RoPE::head_dim() const {
+    return head_len;
+}
+
+int RoPE::max_positions() const {
+    return n_positions;
+}
+
+} // namespace DaisoML
@@ -0,0 +1,38 @@
+#ifndef DAISOML_ROPE_H
+#define DAISOML_ROPE_H
+
+#include "../file_format.h"
+#include <cstddef>
+#include <vector>
+
+namespace DaisoML {
+
+// Rotary Position Embedding with precomputed tables. The cos/sin of every
+// (position, frequency) pair is computed once at load time, so rotating a
+// head costs one SIMD multiply-add pass and no transcendental calls. One
+// instance is shared by all attention layers of a model.
+//
+// Tables are stored per position as head_dim floats, duplicated per pair
+// ({c0, c0, c1, c1, ...} and {-s0, s0, -s1, s1, ...}) to match the
+// interleaved layout of the rotated vectors.
+class RoPE {
+public:
+    RoPE(int head_dim, int seq_len, float theta,
+         DaisoRopeScaling scaling = DAISO_ROPE_SCALING_NONE, float scale = 1.0f);
+
+    // Rotates `n_heads` consecutive heads of x at position `pos`.
+    void rotate(float* x, int n_heads, int pos) const;
+
+    int head_dim() const;
+    int max_positions() const;
+
+private:
+    int head_len;
+    int n_positions;
+    std::vector<float> cos_table; // [seq_len, head_dim]
+    std::vector<float> sin_table; // [seq_len, head_dim]
+};
+
+} // namespace DaisoML
+
+#endif //DAISOML_ROPE_H
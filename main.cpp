@@ -1,31 +1,214 @@
+#include <chrono>
+#include <csignal>
+#include <fstream>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <vector>
+#include "engine.h"
 #include "model.h"
+#include "profile.h"
+#include "sampler.h"
+#include "server.h"
+#include "speculative.h"
+#include "tensor.h"
+#include "thread_pool.h"
+#include "utils.h"
 #include "tokenizer.h" // Include tokenizer for direct use if needed
 
+namespace {
+DaisoML::Server* active_server = nullptr;
+
+void stop_server(int) {
+    if (active_server) active_server->stop();
+}
+
+// Prints the per-op report and writes the trace requested on the command line
+void finish_profile(bool report, const std::string& trace_path) {
+    if (report) {
+        DaisoML::flush_log();
+        std::cerr << "\nProfile:\n" << DaisoML::Profiler::report();
+    }
+    if (!trace_path.empty()) {
+        DaisoML::Profiler::write_trace(trace_path);
+        std::cerr << "Trace written to " << trace_path << std::endl;
+    }
+}
+
+// Continues the conversation saved at `path` (if the file exists) with the
+// prompt, then saves it back, so the history is never prefilled again.
+// Returns the prompt and the generated tokens.
+std::vector<int> generate_in_session(DaisoML::Model& model, const std::string& path, const std::string& save_type,
+                                     const std::vector<int>& prompt, int steps,
+                                     const DaisoML::SamplerOptions& sampling) {
+    const int seq = model.create_sequence();
+    std::vector<int> tokens;
+    if (std::ifstream(path).good()) {
+        const auto start = std::chrono::steady_clock::now();
+        tokens = model.load_session(seq, path);
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Session restored: " << tokens.size() << " tokens in " << ms << " ms" << std::endl;
+    }
+    const size_t history = tokens.size();
+    tokens.insert(tokens.end(), prompt.begin(), prompt.end());
+
+    DaisoML::Sampler sampler(model.getConfig().vocab_size, sampling);
+    for (int token : tokens) {
+        sampler.accept(token);
+    }
+    DaisoML::Tensor* logits = model.prefill(prompt, (int)history, seq);
+    int pos = (int)tokens.size();
+    for (int i = 0; i < steps; ++i) {
+        tokens.push_back(sampler.sample(*logits));
+        if (i + 1 == steps || pos >= model.getConfig().seq_len) break;
+        logits = model.forward(tokens.back(), pos++, seq);
+    }
+    // The last token has not been through the model yet; cache it too
+    if (pos < model.getConfig().seq_len) {
+        model.forward(tokens.back(), pos++, seq, DaisoML::Logits::None);
+    }
+    const std::vector<int> cached(tokens.begin(), tokens.begin() + pos);
+    if (save_type.empty()) {
+        model.save_session(seq, cached, path);
+    } else {
+        model.save_session(seq, cached, path, DaisoML::kv_type_from_name(save_type));
+    }
+    model.free_sequence(seq);
+    std::cout << "Session saved: " << cached.size() << " tokens to " << path << std::endl;
+    return std::vector<int>(tokens.begin() + history, tokens.end());
+}
+} // namespace
+
 int main(int argc, char **argv) {
     std::cout << "Welcome to DaisoML!" << std::endl;
 
     if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <model_path>" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " <model_path> [--threads N] [--no-pin] [--no-mmap]"
+                  << " [--kv-type f32|f16|q8] [--kv-layout head|position] [--kv-cache-tokens N] [--max-batch N] [--prefix-cache TOKENS] [--draft PATH | --lookup N] [--draft-tokens N] [--session PATH] [--session-type f32|f16|q8] [--parallel N] [--port N | --socket PATH]"
+                  << " [--temp F] [--top-k N] [--top-p F] [--min-p F] [--repeat-penalty F] [--seed N]"
+                  << " [--profile] [--trace PATH] [--log-level debug|info|warn|error|off]" << std::endl;
         return 1;
     }
 
     const std::string model_path = argv[1];
+    int n_threads = 0; // 0 = all hardware threads
+    bool pin_threads = true;
+    int parallel = 0; // >0: run that many copies of the prompt through the batching engine
+    bool serve = false; // serve requests over a socket instead of running the built-in prompt
+    DaisoML::ServerOptions server_options;
+    DaisoML::SamplerOptions sampling;
+    DaisoML::ModelOptions options;
+    bool profile = false;
+    std::string trace_path;
+    std::string draft_path; // small model proposing tokens for speculative decoding
+    int lookup_ngram = 0; // >0: speculative decoding by prompt lookup with n-grams up to this size
+    int draft_tokens = 0; // 0: the decoder's default
+    std::string session_path; // conversation state kept on disk between runs
+    std::string session_type; // storage type of the saved KV cache (default: the cache's)
+    for (int i = 2; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) {
+            n_threads = std::stoi(argv[++i]);
+        } else if (arg == "--no-pin") {
+            pin_threads = false;
+        } else if (arg == "--no-mmap") {
+            options.use_mmap = false;
+        } else if (arg == "--port" && i + 1 < argc) {
+            server_options.port = std::stoi(argv[++i]);
+            serve = true;
+        } else if (arg == "--socket" && i + 1 < argc) {
+            server_options.socket_path = argv[++i];
+            serve = true;
+        } else if (arg == "--temp" && i + 1 < argc) {
+            sampling.temperature = std::stof(argv[++i]);
+        } else if (arg == "--top-k" && i + 1 < argc) {
+            sampling.top_k = std::stoi(argv[++i]);
+        } else if (arg == "--top-p" && i + 1 < argc) {
+            sampling.top_p = std::stof(argv[++i]);
+        } else if (arg == "--min-p" && i + 1 < argc) {
+            sampling.min_p = std::stof(argv[++i]);
+        } else if (arg == "--repeat-penalty" && i + 1 < argc) {
+            sampling.repetition_penalty = std::stof(argv[++i]);
+        } else if (arg == "--seed" && i + 1 < argc) {
+            sampling.seed = std::stoull(argv[++i]);
+        } else if (arg == "--kv-cache-tokens" && i + 1 < argc) {
+            options.kv_cache_tokens = std::stoi(argv[++i]);
+        } else if (arg == "--max-batch" && i + 1 < argc) {
+            options.max_batch = std::stoi(argv[++i]);
+        } else if (arg == "--prefix-cache" && i + 1 < argc) {
+            options.prefix_cache_tokens = std::stoi(argv[++i]);
+        } else if (arg == "--draft" && i + 1 < argc) {
+            draft_path = argv[++i];
+        } else if (arg == "--lookup" && i + 1 < argc) {
+            lookup_ngram = std::stoi(argv[++i]);
+        } else if (arg == "--draft-tokens" && i + 1 < argc) {
+            draft_tokens = std::stoi(argv[++i]);
+        } else if (arg == "--session" && i + 1 < argc) {
+            session_path = argv[++i];
+        } else if (arg == "--session-type" && i + 1 < argc) {
+            session_type = argv[++i];
+        } else if (arg == "--parallel" && i + 1 < argc) {
+            parallel = std::stoi(argv[++i]);
+        } else if (arg == "--profile") {
+            profile = true;
+        } else if (arg == "--trace" && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (arg == "--log-level" && i + 1 < argc) {
+            try {
+                DaisoML::set_log_level(DaisoML::log_level_from_name(argv[++i]));
+            } catch (const std::exception& e) {
+                std::cerr << e.what() << std::endl;
+                return 1;
+            }
+        } else if (arg == "--kv-layout" && i + 1 < argc) {
+            try {
+                options.kv_layout = DaisoML::kv_layout_from_name(argv[++i]);
+            } catch (const std::exception& e) {
+                std::cerr << e.what() << std::endl;
+                return 1;
+            }
+        } else if (arg == "--kv-type" && i + 1 < argc) {
+            try {
+                options.kv_type = DaisoML::kv_type_from_name(argv[++i]);
+            } catch (const std::exception& e) {
+                std::cerr << e.what() << std::endl;
+                return 1;
+            }
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return 1;
+        }
+    }
+    DaisoML::Profiler::enable(profile);
+    DaisoML::Profiler::enable_tracing(!trace_path.empty());
+    DaisoML::ThreadPool::set_global_threads(n_threads, pin_threads);
+    std::cout << "Threads: " << DaisoML::ThreadPool::global().num_threads()
+              << ", kernels: " << DaisoML::kernel_isa() << std::endl;
     std::cout << "Loading model from: " << model_path << std::endl;
 
     try {
-        DaisoML::Model model(model_path);
+        DaisoML::Model model(model_path, options);
         std::cout << "Model loaded successfully." << std::endl;
 
+        if (serve) {
+            // Keep the model loaded and answer requests until interrupted
+            DaisoML::Server server(model, server_options);
+            active_server = &server;
+            std::signal(SIGINT, stop_server);
+            std::signal(SIGTERM, stop_server);
+            server.run();
+            active_server = nullptr;
+            finish_profile(profile, trace_path);
+            return 0;
+        }
+
         // Define a simple prompt
         std::string prompt_text = "Hello, my name is";
         std::cout << "Prompt: \"" << prompt_text << "\"" << std::endl;
 
-        // Encode the prompt (dummy implementation for now)
+        // Encode the prompt
         std::vector<int> prompt_tokens = model.getTokenizer().encode(prompt_text);
-        std::cout << "Prompt tokens (dummy): ";
+        std::cout << "Prompt tokens: ";
         for (int token : prompt_tokens) {
             std::cout << token << " ";
         }
@@ -33,11 +216,64 @@ int main(int argc, char **argv) {
 
         // Generate text
         int steps_to_generate = 50;
-        std::vector<int> generated_tokens = model.generate(prompt_tokens, steps_to_generate);
+        if (parallel > 0) {
+            // Decode several requests together; each gets its own output
+            DaisoML::Engine engine(model);
+            std::vector<std::vector<int>> outputs(parallel, prompt_tokens);
+            for (int r = 0; r < parallel; ++r) {
+                // Consecutive seeds, so the copies differ but runs repeat
+                DaisoML::SamplerOptions request_sampling = sampling;
+                request_sampling.seed += r;
+                engine.submit(prompt_tokens, steps_to_generate,
+                              DaisoML::Sampler(model.getConfig().vocab_size, request_sampling));
+            }
+            std::vector<DaisoML::TokenEvent> events;
+            while (engine.has_work()) {
+                events.clear();
+                engine.step(events);
+                for (const auto& e : events) {
+                    outputs[e.request].push_back(e.token);
+                }
+            }
+            for (int r = 0; r < parallel; ++r) {
+                std::cout << "Generated text [" << r << "]: \""
+                          << model.getTokenizer().decode(outputs[r]) << "\"" << std::endl;
+            }
+            finish_profile(profile, trace_path);
+            return 0;
+        }
+        std::vector<int> generated_tokens;
+        if (!draft_path.empty() || lookup_ngram > 0) {
+            // Tokens proposed by a draft model or by prompt lookup are verified
+            // by the main model in batches
+            std::unique_ptr<DaisoML::Model> draft;
+            std::unique_ptr<DaisoML::SpeculativeDecoder> decoder;
+            if (!draft_path.empty()) {
+                DaisoML::ModelOptions draft_options = options;
+                draft_options.prefix_cache_tokens = 0;
+                draft = std::make_unique<DaisoML::Model>(draft_path, draft_options);
+                decoder = std::make_unique<DaisoML::SpeculativeDecoder>(model, *draft,
+                                                                         draft_tokens > 0 ? draft_tokens : 4);
+            } else {
+                decoder = std::make_unique<DaisoML::SpeculativeDecoder>(model, draft_tokens > 0 ? draft_tokens : 8,
+                                                                         lookup_ngram);
+            }
+            generated_tokens = decoder->generate(prompt_tokens, steps_to_generate, sampling);
+            const DaisoML::SpeculativeStats& stats = decoder->stats();
+            std::cout << "Speculative decoding: " << stats.accepted << " of " << stats.drafted
+                      << " drafted tokens accepted (" << 100.0 * stats.acceptance_rate() << "%), "
+                      << stats.tokens_per_round() << " tokens per verification pass" << std::endl;
+        } else if (!session_path.empty()) {
+            generated_tokens = generate_in_session(model, session_path, session_type, prompt_tokens,
+                                                   steps_to_generate, sampling);
+        } else {
+            generated_tokens = model.generate(prompt_tokens, steps_to_generate, sampling);
+        }
 
         // Decode and print the generated text
         std::string generated_text = model.getTokenizer().decode(generated_tokens);
         std::cout << "Generated text: \"" << generated_text << "\"" << std::endl;
+        finish_profile(profile, trace_path);
 
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
@@ -0,0 +1,89 @@
+#include "mapped_file.h"
+#include "utils.h"
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace DaisoML {
+
+#if defined(_WIN32)
+
+MappedFile::MappedFile(const std::string& path) : _data(nullptr), _size(0), _file(nullptr), _mapping(nullptr) {
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        throw DaisoException("Could not open file for mapping: " + path);
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        throw DaisoException("Could not map empty or unreadable file: " + path);
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        CloseHandle(file);
+        throw DaisoException("CreateFileMapping failed for: " + path);
+    }
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        throw DaisoException("MapViewOfFile failed for: " + path);
+    }
+    _file = file;
+    _mapping = mapping;
+    _data = static_cast<uint8_t*>(view);
+    _size = static_cast<size_t>(size.QuadPart);
+}
+
+MappedFile::~MappedFile() {
+    UnmapViewOfFile(_data);
+    CloseHandle(static_cast<HANDLE>(_mapping));
+    CloseHandle(static_cast<HANDLE>(_file));
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& path) : _data(nullptr), _size(0) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw DaisoException("Could not open file for mapping: " + path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        throw DaisoException("Could not map empty or unreadable file: " + path);
+    }
+    void* addr = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); // The mapping keeps its own reference to the file
+    if (addr == MAP_FAILED) {
+        throw DaisoException("mmap failed for: " + path);
+    }
+    _data = static_cast<uint8_t*>(addr);
+    _size = static_cast<size_t>(st.st_size);
+}
+
+MappedFile::~MappedFile() {
+    munmap(_data, _size);
+}
+
+#endif
+
+const uint8_t* MappedFile::data() const {
+    return _data;
+}
+
+size_t MappedFile::size() const {
+    return _size;
+}
+
+} // namespace DaisoML
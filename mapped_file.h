@@ -0,0 +1,35 @@
+#ifndef DAISOML_MAPPED_FILE_H
+#define DAISOML_MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace DaisoML {
+
+// A read-only memory mapping of a whole file. Pages are loaded lazily by the
+// OS on first touch and are shared through the page cache between every
+// process that maps the same file.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* data() const;
+    size_t size() const;
+
+private:
+    uint8_t* _data;
+    size_t _size;
+#if defined(_WIN32)
+    void* _file;
+    void* _mapping;
+#endif
+};
+
+} // namespace DaisoML
+
+#endif //DAISOML_MAPPED_FILE_H
@@ -1,27 +1,30 @@
 #include "model.h"
 #include "utils.h"
 #include "file_format.h"
+#include "model_file.h"
 #include "sampler.h"
+#include "kv_cache.h"
+#include "prefix_cache.h"
+#include "profile.h"
+#include "scratch.h"
+#include "session.h"
 #include "layers/embedding.h"
 #include "layers/rmsnorm.h"
 #include "layers/attention.h"
+#include "layers/rope.h"
 #include "layers/feed_forward.h"
 
-#include <fstream>
+#include <algorithm>
+#include <climits>
+#include <cstring>
 #include <memory>
 #include <vector>
 
 namespace DaisoML {
 
-// Helper function to read a tensor's data from the file
-void read_tensor(std::ifstream& file, Tensor* tensor) {
-    file.read(reinterpret_cast<char*>(tensor->data()), tensor->size() * sizeof(float));
-}
-
-Model::Model(const std::string& path) {
+Model::Model(const std::string& path, const ModelOptions& options) : options(options) {
     log("Initializing model from: " + path);
     load_weights(path);
-    tokenizer = Tokenizer(config.vocab_size);
     log("Model initialization complete.");
 }
 
@@ -30,148 +33,339 @@ Model::~Model() {
     delete token_embedding_table;
     delete rms_final;
     delete final_weights;
-    delete k_cache;
-    delete v_cache;
+    delete prefix_cache;
+    delete kv_cache;
+    delete scratch;
     delete x;
-    delete xb;
     delete logits;
+    delete batch_logits;
+    delete prompt_logits;
     for (auto& block : layers) {
         delete block.rms_att;
         delete block.attention;
         delete block.rms_ffn;
         delete block.ffn;
     }
+    delete rope;
     log("Model destroyed.");
 }
 
 void Model::load_weights(const std::string& path) {
     log("Loading model weights from " + path);
-    std::ifstream file(path, std::ios::binary);
-    if (!file) {
-        throw DaisoException("Could not open model file: " + path);
+    ModelFile file(path, options.use_mmap);
+    config = file.header();
+    meta = file.meta();
+    // The vocabulary travels with the weights; older files fall back to raw bytes
+    if (file.has_tokenizer()) {
+        tokenizer = Tokenizer::deserialize(file.tokenizer_data());
+        if (tokenizer.vocab_size() > config.vocab_size) {
+            throw DaisoException("Tokenizer vocabulary is larger than the model's vocab_size.");
+        }
+        log("Tokenizer loaded: " + std::to_string(tokenizer.vocab_size()) + " tokens, " +
+            std::to_string(tokenizer.n_merges()) + " merges");
+    } else {
+        tokenizer = Tokenizer(config.vocab_size);
+        log("Model file has no tokenizer; using raw bytes.");
     }
+    log("Model config loaded: version=" + std::to_string(config.version) + ", dim=" + std::to_string(config.dim) + ", n_layers=" + std::to_string(config.n_layers) + ", n_heads=" + std::to_string(config.n_heads) + ", n_kv_heads=" + std::to_string(config.n_kv_heads));
 
-    // Read and validate header
-    file.read(reinterpret_cast<char*>(&config), sizeof(DaisoModelHeader));
-    if (config.magic != DAISO_MAGIC) throw DaisoException("Invalid model file: magic number mismatch.");
-    if (config.version != 1) throw DaisoException("Unsupported model file version.");
-    log("Model config loaded: dim=" + std::to_string(config.dim) + ", n_layers=" + std::to_string(config.n_layers));
-
-    // Allocate layers and weights
+    // Create layers. All attention layers share one set of RoPE tables.
+    rope = new RoPE(config.dim / config.n_heads, config.seq_len, meta.rope_theta,
+                    static_cast<DaisoRopeScaling>(meta.rope_scaling), meta.rope_scale);
     token_embedding_table = new Embedding(config.vocab_size, config.dim);
     layers.reserve(config.n_layers);
     for (int i = 0; i < config.n_layers; ++i) {
         layers.push_back({
-            new RMSNorm(config.dim),
-            new Attention(config.dim, config.n_heads, config.n_kv_heads, config.seq_len),
-            new RMSNorm(config.dim),
+            new RMSNorm(config.dim, meta.norm_eps),
+            new Attention(config.dim, config.n_heads, config.n_kv_heads, config.seq_len, *rope),
+            new RMSNorm(config.dim, meta.norm_eps),
             new FeedForward(config.dim, config.hidden_dim)
         });
     }
-    rms_final = new RMSNorm(config.dim);
-    final_weights = new Tensor({(size_t)config.vocab_size, (size_t)config.dim});
+    rms_final = new RMSNorm(config.dim, meta.norm_eps);
     
     // Allocate caches and buffers
-    k_cache = new Tensor({(size_t)config.n_layers, (size_t)config.seq_len, (size_t)config.dim});
-    v_cache = new Tensor({(size_t)config.n_layers, (size_t)config.seq_len, (size_t)config.dim});
+    // Only the KV heads are cached; with grouped-query attention that is a
+    // fraction of dim. The pool is only reserved here; its memory is
+    // committed as sequences grow into it.
+    const int block_size = options.kv_block_size > 0 ? options.kv_block_size : 16;
+    const long long cache_tokens = options.kv_cache_tokens > 0 ? options.kv_cache_tokens
+                                                               : (long long)config.seq_len * max_batch_size();
+    // The prefix cache gets its own share of the pool, so the blocks it
+    // holds never take room from running sequences.
+    prefix_blocks_max = (std::max(options.prefix_cache_tokens, 0) + block_size - 1) / block_size;
+    const long long cache_blocks = (cache_tokens + block_size - 1) / block_size + prefix_blocks_max;
+    if (cache_blocks > INT_MAX) {
+        throw DaisoException("Too many KV cache tokens.");
+    }
+    kv_cache = new KVCache(config.n_layers, config.n_kv_heads, config.dim / config.n_heads, block_size,
+                           (int)cache_blocks, options.kv_type, options.kv_layout);
+    if (prefix_blocks_max > 0) {
+        prefix_cache = new PrefixCache(*kv_cache, prefix_blocks_max);
+    }
+    // Scratch for the largest batch a forward call runs (a prefill chunk or
+    // a decode batch): its activations and row indices, plus whichever layer
+    // needs more temporaries.
+    const size_t max_tokens = max_batch_tokens();
+    const size_t layer_bytes = std::max(layers[0].attention->scratch_bytes(max_tokens),
+                                        layers[0].ffn->scratch_bytes(max_tokens));
+    scratch = new ScratchArena(ScratchArena::bytes_for({max_tokens * config.dim, max_tokens, max_tokens}) +
+                               layer_bytes);
     x = new Tensor({(size_t)config.dim});
-    xb = new Tensor({(size_t)config.dim});
     logits = new Tensor({(size_t)config.vocab_size});
+    batch_logits = new Tensor({max_batch_size(), (size_t)config.vocab_size});
+    prompt_logits = new Tensor({max_tokens, (size_t)config.vocab_size});
 
-    // Read weights from the file
-    log("Reading weights from file...");
-    read_tensor(file, token_embedding_table->get_weights());
+    // Take the weights from the file (zero-copy views when mapped). For v1
+    // files the calls below must follow the on-disk order.
+    log(file.is_mapped() ? "Mapping weights from file..." : "Reading weights from file...");
+    token_embedding_table->load_weights(file, "tok_embeddings");
     for (int i = 0; i < config.n_layers; ++i) {
-        read_tensor(file, layers[i].rms_att->get_weights());
-        layers[i].attention->read_weights(file);
-        read_tensor(file, layers[i].rms_ffn->get_weights());
-        layers[i].ffn->read_weights(file);
+        layers[i].rms_att->load_weights(file, layer_tensor(i, "attention_norm"));
+        layers[i].attention->load_weights(file, layer_tensor(i, "attention."));
+        layers[i].rms_ffn->load_weights(file, layer_tensor(i, "ffn_norm"));
+        layers[i].ffn->load_weights(file, layer_tensor(i, "feed_forward."));
+    }
+    rms_final->load_weights(file, "norm");
+    if (file.tied_embeddings()) {
+        // Shares storage with the embedding table
+        final_weights = new Tensor(*token_embedding_table->get_weights());
+    } else {
+        final_weights = new Tensor(file.get("output", {(size_t)config.vocab_size, (size_t)config.dim}));
     }
-    read_tensor(file, rms_final->get_weights());
-    read_tensor(file, final_weights);
-    log("All weights loaded into memory.");
-    file.close();
+    log(file.is_mapped() ? "All weights mapped." : "All weights loaded into memory.");
 }
 
-Tensor* Model::forward(int token_id, int pos) {
+size_t Model::max_batch_size() const {
+    return options.max_batch > 0 ? (size_t)options.max_batch : 1;
+}
+
+int Model::sequence_blocks() const {
+    return kv_cache->max_blocks() - prefix_blocks_max;
+}
+
+size_t Model::max_batch_tokens() const {
+    const size_t chunk = options.prefill_chunk > 0 ? (size_t)options.prefill_chunk : 1;
+    return std::max(chunk, max_batch_size());
+}
+
+void Model::run_layers(float* xs, size_t n, const int* positions, const int* seqs) {
+    // Each block normalizes its input and adds its output back into xs
+    for (int i = 0; i < config.n_layers; ++i) {
+        DAISO_PROFILE_SCOPE(ProfileOp::Layer, i);
+        layers[i].attention->forward(xs, n, *layers[i].rms_att, positions, seqs, i, *kv_cache, *scratch);
+        layers[i].ffn->forward(xs, n, *layers[i].rms_ffn, *scratch);
+    }
+}
+
+Tensor* Model::forward(int token_id, int pos, int seq, Logits output) {
+    if (pos >= config.seq_len) {
+        throw DaisoException("Position exceeds the maximum sequence length.");
+    }
+    kv_cache->resize(seq, pos + 1);
+
     // 1. Get token embedding
-    Tensor token_tensor({1});
-    token_tensor.data()[0] = (float)token_id;
-    token_embedding_table->forward(*x, token_tensor);
+    {
+        DAISO_PROFILE_SCOPE(ProfileOp::Embedding, -1, 2 * x->size() * sizeof(float));
+        token_embedding_table->forward(x->data(), &token_id, 1);
+    }
 
     // 2. Forward through transformer blocks
-    for (int i = 0; i < config.n_layers; ++i) {
-        // RMSNorm before attention
-        layers[i].rms_att->forward(*xb, *x);
+    run_layers(x->data(), 1, &pos, &seq);
+
+    // 3. Final RMSNorm and classifier, unless only the cache was wanted
+    if (output == Logits::None) return nullptr;
+    classify(logits->data(), x->data(), 1);
+    return logits;
+}
 
-        // Attention
-        layers[i].attention->forward(*xb, *xb, pos, i, *k_cache, *v_cache);
-        
-        // Residual connection
-        add(*x, *x, *xb);
 
-        // RMSNorm before FFN
-        layers[i].rms_ffn->forward(*xb, *x);
+Tensor* Model::prefill(const std::vector<int>& tokens, int pos, int seq, Logits output) {
+    if (tokens.empty()) {
+        throw DaisoException("prefill expects at least one token.");
+    }
+    if (pos + tokens.size() > (size_t)config.seq_len) {
+        throw DaisoException("Prompt exceeds the maximum sequence length.");
+    }
+    const size_t dim = config.dim;
+    const size_t vocab = config.vocab_size;
+    const size_t chunk = options.prefill_chunk > 0 ? (size_t)options.prefill_chunk : 1;
+    kv_cache->resize(seq, pos + (int)tokens.size());
+    if (output == Logits::All && prompt_logits->shape()[0] < tokens.size()) {
+        // Only inputs longer than any forward pass, e.g. a whole text being
+        // scored, need more rows than the buffer was given at load time
+        *prompt_logits = Tensor({tokens.size(), vocab});
+    }
 
-        // FFN
-        layers[i].ffn->forward(*xb, *xb);
+    for (size_t begin = 0; begin < tokens.size(); begin += chunk) {
+        const size_t end = std::min(begin + chunk, tokens.size());
+        const size_t n = end - begin;
 
-        // Residual connection
-        add(*x, *x, *xb);
+        // Activations for the whole chunk, one row per token
+        ScratchArena::Scope scope(*scratch);
+        float* xs = scratch->alloc_floats(n * dim);
+        int* positions = scratch->alloc_ints(n);
+        int* seqs = scratch->alloc_ints(n);
+        for (size_t t = 0; t < n; ++t) {
+            positions[t] = pos + (int)(begin + t);
+            seqs[t] = seq;
+        }
+        {
+            DAISO_PROFILE_SCOPE(ProfileOp::Embedding, -1, 2 * n * dim * sizeof(float));
+            token_embedding_table->forward(xs, tokens.data() + begin, n);
+        }
+        run_layers(xs, n, positions, seqs);
+
+        // Only rows whose logits are used go through the classifier
+        if (output == Logits::All) {
+            classify(prompt_logits->data() + begin * vocab, xs, n);
+        } else if (output == Logits::Last && end == tokens.size()) {
+            classify(logits->data(), xs + (n - 1) * dim, 1);
+        }
     }
 
-    // 3. Final RMSNorm
-    rms_final->forward(*x, *x);
+    switch (output) {
+        case Logits::None: return nullptr;
+        case Logits::Last: return logits;
+        case Logits::All: return prompt_logits;
+    }
+    return nullptr;
+}
+
+
+Tensor* Model::prefill_prompt(const std::vector<int>& tokens, int seq) {
+    if (!prefix_cache || tokens.empty()) {
+        return prefill(tokens, 0, seq);
+    }
+    // The last token is always computed: its logits are needed
+    const size_t reused = prefix_cache->lookup(tokens, tokens.size() - 1, prefix_blocks);
+    kv_cache->attach(seq, prefix_blocks);
+    log(LogLevel::Debug, "Prefix cache: reusing " + std::to_string(reused) + " of " +
+                             std::to_string(tokens.size()) + " prompt tokens");
+    Tensor* out = reused > 0 ? prefill(std::vector<int>(tokens.begin() + reused, tokens.end()), (int)reused, seq)
+                             : prefill(tokens, 0, seq);
+    prefix_cache->insert(tokens, kv_cache->block_table(seq));
+    return out;
+}
+
 
-    // 4. Classifier: calculate logits
-    float* logits_data = logits->data();
-    const float* x_data = x->data();
-    const float* w_data = final_weights->data();
-    for (int i = 0; i < config.vocab_size; ++i) {
-        float val = 0.0f;
-        for (int j = 0; j < config.dim; ++j) {
-            val += w_data[i * config.dim + j] * x_data[j];
+Tensor* Model::forward_batch(const Batch& batch) {
+    const size_t n = batch.size();
+    if (n == 0 || n > max_batch_size()) {
+        throw DaisoException("Batch size must be between 1 and " + std::to_string(max_batch_size()) + ".");
+    }
+    for (size_t t = 0; t < n; ++t) {
+        if (batch.positions[t] < 0 || batch.positions[t] >= config.seq_len) {
+            throw DaisoException("Position exceeds the maximum sequence length.");
+        }
+        if (batch.positions[t] >= kv_cache->length(batch.seqs[t])) {
+            kv_cache->resize(batch.seqs[t], batch.positions[t] + 1);
         }
-        logits_data[i] = val;
     }
+    const size_t dim = config.dim;
 
-    return logits;
+    ScratchArena::Scope scope(*scratch);
+    float* xs = scratch->alloc_floats(n * dim);
+    {
+        DAISO_PROFILE_SCOPE(ProfileOp::Embedding, -1, 2 * n * dim * sizeof(float));
+        token_embedding_table->forward(xs, batch.tokens.data(), n);
+    }
+    run_layers(xs, n, batch.positions.data(), batch.seqs.data());
+
+    // Pack the rows that want logits to the front; the classifier then
+    // reads its weights once for all of them
+    size_t n_out = 0;
+    for (size_t t = 0; t < n; ++t) {
+        if (!batch.logits[t]) continue;
+        if (n_out != t) std::memcpy(xs + n_out * dim, xs + t * dim, dim * sizeof(float));
+        n_out++;
+    }
+    if (n_out > 0) classify(batch_logits->data(), xs, n_out);
+    return batch_logits;
+}
+
+void Model::classify(float* out, float* xs, size_t n) {
+    const size_t dim = config.dim;
+    {
+        DAISO_PROFILE_SCOPE(ProfileOp::FinalNorm, -1, 2 * n * dim * sizeof(float), 4 * (uint64_t)n * dim);
+        rms_final->forward(xs, xs, n);
+    }
+    DAISO_PROFILE_SCOPE(ProfileOp::Classifier, -1,
+                        final_weights->nbytes() + n * (config.dim + config.vocab_size) * sizeof(float),
+                        2 * (uint64_t)n * config.dim * config.vocab_size);
+    gemm(out, *final_weights, xs, n);
+}
+
+
+int Model::create_sequence() {
+    return kv_cache->create_sequence();
+}
+
+void Model::free_sequence(int seq) {
+    kv_cache->free_sequence(seq);
+}
+
+void Model::truncate_sequence(int seq, int length) {
+    if (length < kv_cache->length(seq)) {
+        kv_cache->resize(seq, length);
+    }
+}
+
+void Model::save_session(int seq, const std::vector<int>& tokens, const std::string& path) const {
+    save_session(seq, tokens, path, kv_cache->type());
 }
 
+void Model::save_session(int seq, const std::vector<int>& tokens, const std::string& path, KVType type) const {
+    write_session(path, config, *kv_cache, seq, tokens, type);
+}
+
+std::vector<int> Model::load_session(int seq, const std::string& path) {
+    return read_session(path, config, *kv_cache, seq);
+}
 
-std::vector<int> Model::generate(const std::vector<int>& prompt_tokens, int steps) {
+std::vector<int> Model::generate(const std::vector<int>& prompt_tokens, int steps, const SamplerOptions& sampling) {
     log("Starting text generation...");
     std::vector<int> generated_tokens = prompt_tokens;
     
-    Sampler sampler(config.vocab_size, 0.8f, 0.9f);
+    Sampler sampler(config.vocab_size, sampling);
+    for (int token : prompt_tokens) {
+        sampler.accept(token);
+    }
+    const int seq = kv_cache->create_sequence();
+    // Frees the sequence however generation ends, errors included
+    struct Release {
+        KVCache* cache;
+        int seq;
+        ~Release() { cache->free_sequence(seq); }
+    } release{kv_cache, seq};
 
-    int current_pos = 0;
+    // The prompt is processed in chunks; its last logits give the first new token
+    Tensor* current_logits;
+    int current_pos;
     if (!prompt_tokens.empty()) {
         log("Processing prompt...");
-        for (int token : prompt_tokens) {
-            forward(token, current_pos);
-            current_pos++;
-        }
+        current_logits = prefill_prompt(prompt_tokens, seq);
+        current_pos = (int)prompt_tokens.size();
         log("Prompt processing finished.");
+    } else {
+        current_logits = forward(0, 0, seq); // Start from token 0
+        current_pos = 1;
     }
-    
-    int next_token = prompt_tokens.empty() ? 0 : prompt_tokens.back(); // Start with last prompt token or 0
 
     log("Generating new tokens...");
     for (int i = 0; i < steps; ++i) {
+        int next_token = sampler.sample(*current_logits);
+        generated_tokens.push_back(next_token);
+
+        if (i + 1 == steps) break;
         if (current_pos >= config.seq_len) {
             log("Reached max sequence length.");
             break;
         }
-
-        forward(next_token, current_pos);
-        Tensor* current_logits = logits;
-
-        next_token = sampler.sample(*current_logits);
-        generated_tokens.push_back(next_token);
+        current_logits = forward(next_token, current_pos, seq);
         current_pos++;
     }
-    
+
     log("Generation finished.");
     return generated_tokens;
 }
@@ -180,4 +374,16 @@ Tokenizer& Model::getTokenizer() {
     return tokenizer;
 }
 
+const DaisoModelHeader& Model::getConfig() const {
+    return config;
+}
+
+const PrefixCache* Model::getPrefixCache() const {
+    return prefix_cache;
+}
+
+const KVCache& Model::getKVCache() const {
+    return *kv_cache;
+}
+
 } // namespace DaisoML
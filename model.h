@@ -1,12 +1,15 @@
 #ifndef DAISOML_MODEL_H
 #define DAISOML_MODEL_H
 
+#include <cstdint>
 #include <string>
 #include <vector>
+#include "sampler.h"
 #include "tensor.h"
 #include "tokenizer.h"
 
 #include "file_format.h"
+#include "kv_cache.h"
 
 namespace DaisoML {
 
@@ -15,6 +18,73 @@ class Embedding;
 class RMSNorm;
 class Attention;
 class FeedForward;
+class ScratchArena;
+class RoPE;
+class PrefixCache;
+
+// Options controlling how a model is loaded and run.
+struct ModelOptions {
+    // Map the weights directly from the file instead of copying them into
+    // process memory. Startup is near-instant, pages load on demand, and
+    // processes using the same file share one page-cache copy.
+    bool use_mmap = true;
+    // Number of prompt tokens pushed through the layers together during
+    // prefill. Larger chunks reuse each weight matrix for more tokens.
+    int prefill_chunk = 128;
+    // KV cache paging: positions per block, and the total number of positions
+    // the shared block pool may hold across all sequences (0: seq_len for
+    // each of max_batch sequences). The pool's address space is reserved when
+    // the model loads; memory is only committed as sequences use blocks.
+    int kv_block_size = 16;
+    int kv_cache_tokens = 0;
+    // Storage type of cached keys and values. f16 halves and q8 quarters the
+    // cache footprint and the bytes attention reads per token.
+    KVType kv_type = KVType::F32;
+    // Order of the cached rows. Head-major keeps each head's history
+    // contiguous for attention; position-major is the original layout.
+    KVLayout kv_layout = KVLayout::HeadMajor;
+    // Most rows forward_batch() accepts, i.e. sequences decoded together.
+    int max_batch = 16;
+    // Positions of prompt prefixes kept in the KV cache for reuse by later
+    // prompts that start the same way (0: no prefix cache). They come on top
+    // of kv_cache_tokens.
+    int prefix_cache_tokens = 0;
+};
+
+// Which positions of a forward pass produce logits. The final RMSNorm and
+// the vocabulary projection, usually the largest matrix of the model, only
+// run for those.
+enum class Logits {
+    None, // hidden states only: the pass just fills the KV cache
+    Last, // the last position, to sample the next token
+    All,  // every position, e.g. to score a text or verify drafted tokens
+};
+
+// Token rows evaluated together in one forward pass. Row i is token
+// tokens[i] at position positions[i] of KV cache sequence seqs[i], and
+// produces logits if logits[i] is set. Rows of different sequences share
+// every weight read. The vectors keep their capacity across clear(), so
+// reusing a Batch does not allocate.
+struct Batch {
+    std::vector<int> tokens;
+    std::vector<int> positions;
+    std::vector<int> seqs;
+    std::vector<uint8_t> logits;
+
+    void add(int token, int pos, int seq, bool output = true) {
+        tokens.push_back(token);
+        positions.push_back(pos);
+        seqs.push_back(seq);
+        logits.push_back(output);
+    }
+    void clear() {
+        tokens.clear();
+        positions.clear();
+        seqs.clear();
+        logits.clear();
+    }
+    size_t size() const { return tokens.size(); }
+};
 
 struct TransformerBlock {
     RMSNorm* rms_att;
@@ -25,34 +95,90 @@ struct TransformerBlock {
 
 class Model {
 public:
-    explicit Model(const std::string& path);
+    explicit Model(const std::string& path, const ModelOptions& options = ModelOptions());
     ~Model();
 
-    std::vector<int> generate(const std::vector<int>& tokens, int steps);
+    std::vector<int> generate(const std::vector<int>& tokens, int steps,
+                              const SamplerOptions& sampling = SamplerOptions());
     Tokenizer& getTokenizer();
+    const DaisoModelHeader& getConfig() const;
+    const KVCache& getKVCache() const;
+    // nullptr unless options.prefix_cache_tokens is set
+    const PrefixCache* getPrefixCache() const;
+
+    // KV cache sequences; every independent generation owns one.
+    int create_sequence();
+    void free_sequence(int seq);
+    // Drops the cached positions of `seq` from `length` on, e.g. tokens a
+    // speculative step proposed and then rejected.
+    void truncate_sequence(int seq, int length);
+    // Session snapshots (see session.h). save_session() writes the cached
+    // keys and values of positions 0 .. tokens.size() - 1 of `seq`, in the
+    // cache type or converted to `type`; load_session() fills the empty
+    // sequence `seq` from such a file and returns its tokens, so generation
+    // continues at position tokens.size().
+    void save_session(int seq, const std::vector<int>& tokens, const std::string& path) const;
+    void save_session(int seq, const std::vector<int>& tokens, const std::string& path, KVType type) const;
+    std::vector<int> load_session(int seq, const std::string& path);
+
+    // Runs one token at position `pos` of KV cache sequence `seq` and
+    // returns its logits (nullptr for Logits::None).
+    Tensor* forward(int token_id, int pos, int seq, Logits output = Logits::Last);
+    // Runs `tokens` at positions pos, pos + 1, ... in chunks of
+    // options.prefill_chunk. Returns the logits of the last token [vocab],
+    // of every token, or nullptr, as selected by `output`. For Logits::All,
+    // row i of the result belongs to tokens[i]; it has at least
+    // max_batch_tokens() rows, so calls up to that size reuse the same
+    // buffer, and is valid until the next call.
+    Tensor* prefill(const std::vector<int>& tokens, int pos, int seq, Logits output = Logits::Last);
+    // Prefills a whole prompt into the empty sequence `seq` and returns the
+    // logits of its last token. The longest prefix found in the prefix cache
+    // is attached instead of computed, and the prompt's full blocks are then
+    // added to the cache.
+    Tensor* prefill_prompt(const std::vector<int>& tokens, int seq);
+    // Runs all rows of `batch` (at most max_batch_size()) in one pass.
+    // Returns logits [max_batch_size(), vocab_size]: row j belongs to the
+    // j-th batch row with its logits flag set.
+    Tensor* forward_batch(const Batch& batch);
+    size_t max_batch_size() const;
+    // Most tokens a single forward pass processes
+    size_t max_batch_tokens() const;
+    // KV cache blocks running sequences may use: the pool less the prefix
+    // cache's share, which it can hold on to while sequences run.
+    int sequence_blocks() const;
 
 private:
-    Tensor* forward(int token_id, int pos);
-
     void load_weights(const std::string& path);
+    // Runs the transformer blocks over the n rows of xs [n, dim] in place.
+    void run_layers(float* xs, size_t n, const int* positions, const int* seqs);
+    // Final RMSNorm (in place) and projection of n rows to vocabulary logits
+    void classify(float* out, float* xs, size_t n);
 
+    ModelOptions options;
     DaisoModelHeader config;
+    DaisoModelMetaV2 meta; // rope theta, norm epsilon, flags
     Tokenizer tokenizer;
 
     // Model weights and layers
     Embedding* token_embedding_table;
     std::vector<TransformerBlock> layers;
     RMSNorm* rms_final;
+    RoPE* rope; // shared by all attention layers
     Tensor* final_weights; // (vocab_size, dim)
 
-    // Key-value cache
-    Tensor* k_cache;
-    Tensor* v_cache;
+    // Paged key-value cache, and the prompt prefixes kept in it
+    KVCache* kv_cache;
+    PrefixCache* prefix_cache = nullptr;
+    int prefix_blocks_max = 0; // the prefix cache's share of the pool
+    std::vector<int> prefix_blocks;
 
-    // Buffers for forward pass
+    // Buffers for forward pass. Layer temporaries come from `scratch`, which
+    // is sized up front so decode steps never touch the heap.
+    ScratchArena* scratch;
     Tensor* x;
-    Tensor* xb;
     Tensor* logits;
+    Tensor* batch_logits; // (max_batch, vocab_size)
+    Tensor* prompt_logits; // (>= max_batch_tokens, vocab_size): prefill with Logits::All
 };
 
 
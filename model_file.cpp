@@ -0,0 +1,249 @@
+#include "model_file.h"
+#include "utils.h"
+#include "kernels/quant.h"
+#include <cstring>
+
+namespace DaisoML {
+
+static size_t element_count(const std::vector<size_t>& shape) {
+    size_t count = 1;
+    for (size_t dim : shape) count *= dim;
+    return count;
+}
+
+ModelFile::ModelFile(const std::string& path, bool use_mmap) : path(path), file_size(0), next_offset(0) {
+    if (use_mmap) {
+        mapping = std::make_shared<MappedFile>(path);
+        file_size = mapping->size();
+    } else {
+        stream.open(path, std::ios::binary | std::ios::ate);
+        if (!stream) {
+            throw DaisoException("Could not open model file: " + path);
+        }
+        file_size = static_cast<uint64_t>(stream.tellg());
+    }
+    read_bytes(0, &config, sizeof(DaisoModelHeader));
+    next_offset = sizeof(DaisoModelHeader);
+
+    if (config.magic != DAISO_MAGIC) throw DaisoException("Invalid model file: magic number mismatch.");
+    if (config.n_kv_heads == 0) {
+        config.n_kv_heads = config.n_heads; // Files that predate grouped-query attention
+    }
+    if (config.dim <= 0 || config.hidden_dim <= 0 || config.n_layers <= 0 || config.vocab_size <= 0 ||
+        config.seq_len <= 0) {
+        throw DaisoException("Invalid model file: bad model dimensions.");
+    }
+    if (config.n_heads <= 0 || config.dim % config.n_heads != 0 ||
+        config.n_kv_heads <= 0 || config.n_heads % config.n_kv_heads != 0) {
+        throw DaisoException("Invalid model file: bad head configuration.");
+    }
+
+    // Defaults matching what the engine hard-coded before v2
+    std::memset(&metadata, 0, sizeof(metadata));
+    metadata.rope_theta = 10000.0f;
+    metadata.norm_eps = 1e-5f;
+    metadata.rope_scale = 1.0f;
+
+    if (config.version == DAISO_VERSION_2) {
+        read_directory();
+    } else if (config.version != DAISO_VERSION_1) {
+        throw DaisoException("Unsupported model file version: " + std::to_string(config.version));
+    }
+}
+
+// True if [offset, offset + size) lies within the file. Written so that
+// offsets and sizes read from a corrupt file cannot overflow.
+static bool in_file(uint64_t offset, uint64_t size, uint64_t file_size) {
+    return size <= file_size && offset <= file_size - size;
+}
+
+void ModelFile::read_directory() {
+    read_bytes(sizeof(DaisoModelHeader), &metadata, sizeof(DaisoModelMetaV2));
+    // The directory must fit in the file before anything is sized from it
+    if (!in_file(sizeof(DaisoModelHeader) + sizeof(DaisoModelMetaV2),
+                 (uint64_t)metadata.n_tensors * sizeof(DaisoTensorEntry), file_size)) {
+        throw DaisoException("Model file is truncated in the tensor directory.");
+    }
+    entries.resize(metadata.n_tensors);
+    if (metadata.n_tensors > 0) {
+        read_bytes(sizeof(DaisoModelHeader) + sizeof(DaisoModelMetaV2), entries.data(),
+                   metadata.n_tensors * sizeof(DaisoTensorEntry));
+    }
+    for (size_t i = 0; i < entries.size(); ++i) {
+        DaisoTensorEntry& e = entries[i];
+        e.name[DAISO_MAX_NAME - 1] = '\0';
+        if (e.offset % DAISO_ALIGNMENT != 0) {
+            throw DaisoException(std::string("Misaligned tensor in model file: ") + e.name);
+        }
+        if (!in_file(e.offset, e.size, file_size)) {
+            throw DaisoException(std::string("Model file is truncated at tensor: ") + e.name);
+        }
+        if (e.n_dims == 0 || e.n_dims > DAISO_MAX_DIMS) {
+            throw DaisoException(std::string("Invalid rank for tensor: ") + e.name);
+        }
+        // Quantized kernels walk whole QK blocks; a partial block at the end
+        // of each row would be read past
+        if (e.dtype != DAISO_DTYPE_F32 && e.shape[e.n_dims - 1] % kernels::QK != 0) {
+            throw DaisoException(std::string("Quantized tensor rows must be a multiple of ") +
+                                 std::to_string(kernels::QK) + " values: " + e.name);
+        }
+        index[e.name] = i;
+    }
+    if (metadata.tokenizer_size > 0 && !in_file(metadata.tokenizer_offset, metadata.tokenizer_size, file_size)) {
+        throw DaisoException("Model file is truncated at the tokenizer section.");
+    }
+}
+
+const DaisoModelHeader& ModelFile::header() const {
+    return config;
+}
+
+const DaisoModelMetaV2& ModelFile::meta() const {
+    return metadata;
+}
+
+int ModelFile::version() const {
+    return config.version;
+}
+
+bool ModelFile::is_mapped() const {
+    return mapping != nullptr;
+}
+
+bool ModelFile::tied_embeddings() const {
+    return (metadata.flags & DAISO_FLAG_TIED_EMBEDDINGS) != 0;
+}
+
+bool ModelFile::has(const std::string& name) const {
+    return index.count(name) != 0;
+}
+
+std::vector<std::string> ModelFile::tensor_names() const {
+    std::vector<std::string> names;
+    names.reserve(entries.size());
+    for (const auto& e : entries) names.push_back(e.name);
+    return names;
+}
+
+const DaisoTensorEntry& ModelFile::entry(const std::string& name) const {
+    auto it = index.find(name);
+    if (it == index.end()) {
+        throw DaisoException("Tensor not found in model file: " + name);
+    }
+    return entries[it->second];
+}
+
+Tensor ModelFile::get(const std::string& name, const std::vector<size_t>& shape) {
+    if (config.version == DAISO_VERSION_1) {
+        const uint64_t bytes = element_count(shape) * sizeof(float);
+        Tensor tensor = load(next_offset, bytes, shape, DType::F32);
+        next_offset += bytes;
+        return tensor;
+    }
+
+    const DaisoTensorEntry& e = entry(name);
+    bool shape_ok = e.n_dims == shape.size();
+    for (uint32_t d = 0; shape_ok && d < e.n_dims; ++d) {
+        shape_ok = e.shape[d] == shape[d];
+    }
+    if (!shape_ok) {
+        throw DaisoException("Shape mismatch for tensor: " + name);
+    }
+    const DType dtype = dtype_from_file(e.dtype);
+    const uint64_t bytes = (element_count(shape) / shape.back()) * dtype_row_bytes(dtype, shape.back());
+    if (e.size != bytes) {
+        throw DaisoException("Size mismatch for tensor: " + name);
+    }
+    return load(e.offset, bytes, shape, dtype);
+}
+
+bool ModelFile::has_tokenizer() const {
+    return config.version == DAISO_VERSION_2 && metadata.tokenizer_size > 0;
+}
+
+std::vector<uint8_t> ModelFile::tokenizer_data() {
+    if (!has_tokenizer()) {
+        throw DaisoException("Model file has no tokenizer section.");
+    }
+    std::vector<uint8_t> data(metadata.tokenizer_size);
+    read_bytes(metadata.tokenizer_offset, data.data(), data.size());
+    return data;
+}
+
+Tensor ModelFile::load(uint64_t offset, uint64_t bytes, const std::vector<size_t>& shape, DType dtype) {
+    if (!in_file(offset, bytes, file_size)) {
+        throw DaisoException("Model file is truncated: " + path);
+    }
+    if (mapping) {
+        // The mapping is read-only; the const_cast only adapts to Tensor's
+        // interface, weights are never written through it.
+        void* data = const_cast<uint8_t*>(mapping->data() + offset);
+        return Tensor::view(shape, data, mapping, dtype);
+    }
+    Tensor tensor(shape, dtype);
+    read_bytes(offset, tensor.raw(), bytes);
+    return tensor;
+}
+
+void ModelFile::read_bytes(uint64_t offset, void* dst, uint64_t bytes) {
+    if (!in_file(offset, bytes, file_size)) {
+        throw DaisoException("Model file is truncated: " + path);
+    }
+    if (mapping) {
+        std::memcpy(dst, mapping->data() + offset, bytes);
+        return;
+    }
+    stream.seekg(static_cast<std::streamoff>(offset));
+    if (!stream.read(static_cast<char*>(dst), static_cast<std::streamsize>(bytes))) {
+        throw DaisoException("Failed to read model file: " + path);
+    }
+}
+
+DType dtype_from_file(uint32_t dtype) {
+    switch (dtype) {
+        case DAISO_DTYPE_F32: return DType::F32;
+        case DAISO_DTYPE_Q8_0: return DType::Q8_0;
+        case DAISO_DTYPE_Q4_0: return DType::Q4_0;
+    }
+    throw DaisoException("Unknown tensor dtype in model file: " + std::to_string(dtype));
+}
+
+DaisoDType dtype_to_file(DType dtype) {
+    switch (dtype) {
+        case DType::F32: return DAISO_DTYPE_F32;
+        case DType::Q8_0: return DAISO_DTYPE_Q8_0;
+        case DType::Q4_0: return DAISO_DTYPE_Q4_0;
+    }
+    throw DaisoException("Unknown dtype.");
+}
+
+std::vector<TensorSpec> model_tensor_specs(const DaisoModelHeader& config, bool tied_embeddings) {
+    const size_t dim = config.dim;
+    const size_t hidden_dim = config.hidden_dim;
+    const size_t vocab_size = config.vocab_size;
+    const size_t kv_dim = (size_t)config.n_kv_heads * (dim / config.n_heads);
+    std::vector<TensorSpec> specs;
+    specs.push_back({"tok_embeddings", {vocab_size, dim}});
+    for (int i = 0; i < config.n_layers; ++i) {
+        specs.push_back({layer_tensor(i, "attention_norm"), {dim}});
+        specs.push_back({layer_tensor(i, "attention.wq"), {dim, dim}});
+        specs.push_back({layer_tensor(i, "attention.wk"), {kv_dim, dim}});
+        specs.push_back({layer_tensor(i, "attention.wv"), {kv_dim, dim}});
+        specs.push_back({layer_tensor(i, "attention.wo"), {dim, dim}});
+        specs.push_back({layer_tensor(i, "ffn_norm"), {dim}});
+        specs.push_back({layer_tensor(i, "feed_forward.w1"), {hidden_dim, dim}});
+        specs.push_back({layer_tensor(i, "feed_forward.w2"), {dim, hidden_dim}});
+        specs.push_back({layer_tensor(i, "feed_forward.w3"), {hidden_dim, dim}});
+    }
+    specs.push_back({"norm", {dim}});
+    if (!tied_embeddings) {
+        specs.push_back({"output", {vocab_size, dim}});
+    }
+    return specs;
+}
+
+std::string layer_tensor(int layer, const std::string& name) {
+    return "layers." + std::to_string(layer) + "." + name;
+}
+
+} // namespace DaisoML
@@ -0,0 +1,87 @@
+#ifndef DAISOML_MODEL_FILE_H
+#define DAISOML_MODEL_FILE_H
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "file_format.h"
+#include "mapped_file.h"
+#include "tensor.h"
+
+namespace DaisoML {
+
+// Reader for DaisoML model files (v1 and v2). Validates the header and hands
+// out weight tensors. In mmap mode the tensors are zero-copy views into the
+// mapped file; otherwise each tensor is allocated and read from disk.
+//
+// v2 files carry a tensor directory, so any tensor can be fetched by name in
+// any order. v1 files are an implicit, order-dependent blob; get() then
+// returns the next tensor in the stream and the caller must ask for tensors
+// in the canonical order (see file_format.h).
+class ModelFile {
+public:
+    ModelFile(const std::string& path, bool use_mmap);
+
+    const DaisoModelHeader& header() const;
+    // Metadata; for v1 files this holds the defaults the v1 engine assumed.
+    const DaisoModelMetaV2& meta() const;
+    int version() const;
+    bool is_mapped() const;
+    bool tied_embeddings() const;
+
+    // True if the file has a tensor with this name (always false for v1).
+    bool has(const std::string& name) const;
+    // Names in the tensor directory, in file order (empty for v1).
+    std::vector<std::string> tensor_names() const;
+    // Directory entry for `name`; throws if absent.
+    const DaisoTensorEntry& entry(const std::string& name) const;
+
+    // Returns the tensor `name`, checking it has the expected shape. The
+    // tensor keeps the dtype it has in the file.
+    Tensor get(const std::string& name, const std::vector<size_t>& shape);
+
+    // The raw tokenizer section (v2 only; see file_format.h).
+    bool has_tokenizer() const;
+    std::vector<uint8_t> tokenizer_data();
+
+private:
+    void read_directory();
+    Tensor load(uint64_t offset, uint64_t bytes, const std::vector<size_t>& shape, DType dtype);
+    void read_bytes(uint64_t offset, void* dst, uint64_t bytes);
+
+    std::string path;
+    DaisoModelHeader config;
+    DaisoModelMetaV2 metadata;
+    std::shared_ptr<MappedFile> mapping;
+    std::ifstream stream;
+    uint64_t file_size;
+
+    // v1: byte offset of the next tensor in the stream
+    uint64_t next_offset;
+    // v2: tensor directory
+    std::vector<DaisoTensorEntry> entries;
+    std::unordered_map<std::string, size_t> index;
+};
+
+// Conversions between the on-disk dtype codes and DType.
+DType dtype_from_file(uint32_t dtype);
+DaisoDType dtype_to_file(DType dtype);
+
+// Name and shape of a tensor in a model.
+struct TensorSpec {
+    std::string name;
+    std::vector<size_t> shape;
+};
+
+// All tensors of a model with this configuration, in canonical (v1) order.
+std::vector<TensorSpec> model_tensor_specs(const DaisoModelHeader& config, bool tied_embeddings);
+
+// Builds the canonical per-layer tensor name, e.g. layer_tensor(3, "ffn_norm")
+// -> "layers.3.ffn_norm".
+std::string layer_tensor(int layer, const std::string& name);
+
+} // namespace DaisoML
+
+#endif //DAISOML_MODEL_FILE_H
@@ -0,0 +1,123 @@
+#include "model_writer.h"
+#include "model_file.h"
+#include "utils.h"
+#include <cstring>
+#include <fstream>
+
+namespace DaisoML {
+
+static uint64_t align_up(uint64_t offset) {
+    return (offset + DAISO_ALIGNMENT - 1) / DAISO_ALIGNMENT * DAISO_ALIGNMENT;
+}
+
+ModelWriter::ModelWriter(const DaisoModelHeader& header) : header(header) {
+    std::memset(&metadata, 0, sizeof(metadata));
+    metadata.rope_theta = 10000.0f;
+    metadata.norm_eps = 1e-5f;
+    metadata.rope_scale = 1.0f;
+}
+
+DaisoModelMetaV2& ModelWriter::meta() {
+    return metadata;
+}
+
+void ModelWriter::add(const std::string& name, const Tensor& tensor) {
+    if (name.size() >= (size_t)DAISO_MAX_NAME) {
+        throw DaisoException("Tensor name too long: " + name);
+    }
+    if (tensor.shape().size() > (size_t)DAISO_MAX_DIMS) {
+        throw DaisoException("Too many dimensions for tensor: " + name);
+    }
+    names.push_back(name);
+    tensors.push_back(tensor);
+}
+
+void ModelWriter::set_tokenizer(const std::vector<uint8_t>& data) {
+    tokenizer = data;
+}
+
+void ModelWriter::write(const std::string& path, int version) const {
+    if (version == DAISO_VERSION_1) {
+        write_v1(path);
+    } else if (version == DAISO_VERSION_2) {
+        write_v2(path);
+    } else {
+        throw DaisoException("Cannot write model file version " + std::to_string(version));
+    }
+}
+
+void ModelWriter::write_v1(const std::string& path) const {
+    if (metadata.flags & DAISO_FLAG_TIED_EMBEDDINGS) {
+        throw DaisoException("Tied embeddings cannot be stored in a v1 model file.");
+    }
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        throw DaisoException("Could not open file for writing: " + path);
+    }
+    DaisoModelHeader h = header;
+    h.version = DAISO_VERSION_1;
+    file.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    for (const Tensor& t : tensors) {
+        if (t.dtype() != DType::F32) {
+            throw DaisoException("Quantized tensors cannot be stored in a v1 model file.");
+        }
+        file.write(reinterpret_cast<const char*>(t.data()), t.size() * sizeof(float));
+    }
+    if (!file) {
+        throw DaisoException("Failed to write model file: " + path);
+    }
+}
+
+void ModelWriter::write_v2(const std::string& path) const {
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        throw DaisoException("Could not open file for writing: " + path);
+    }
+
+    // Lay out the directory first so every offset is known up front.
+    std::vector<DaisoTensorEntry> entries(tensors.size());
+    uint64_t offset = align_up(sizeof(DaisoModelHeader) + sizeof(DaisoModelMetaV2) +
+                               tensors.size() * sizeof(DaisoTensorEntry));
+    DaisoModelMetaV2 m = metadata;
+    m.n_tensors = static_cast<uint32_t>(tensors.size());
+    m.data_offset = offset;
+    for (size_t i = 0; i < tensors.size(); ++i) {
+        DaisoTensorEntry& e = entries[i];
+        std::memset(&e, 0, sizeof(e));
+        std::strncpy(e.name, names[i].c_str(), DAISO_MAX_NAME - 1);
+        e.dtype = dtype_to_file(tensors[i].dtype());
+        e.n_dims = static_cast<uint32_t>(tensors[i].shape().size());
+        for (uint32_t d = 0; d < e.n_dims; ++d) {
+            e.shape[d] = tensors[i].shape()[d];
+        }
+        e.offset = offset;
+        e.size = tensors[i].nbytes();
+        offset = align_up(offset + e.size);
+    }
+    // The tokenizer follows the last tensor
+    m.tokenizer_offset = tokenizer.empty() ? 0 : offset;
+    m.tokenizer_size = tokenizer.size();
+
+    DaisoModelHeader h = header;
+    h.version = DAISO_VERSION_2;
+    file.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    file.write(reinterpret_cast<const char*>(&m), sizeof(m));
+    file.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(DaisoTensorEntry));
+
+    static const char zeros[DAISO_ALIGNMENT] = {};
+    for (size_t i = 0; i < tensors.size(); ++i) {
+        const uint64_t pos = static_cast<uint64_t>(file.tellp());
+        file.write(zeros, static_cast<std::streamsize>(entries[i].offset - pos));
+        file.write(static_cast<const char*>(tensors[i].raw()), entries[i].size);
+    }
+    if (!tokenizer.empty()) {
+        const uint64_t pos = static_cast<uint64_t>(file.tellp());
+        file.write(zeros, static_cast<std::streamsize>(m.tokenizer_offset - pos));
+        file.write(reinterpret_cast<const char*>(tokenizer.data()), static_cast<std::streamsize>(tokenizer.size()));
+    }
+    if (!file) {
+        throw DaisoException("Failed to write model file: " + path);
+    }
+}
+
+} // namespace DaisoML
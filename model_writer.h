@@ -0,0 +1,43 @@
+#ifndef DAISOML_MODEL_WRITER_H
+#define DAISOML_MODEL_WRITER_H
+
+#include <string>
+#include <vector>
+#include "file_format.h"
+#include "tensor.h"
+
+namespace DaisoML {
+
+// Collects named tensors and writes them as a DaisoML model file. Used by the
+// dummy model generator and other offline tools.
+class ModelWriter {
+public:
+    explicit ModelWriter(const DaisoModelHeader& header);
+
+    // v2 metadata (flags, rope theta, norm epsilon); ignored for v1 output.
+    DaisoModelMetaV2& meta();
+
+    // Queues a tensor. For v1 output tensors must be added in the canonical
+    // order listed in file_format.h.
+    void add(const std::string& name, const Tensor& tensor);
+
+    // Tokenizer section (see Tokenizer::serialize); ignored for v1 output.
+    void set_tokenizer(const std::vector<uint8_t>& data);
+
+    // Writes the file in the given format version (DAISO_VERSION_1 or 2).
+    void write(const std::string& path, int version) const;
+
+private:
+    void write_v1(const std::string& path) const;
+    void write_v2(const std::string& path) const;
+
+    DaisoModelHeader header;
+    DaisoModelMetaV2 metadata;
+    std::vector<std::string> names;
+    std::vector<Tensor> tensors;
+    std::vector<uint8_t> tokenizer;
+};
+
+} // namespace DaisoML
+
+#endif //DAISOML_MODEL_WRITER_H
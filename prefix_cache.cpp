@@ -0,0 +1,123 @@
+#include "prefix_cache.h"
+#include "kv_cache.h"
+#include "utils.h"
+#include <algorithm>
+
+namespace DaisoML {
+
+PrefixCache::PrefixCache(KVCache& cache, int max_blocks)
+    : cache(cache), block_len(cache.block_size()), block_limit(max_blocks) {
+    if (max_blocks <= 0) {
+        throw DaisoException("Prefix cache needs room for at least one block.");
+    }
+    nodes.emplace_back();
+}
+
+PrefixCache::~PrefixCache() {
+    for (size_t i = 1; i < nodes.size(); ++i) {
+        if (nodes[i].block >= 0) cache.release_block(nodes[i].block);
+    }
+}
+
+size_t PrefixCache::lookup(const std::vector<int>& tokens, size_t limit, std::vector<int>& blocks) {
+    blocks.clear();
+    limit = std::min(limit, tokens.size());
+    const uint64_t now = ++clock;
+    int node = 0;
+    for (size_t begin = 0; begin + block_len <= limit; begin += block_len) {
+        node = child(node, tokens.data() + begin);
+        if (node < 0) break;
+        // A path is touched as a whole, so a leaf is never newer than its parent
+        nodes[node].last_used = now;
+        blocks.push_back(nodes[node].block);
+    }
+    const size_t found = blocks.size() * block_len;
+    looked_up += limit;
+    hits += found;
+    return found;
+}
+
+void PrefixCache::insert(const std::vector<int>& tokens, const std::vector<int>& blocks) {
+    const size_t n_full = std::min(tokens.size() / block_len, blocks.size());
+    const uint64_t now = ++clock;
+    int node = 0;
+    for (size_t i = 0; i < n_full; ++i) {
+        const int* key = tokens.data() + i * block_len;
+        int next = child(node, key);
+        if (next < 0) {
+            if (n_blocks >= block_limit && !evict_one(node)) break;
+            next = add_node(node, key, blocks[i]);
+        }
+        // An existing node may hold another copy of the same positions; the
+        // tree keeps the one it has
+        node = next;
+        nodes[node].last_used = now;
+    }
+}
+
+void PrefixCache::trim() {
+    while (evict_one(-1)) {
+    }
+}
+
+int PrefixCache::cached_blocks() const {
+    return n_blocks;
+}
+
+uint64_t PrefixCache::lookup_tokens() const {
+    return looked_up;
+}
+
+uint64_t PrefixCache::hit_tokens() const {
+    return hits;
+}
+
+int PrefixCache::child(int node, const int* tokens) const {
+    const auto& children = nodes[node].children;
+    const auto it = children.find(std::vector<int>(tokens, tokens + block_len));
+    return it == children.end() ? -1 : it->second;
+}
+
+int PrefixCache::add_node(int parent, const int* tokens, int block) {
+    int index;
+    if (!free_nodes.empty()) {
+        index = free_nodes.back();
+        free_nodes.pop_back();
+    } else {
+        index = (int)nodes.size();
+        nodes.emplace_back();
+    }
+    cache.retain_block(block);
+    Node& n = nodes[index];
+    n.block = block;
+    n.parent = parent;
+    n.key.assign(tokens, tokens + block_len);
+    nodes[parent].children.emplace(n.key, index);
+    n_blocks++;
+    return index;
+}
+
+bool PrefixCache::evict_one(int keep) {
+    // Only leaves can go, and only when the tree holds the last reference.
+    // The scan is linear in the tree, which is bounded by the block budget.
+    int victim = -1;
+    for (int i = 1; i < (int)nodes.size(); ++i) {
+        const Node& n = nodes[i];
+        if (n.block < 0 || i == keep || !n.children.empty() || cache.block_refs(n.block) > 1) continue;
+        if (victim < 0 || n.last_used < nodes[victim].last_used) victim = i;
+    }
+    if (victim < 0) return false;
+    remove(victim);
+    return true;
+}
+
+void PrefixCache::remove(int node) {
+    Node& n = nodes[node];
+    nodes[n.parent].children.erase(n.key);
+    cache.release_block(n.block);
+    n = Node();
+    free_nodes.push_back(node);
+    n_blocks--;
+}
+
+} // namespace DaisoML
@@ -0,0 +1,76 @@
+#ifndef DAISOML_PREFIX_CACHE_H
+#define DAISOML_PREFIX_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+namespace DaisoML {
+
+class KVCache;
+
+// Keeps the KV cache of prompt prefixes so later sequences can skip them.
+//
+// A radix tree over KV cache blocks: every node is one full block, reached by
+// the block_size tokens cached in it, so a path from the root spells a token
+// prefix and holds the blocks of its positions. The tree keeps a reference
+// on each of its blocks (see KVCache::retain_block); a sequence starting with
+// a cached prefix attaches those blocks and only computes the rest.
+//
+// At most `max_blocks` blocks are held. To make room, the least recently used
+// leaves whose blocks no sequence is using are evicted. Not thread-safe.
+class PrefixCache {
+public:
+    PrefixCache(KVCache& cache, int max_blocks);
+    // Releases every block the tree holds
+    ~PrefixCache();
+
+    PrefixCache(const PrefixCache&) = delete;
+    PrefixCache& operator=(const PrefixCache&) = delete;
+
+    // Fills `blocks` with the blocks of the longest cached prefix of the
+    // first `limit` tokens and returns its length in tokens (a multiple of
+    // the block size).
+    size_t lookup(const std::vector<int>& tokens, size_t limit, std::vector<int>& blocks);
+    // Adds the full blocks among `blocks`, which hold the KV of `tokens`
+    // from position 0, to the tree.
+    void insert(const std::vector<int>& tokens, const std::vector<int>& blocks);
+    // Drops every block not in use by a sequence
+    void trim();
+
+    int cached_blocks() const;
+    // Prompt tokens looked up, and how many of them were found cached
+    uint64_t lookup_tokens() const;
+    uint64_t hit_tokens() const;
+
+private:
+    struct Node {
+        int block = -1;
+        int parent = -1;
+        uint64_t last_used = 0;
+        std::vector<int> key; // the tokens of `block`
+        std::map<std::vector<int>, int> children;
+    };
+
+    int child(int node, const int* tokens) const;
+    int add_node(int parent, const int* tokens, int block);
+    // Evicts the least recently used unused leaf other than `keep`; returns
+    // false if there is none.
+    bool evict_one(int keep);
+    void remove(int node);
+
+    KVCache& cache;
+    int block_len;
+    int block_limit;
+    int n_blocks = 0;
+    uint64_t clock = 0;
+    uint64_t looked_up = 0;
+    uint64_t hits = 0;
+    std::vector<Node> nodes; // nodes[0] is the root
+    std::vector<int> free_nodes;
+};
+
+} // namespace DaisoML
+
+#endif //DAISOML_PREFIX_CACHE_H
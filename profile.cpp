@@ -0,0 +1,273 @@
+#include "profile.h"
+#include "utils.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace DaisoML {
+
+namespace {
+
+constexpr int n_ops = static_cast<int>(ProfileOp::Count);
+constexpr int max_layers = 256;
+// Events kept per thread while tracing; later ones are counted and dropped.
+constexpr size_t max_events = 1 << 18;
+
+struct Counter {
+    std::atomic<uint64_t> calls{0};
+    std::atomic<uint64_t> ns{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> flops{0};
+};
+
+struct Event {
+    ProfileOp op;
+    int layer;
+    uint64_t start;
+    uint64_t end;
+};
+
+// Only the owning thread writes; other threads read for reports. Updates are
+// a relaxed load and store, which is enough for a single writer.
+struct ThreadState {
+    int tid = 0;
+    int current_layer = -1;
+    Counter ops[n_ops];
+    std::atomic<uint64_t> layer_ns[max_layers] = {};
+    std::unique_ptr<Event[]> events;
+    std::atomic<size_t> n_events{0};
+    std::atomic<uint64_t> dropped_events{0};
+};
+
+void bump(std::atomic<uint64_t>& counter, uint64_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::shared_ptr<ThreadState>> threads;
+};
+
+Registry& registry() {
+    static Registry* r = new Registry();
+    return *r;
+}
+
+ThreadState& thread_state() {
+    thread_local std::shared_ptr<ThreadState> state;
+    if (!state) {
+        state = std::make_shared<ThreadState>();
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        state->tid = (int)r.threads.size() + 1;
+        r.threads.push_back(state);
+    }
+    return *state;
+}
+
+std::vector<std::shared_ptr<ThreadState>> all_threads() {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    return r.threads;
+}
+
+} // namespace
+
+std::atomic<bool> Profiler::active{false};
+std::atomic<bool> Profiler::trace_active{false};
+
+const char* profile_op_name(ProfileOp op) {
+    switch (op) {
+        case ProfileOp::Embedding: return "embedding";
+        case ProfileOp::Layer: return "layer";
+        case ProfileOp::AttnNorm: return "attn_norm";
+        case ProfileOp::AttnQKV: return "attn_qkv";
+        case ProfileOp::AttnRope: return "attn_rope_kv";
+        case ProfileOp::AttnCore: return "attn_core";
+        case ProfileOp::AttnOut: return "attn_out";
+        case ProfileOp::FfnNorm: return "ffn_norm";
+        case ProfileOp::FfnGateUp: return "ffn_gate_up";
+        case ProfileOp::FfnDown: return "ffn_down";
+        case ProfileOp::FinalNorm: return "final_norm";
+        case ProfileOp::Classifier: return "classifier";
+        case ProfileOp::Sample: return "sample";
+        case ProfileOp::Tokenize: return "tokenize";
+        case ProfileOp::Count: break;
+    }
+    return "unknown";
+}
+
+void Profiler::enable(bool on) {
+    active.store(on, std::memory_order_relaxed);
+    if (!on) trace_active.store(false, std::memory_order_relaxed);
+}
+
+void Profiler::enable_tracing(bool on) {
+    trace_active.store(on, std::memory_order_relaxed);
+    if (on) active.store(true, std::memory_order_relaxed);
+}
+
+void Profiler::reset() {
+    for (const auto& t : all_threads()) {
+        for (Counter& c : t->ops) {
+            c.calls.store(0, std::memory_order_relaxed);
+            c.ns.store(0, std::memory_order_relaxed);
+            c.bytes.store(0, std::memory_order_relaxed);
+            c.flops.store(0, std::memory_order_relaxed);
+        }
+        for (auto& ns : t->layer_ns) {
+            ns.store(0, std::memory_order_relaxed);
+        }
+        t->n_events.store(0, std::memory_order_release);
+        t->dropped_events.store(0, std::memory_order_relaxed);
+    }
+}
+
+uint64_t Profiler::now_ns() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+void Profiler::record(ProfileOp op, int layer, uint64_t start_ns, uint64_t end_ns, uint64_t bytes,
+                      uint64_t flops) {
+    ThreadState& t = thread_state();
+    if (layer < 0) layer = t.current_layer;
+    const uint64_t ns = end_ns > start_ns ? end_ns - start_ns : 0;
+    Counter& c = t.ops[static_cast<int>(op)];
+    bump(c.calls, 1);
+    bump(c.ns, ns);
+    bump(c.bytes, bytes);
+    bump(c.flops, flops);
+    if (op == ProfileOp::Layer && layer >= 0 && layer < max_layers) {
+        bump(t.layer_ns[layer], ns);
+    }
+
+    if (tracing()) {
+        const size_t n = t.n_events.load(std::memory_order_relaxed);
+        if (n >= max_events) {
+            bump(t.dropped_events, 1);
+            return;
+        }
+        if (!t.events) t.events.reset(new Event[max_events]);
+        t.events[n] = {op, layer, start_ns, end_ns};
+        // Publishes the event (and the buffer) to write_trace()
+        t.n_events.store(n + 1, std::memory_order_release);
+    }
+}
+
+std::string Profiler::report() {
+    uint64_t calls[n_ops] = {}, ns[n_ops] = {}, bytes[n_ops] = {}, flops[n_ops] = {};
+    uint64_t layer_ns[max_layers] = {};
+    for (const auto& t : all_threads()) {
+        for (int i = 0; i < n_ops; ++i) {
+            calls[i] += t->ops[i].calls.load(std::memory_order_relaxed);
+            ns[i] += t->ops[i].ns.load(std::memory_order_relaxed);
+            bytes[i] += t->ops[i].bytes.load(std::memory_order_relaxed);
+            flops[i] += t->ops[i].flops.load(std::memory_order_relaxed);
+        }
+        for (int l = 0; l < max_layers; ++l) {
+            layer_ns[l] += t->layer_ns[l].load(std::memory_order_relaxed);
+        }
+    }
+
+    // Shares are of the time in leaf ops; layer spans overlap their contents.
+    uint64_t total_ns = 0;
+    for (int i = 0; i < n_ops; ++i) {
+        if (i != static_cast<int>(ProfileOp::Layer)) total_ns += ns[i];
+    }
+    auto share = [&](uint64_t v) { return total_ns > 0 ? 100.0 * (double)v / (double)total_ns : 0.0; };
+
+    std::string out;
+    char line[160];
+    std::snprintf(line, sizeof(line), "%-14s %9s %11s %7s %10s %9s %9s\n", "op", "calls", "total ms", "%",
+                  "avg us", "GB/s", "GFLOP/s");
+    out += line;
+    for (int i = 0; i < n_ops; ++i) {
+        if (calls[i] == 0) continue;
+        const double seconds = (double)ns[i] * 1e-9;
+        std::snprintf(line, sizeof(line), "%-14s %9llu %11.3f %7.1f %10.2f %9.2f %9.2f\n",
+                      profile_op_name(static_cast<ProfileOp>(i)), (unsigned long long)calls[i], ns[i] * 1e-6,
+                      share(ns[i]), ns[i] * 1e-3 / (double)calls[i],
+                      seconds > 0 ? (double)bytes[i] / seconds * 1e-9 : 0.0,
+                      seconds > 0 ? (double)flops[i] / seconds * 1e-9 : 0.0);
+        out += line;
+    }
+    std::snprintf(line, sizeof(line), "%-14s %9s %11.3f\n", "total", "", total_ns * 1e-6);
+    out += line;
+
+    bool header = false;
+    for (int l = 0; l < max_layers; ++l) {
+        if (layer_ns[l] == 0) continue;
+        if (!header) {
+            out += "\nlayer            total ms       %\n";
+            header = true;
+        }
+        std::snprintf(line, sizeof(line), "%-14d %11.3f %7.1f\n", l, layer_ns[l] * 1e-6, share(layer_ns[l]));
+        out += line;
+    }
+    return out;
+}
+
+void Profiler::write_trace(const std::string& path) {
+    std::ofstream file(path);
+    if (!file) {
+        throw DaisoException("Cannot open trace file: " + path);
+    }
+    const auto threads = all_threads();
+    uint64_t origin = UINT64_MAX;
+    uint64_t dropped = 0;
+    for (const auto& t : threads) {
+        const size_t n = t->n_events.load(std::memory_order_acquire);
+        if (n > 0) origin = std::min(origin, t->events[0].start);
+        dropped += t->dropped_events.load(std::memory_order_relaxed);
+    }
+
+    file << "{\"traceEvents\":[";
+    bool first = true;
+    char buf[256];
+    for (const auto& t : threads) {
+        const size_t n = t->n_events.load(std::memory_order_acquire);
+        for (size_t i = 0; i < n; ++i) {
+            const Event& e = t->events[i];
+            const double ts = (double)(e.start - std::min(origin, e.start)) * 1e-3;
+            const double dur = (double)(e.end - e.start) * 1e-3;
+            std::snprintf(buf, sizeof(buf),
+                          "%s\n{\"name\":\"%s\",\"cat\":\"daiso\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                          "\"pid\":1,\"tid\":%d,\"args\":{\"layer\":%d}}",
+                          first ? "" : ",", profile_op_name(e.op), ts, dur, t->tid, e.layer);
+            file << buf;
+            first = false;
+        }
+    }
+    file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    if (!file) {
+        throw DaisoException("Failed to write trace file: " + path);
+    }
+    if (dropped > 0) {
+        log(LogLevel::Warn, "Trace buffer full; " + std::to_string(dropped) + " events were not recorded.");
+    }
+}
+
+ProfileScope::ProfileScope(ProfileOp op, int layer, uint64_t bytes, uint64_t flops)
+    : op(op), layer(layer), outer_layer(-1), bytes(bytes), flops(flops) {
+    if (!Profiler::enabled()) return;
+    if (op == ProfileOp::Layer) {
+        ThreadState& t = thread_state();
+        outer_layer = t.current_layer;
+        t.current_layer = layer;
+    }
+    start = Profiler::now_ns();
+}
+
+ProfileScope::~ProfileScope() {
+    if (start == 0) return;
+    Profiler::record(op, layer, start, Profiler::now_ns(), bytes, flops);
+    if (op == ProfileOp::Layer) thread_state().current_layer = outer_layer;
+}
+
+} // namespace DaisoML
@@ -0,0 +1,109 @@
+#ifndef DAISOML_PROFILE_H
+#define DAISOML_PROFILE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Hot-path instrumentation. Scopes compile to nothing when DAISO_PROFILE is 0
+// (CMake option DAISO_PROFILING); otherwise a disabled profiler costs one
+// relaxed atomic load per scope.
+#ifndef DAISO_PROFILE
+#define DAISO_PROFILE 1
+#endif
+
+namespace DaisoML {
+
+// Operations timed inside the forward pass and around it.
+enum class ProfileOp {
+    Embedding,
+    Layer, // a whole transformer block; the ops below nest inside it
+    AttnNorm,
+    AttnQKV,
+    AttnRope,
+    AttnCore,
+    AttnOut,
+    FfnNorm,
+    FfnGateUp,
+    FfnDown,
+    FinalNorm,
+    Classifier,
+    Sample,
+    Tokenize,
+    Count,
+};
+
+const char* profile_op_name(ProfileOp op);
+
+// Collects time, bytes moved and flops per op. Each recording thread owns its
+// counters (single writer, relaxed atomics), so recording never takes a lock;
+// report() sums them across threads. With tracing on, every scope is also
+// kept as an event for a Chrome trace (chrome://tracing, Perfetto).
+class Profiler {
+public:
+    static void enable(bool on);
+    static bool enabled() { return active.load(std::memory_order_relaxed); }
+    // Keeps individual events for write_trace(). Implies enable(true).
+    static void enable_tracing(bool on);
+    static bool tracing() { return trace_active.load(std::memory_order_relaxed); }
+
+    // Clears all counters and events. Call while nothing is being recorded.
+    static void reset();
+
+    // Table of calls, time, share of total, achieved GB/s and GFLOP/s per op,
+    // followed by the time spent in each layer.
+    static std::string report();
+    // Writes the recorded events as Chrome trace-event JSON.
+    static void write_trace(const std::string& path);
+
+    // Nanoseconds on a monotonic clock
+    static uint64_t now_ns();
+    // layer < 0: the layer of the innermost enclosing Layer scope, if any
+    static void record(ProfileOp op, int layer, uint64_t start_ns, uint64_t end_ns, uint64_t bytes,
+                       uint64_t flops);
+
+private:
+    static std::atomic<bool> active;
+    static std::atomic<bool> trace_active;
+};
+
+// Work of a matrix product of a rows x cols weight (stored in weight_bytes)
+// with n activation rows: the weights and both activations cross memory once.
+inline uint64_t matmul_bytes(uint64_t weight_bytes, uint64_t rows, uint64_t cols, uint64_t n) {
+    return weight_bytes + n * (rows + cols) * sizeof(float);
+}
+inline uint64_t matmul_flops(uint64_t rows, uint64_t cols, uint64_t n) {
+    return 2 * rows * cols * n;
+}
+
+// Times its own lifetime as one `op`. `bytes` and `flops` describe the work
+// done, for bandwidth and throughput figures.
+class ProfileScope {
+public:
+    explicit ProfileScope(ProfileOp op, int layer = -1, uint64_t bytes = 0, uint64_t flops = 0);
+    ~ProfileScope();
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    ProfileOp op;
+    int layer;
+    int outer_layer;
+    uint64_t bytes;
+    uint64_t flops;
+    uint64_t start = 0;
+};
+
+} // namespace DaisoML
+
+#define DAISO_PROFILE_CONCAT_(a, b) a##b
+#define DAISO_PROFILE_CONCAT(a, b) DAISO_PROFILE_CONCAT_(a, b)
+#if DAISO_PROFILE
+#define DAISO_PROFILE_SCOPE(...) \
+    ::DaisoML::ProfileScope DAISO_PROFILE_CONCAT(daiso_profile_scope_, __LINE__)(__VA_ARGS__)
+#else
+#define DAISO_PROFILE_SCOPE(...) ((void)0)
+#endif
+
+#endif //DAISOML_PROFILE_H
@@ -0,0 +1,73 @@
+#include "file_format.h"
+#include "model_file.h"
+#include "model_writer.h"
+#include "tensor.h"
+#include "kernels/quant.h"
+#include <iostream>
+#include <string>
+
+// This utility converts a model file to block-quantized weights.
+// Projection matrices (attention, feed-forward and the output head) are
+// quantized; the embedding table and the norm weights stay in f32, since they
+// are read element-wise rather than through dot products.
+//
+// Usage: daiso_quantize <input_path> <output_path> <q8_0|q4_0>
+
+static bool quantizable(const std::string& name, const std::vector<size_t>& shape) {
+    return shape.size() == 2 && name != "tok_embeddings" && shape[1] % DaisoML::kernels::QK == 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 4) {
+        std::cerr << "Usage: " << argv[0] << " <input_path> <output_path> <q8_0|q4_0>" << std::endl;
+        return 1;
+    }
+    const std::string input = argv[1];
+    const std::string output = argv[2];
+    const std::string type = argv[3];
+
+    DaisoML::DType dtype;
+    if (type == "q8_0") {
+        dtype = DaisoML::DType::Q8_0;
+    } else if (type == "q4_0") {
+        dtype = DaisoML::DType::Q4_0;
+    } else {
+        std::cerr << "Error: unknown quantization type '" << type << "' (expected q8_0 or q4_0)" << std::endl;
+        return 1;
+    }
+
+    try {
+        DaisoML::ModelFile file(input, true);
+        DaisoML::ModelWriter writer(file.header());
+        writer.meta() = file.meta();
+        if (file.has_tokenizer()) {
+            writer.set_tokenizer(file.tokenizer_data());
+        }
+
+        std::cout << "DaisoML Quantizer" << std::endl;
+        std::cout << "---------------------------" << std::endl;
+        std::cout << input << " -> " << output << " (" << DaisoML::dtype_name(dtype) << ")" << std::endl;
+
+        size_t bytes_in = 0;
+        size_t bytes_out = 0;
+        for (const auto& spec : DaisoML::model_tensor_specs(file.header(), file.tied_embeddings())) {
+            DaisoML::Tensor t = file.get(spec.name, spec.shape);
+            bytes_in += t.nbytes();
+            if (t.dtype() == DaisoML::DType::F32 && quantizable(spec.name, spec.shape)) {
+                t = DaisoML::quantize(t, dtype);
+            }
+            bytes_out += t.nbytes();
+            writer.add(spec.name, t);
+        }
+        writer.write(output, DaisoML::DAISO_VERSION_2);
+
+        std::cout << "  Tensor data: " << bytes_in / (1024 * 1024.0) << " MiB -> "
+                  << bytes_out / (1024 * 1024.0) << " MiB" << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "---------------------------" << std::endl;
+    std::cout << "Successfully wrote quantized model file: " << output << std::endl;
+    return 0;
+}
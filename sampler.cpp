@@ -1,38 +1,210 @@
 #include "sampler.h"
+#include "profile.h"
 #include "utils.h"
 #include <algorithm>
+#include <cmath>
+#include <limits>
 #include <vector>
 
 namespace DaisoML {
 
-Sampler::Sampler(int vocab_size, float temperature, float top_p)
-    : vocab_size(vocab_size), temperature(temperature), top_p(top_p) {
-    // Seed the random number generator
-    std::random_device rd;
-    rng = std::mt19937(rd());
-    log("Sampler initialized.");
+Sampler::Sampler(int vocab_size, const SamplerOptions& options)
+    : vocab_size(vocab_size), opts(options), rng(options.seed) {
+    if (vocab_size <= 0) {
+        throw DaisoException("Sampler needs a positive vocabulary size.");
+    }
+}
+
+const SamplerOptions& Sampler::options() const {
+    return opts;
 }
 
 int Sampler::sample(Tensor& logits) {
-    // This is a placeholder for the sampling logic (e.g., top-p/nucleus sampling).
-    // A real implementation would:
-    // 1. Apply temperature to the logits.
-    // 2. Compute softmax over the logits.
-    // 3. Sort probabilities and select the top-p cumulative probability mass.
-    // 4. Sample from the reduced set of tokens.
-    log("Sampling next token (placeholder).");
-
-    // For now, just return the token with the highest logit (argmax).
-    float* logits_data = logits.data();
-    int max_token_id = 0;
-    float max_logit = -1e9;
-    for (int i = 0; i < vocab_size; ++i) {
-        if (logits_data[i] > max_logit) {
-            max_logit = logits_data[i];
-            max_token_id = i;
+    return sample(logits.data());
+}
+
+void Sampler::accept(int token) {
+    if (opts.penalty_last_n <= 0) return;
+    if (history.size() < (size_t)opts.penalty_last_n) {
+        history.push_back(token);
+        return;
+    }
+    history[history_next] = token;
+    history_next = (history_next + 1) % history.size();
+}
+
+void Sampler::collect_penalized() {
+    penalized.clear();
+    if (opts.repetition_penalty == 1.0f && opts.frequency_penalty == 0.0f && opts.presence_penalty == 0.0f) {
+        return;
+    }
+    for (int token : history) {
+        penalized.push_back({token, 1});
+    }
+    std::sort(penalized.begin(), penalized.end());
+    // Merge duplicates into counts
+    size_t n = 0;
+    for (size_t i = 0; i < penalized.size(); ++i) {
+        if (n > 0 && penalized[n - 1].first == penalized[i].first) {
+            penalized[n - 1].second++;
+        } else {
+            penalized[n++] = penalized[i];
+        }
+    }
+    penalized.resize(n);
+}
+
+float Sampler::penalize(float logit, int count) const {
+    if (opts.repetition_penalty != 1.0f) {
+        logit = logit > 0.0f ? logit / opts.repetition_penalty : logit * opts.repetition_penalty;
+    }
+    return logit - opts.presence_penalty - opts.frequency_penalty * (float)count;
+}
+
+int Sampler::sample(const float* logits) {
+    DAISO_PROFILE_SCOPE(ProfileOp::Sample, -1, (uint64_t)vocab_size * sizeof(float));
+    float mass;
+    const size_t n = select(logits, mass);
+
+    // 4. Draw from the kept candidates
+    int token = candidates[0].id;
+    if (opts.temperature > 0.0f) {
+        std::uniform_real_distribution<float> pick(0.0f, mass);
+        token = draw(n, pick(rng));
+    }
+    accept(token);
+    return token;
+}
+
+void Sampler::probabilities(const float* logits, float* probs) {
+    float mass;
+    const size_t n = select(logits, mass);
+    std::fill(probs, probs + vocab_size, 0.0f);
+    const float inv_mass = 1.0f / mass;
+    for (size_t i = 0; i < n; ++i) {
+        probs[candidates[i].id] = candidates[i].value * inv_mass;
+    }
+}
+
+int Sampler::draw(size_t n, float r) const {
+    float cumulative = 0.0f;
+    for (size_t i = 0; i < n; ++i) {
+        cumulative += candidates[i].value;
+        if (r < cumulative) return candidates[i].id;
+    }
+    return candidates[n - 1].id; // guards against rounding at the top end
+}
+
+size_t Sampler::select(const float* logits, float& mass) {
+    collect_penalized();
+    auto is_penalized = [&](int id) {
+        return std::binary_search(penalized.begin(), penalized.end(), std::make_pair(id, 0),
+                                  [](const std::pair<int, int>& a, const std::pair<int, int>& b) {
+                                      return a.first < b.first;
+                                  });
+    };
+    auto by_value_desc = [](const Candidate& a, const Candidate& b) { return a.value > b.value; };
+
+    // 1. One pass over the vocabulary. With top-k (or greedy, k = 1) the best
+    // k tokens are kept in a min-heap, so most logits are rejected by a single
+    // compare against its root. Penalized tokens are skipped here and offered
+    // with their penalized logits afterwards.
+    const bool greedy = opts.temperature <= 0.0f;
+    const size_t k = greedy ? 1 : (opts.top_k > 0 ? std::min((size_t)opts.top_k, (size_t)vocab_size) : 0);
+    candidates.clear();
+    if (k > 0) {
+        candidates.reserve(k);
+        float floor = -std::numeric_limits<float>::infinity();
+        auto offer = [&](float value, int id) {
+            if (candidates.size() < k) {
+                candidates.push_back({value, id});
+                std::push_heap(candidates.begin(), candidates.end(), by_value_desc);
+            } else {
+                std::pop_heap(candidates.begin(), candidates.end(), by_value_desc);
+                candidates.back() = {value, id};
+                std::push_heap(candidates.begin(), candidates.end(), by_value_desc);
+            }
+            if (candidates.size() == k) floor = candidates.front().value;
+        };
+        for (int i = 0; i < vocab_size; ++i) {
+            const float l = logits[i];
+            if (candidates.size() == k && l <= floor) continue;
+            if (!penalized.empty() && is_penalized(i)) continue;
+            offer(l, i);
+        }
+        for (const auto& p : penalized) {
+            if (p.first < 0 || p.first >= vocab_size) continue;
+            const float l = penalize(logits[p.first], p.second);
+            if (candidates.size() < k || l > floor) offer(l, p.first);
+        }
+    } else {
+        candidates.resize(vocab_size);
+        for (int i = 0; i < vocab_size; ++i) {
+            candidates[i] = {logits[i], i};
+        }
+        for (const auto& p : penalized) {
+            if (p.first < 0 || p.first >= vocab_size) continue;
+            candidates[p.first].value = penalize(logits[p.first], p.second);
+        }
+    }
+
+    if (greedy) {
+        candidates.resize(1);
+        candidates[0].value = 1.0f;
+        mass = 1.0f;
+        return 1;
+    }
+
+    // 2. Temperature and softmax over the candidates only. Probabilities are
+    // left unnormalized (the best token is 1) and `mass` tracks their sum.
+    float max_logit = candidates.front().value;
+    for (const Candidate& c : candidates) {
+        max_logit = std::max(max_logit, c.value);
+    }
+    const float inv_temp = 1.0f / opts.temperature;
+    size_t n = 0;
+    mass = 0.0f;
+    for (const Candidate& c : candidates) {
+        const float p = std::exp((c.value - max_logit) * inv_temp);
+        // min-p: relative to the best token, whose p is 1 and is always kept
+        if (p < opts.min_p && p < 1.0f) continue;
+        candidates[n++] = {p, c.id};
+        mass += p;
+    }
+    candidates.resize(n);
+
+    // 3. Top-p: rank only as many candidates as the nucleus needs. Each round
+    // selects the next block of best candidates (nth_element, linear time)
+    // and sorts just that block, growing the block 4x until the cumulative
+    // mass reaches top_p.
+    if (opts.top_p < 1.0f) {
+        const float target = opts.top_p * mass;
+        float cumulative = 0.0f;
+        size_t sorted = 0;
+        size_t keep = n;
+        size_t block = std::min(n, (size_t)32);
+        while (keep == n && sorted < n) {
+            const size_t end = std::min(n, sorted + block);
+            if (end < n) {
+                std::nth_element(candidates.begin() + sorted, candidates.begin() + end, candidates.end(), by_value_desc);
+            }
+            std::sort(candidates.begin() + sorted, candidates.begin() + end, by_value_desc);
+            for (size_t i = sorted; i < end; ++i) {
+                cumulative += candidates[i].value;
+                if (cumulative >= target) {
+                    keep = i + 1;
+                    break;
+                }
+            }
+            sorted = end;
+            block *= 4;
+        }
+        if (keep < n) {
+            n = keep;
+            mass = cumulative;
         }
     }
-    return max_token_id;
+    return n;
 }
 
 } // namespace DaisoML
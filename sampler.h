@@ -2,24 +2,79 @@
 #define DAISOML_SAMPLER_H
 
 #include "tensor.h"
+#include <cstdint>
 #include <random>
+#include <vector>
 
 namespace DaisoML {
 
-// The Sampler is responsible for choosing the next token from the model's output logits.
+// Sampling parameters, applied in this order: penalties, top-k, temperature,
+// min-p, top-p. Setting a filter to its "off" value skips it.
+struct SamplerOptions {
+    float temperature = 0.8f; // <= 0: greedy (argmax)
+    int top_k = 40;           // <= 0: off
+    float top_p = 0.9f;       // >= 1: off
+    float min_p = 0.0f;       // drop tokens below min_p * p(most likely); 0: off
+    // Penalties for tokens among the last `penalty_last_n` seen (prompt and
+    // generated). A repeated token's logit is divided by repetition_penalty
+    // (multiplied when negative), then reduced by presence_penalty plus
+    // frequency_penalty per occurrence.
+    float repetition_penalty = 1.0f;
+    float frequency_penalty = 0.0f;
+    float presence_penalty = 0.0f;
+    int penalty_last_n = 64;
+    uint64_t seed = 0; // the same seed and inputs give the same tokens
+};
+
+// Chooses the next token from the model's output logits.
+//
+// One pass over the vocabulary applies the penalties and keeps the top_k
+// best tokens in a small heap; only those candidates are exponentiated and
+// ranked. Without top-k, top-p is found by partial selection over growing
+// prefixes instead of a full sort. Buffers are reused between calls, so
+// sampling does not allocate after the first token.
 class Sampler {
 public:
-    explicit Sampler(int vocab_size, float temperature = 0.8f, float top_p = 0.9f);
+    explicit Sampler(int vocab_size, const SamplerOptions& options = SamplerOptions());
 
     // Sample a token from the logits tensor
     int sample(Tensor& logits);
+    // Sample a token from vocab_size logits. The token is recorded for the
+    // penalties.
+    int sample(const float* logits);
+    // Records a token that was not sampled (e.g. the prompt) for the penalties.
+    void accept(int token);
+
+    // The distribution sample() draws from, after penalties, temperature and
+    // filters: vocab_size probabilities summing to 1 (one-hot when greedy).
+    // Records nothing.
+    void probabilities(const float* logits, float* probs);
+
+    const SamplerOptions& options() const;
 
 private:
+    struct Candidate {
+        float value; // logit, later unnormalized probability
+        int id;
+    };
+
+    // Collects the distinct recent tokens and their counts into `penalized`.
+    void collect_penalized();
+    float penalize(float logit, int count) const;
+    // Steps 1-3 of sampling: leaves the n kept candidates, with unnormalized
+    // probabilities summing to `mass`, at the front of `candidates`.
+    size_t select(const float* logits, float& mass);
+    // The candidate where the cumulative probability passes r
+    int draw(size_t n, float r) const;
+
     int vocab_size;
-    float temperature;
-    float top_p;
+    SamplerOptions opts;
+    std::mt19937_64 rng;
 
-    std::mt19937 rng; // Random number generator
+    std::vector<int> history; // ring buffer of the last penalty_last_n tokens
+    size_t history_next = 0;
+    std::vector<std::pair<int, int>> penalized; // (token, count), sorted by token
+    std::vector<Candidate> candidates;
 };
 
 } // namespace DaisoML
@@ -0,0 +1,65 @@
+#include "scratch.h"
+#include "utils.h"
+#include <cstdint>
+
+namespace DaisoML {
+
+static size_t align_up(size_t n) {
+    return (n + ScratchArena::kAlignment - 1) / ScratchArena::kAlignment * ScratchArena::kAlignment;
+}
+
+ScratchArena::ScratchArena(size_t bytes) : base(nullptr), size(align_up(bytes)), offset(0), peak(0) {
+    if (size > 0) {
+        buffer.reset(new unsigned char[size + kAlignment]);
+        const uintptr_t p = reinterpret_cast<uintptr_t>(buffer.get());
+        base = buffer.get() + (align_up(p) - p);
+    }
+}
+
+float* ScratchArena::alloc_floats(size_t n) {
+    return static_cast<float*>(alloc_bytes(n * sizeof(float)));
+}
+
+int* ScratchArena::alloc_ints(size_t n) {
+    return static_cast<int*>(alloc_bytes(n * sizeof(int)));
+}
+
+void* ScratchArena::alloc_bytes(size_t n) {
+    const size_t bytes = align_up(n);
+    if (offset + bytes > size) {
+        throw DaisoException("Scratch arena exhausted: need " + std::to_string(offset + bytes) +
+                             " bytes, have " + std::to_string(size));
+    }
+    void* p = base + offset;
+    offset += bytes;
+    if (offset > peak) peak = offset;
+    return p;
+}
+
+size_t ScratchArena::bytes_for(std::initializer_list<size_t> float_counts) {
+    size_t bytes = 0;
+    for (size_t n : float_counts) {
+        bytes += align_up(n * sizeof(float));
+    }
+    return bytes;
+}
+
+size_t ScratchArena::capacity() const {
+    return size;
+}
+
+size_t ScratchArena::used() const {
+    return offset;
+}
+
+size_t ScratchArena::high_water() const {
+    return peak;
+}
+
+ScratchArena::Scope::Scope(ScratchArena& arena) : arena(arena), mark(arena.offset) {}
+
+ScratchArena::Scope::~Scope() {
+    arena.offset = mark;
+}
+
+} // namespace DaisoML
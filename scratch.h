@@ -0,0 +1,62 @@
+#ifndef DAISOML_SCRATCH_H
+#define DAISOML_SCRATCH_H
+
+#include <cstddef>
+#include <initializer_list>
+#include <memory>
+
+namespace DaisoML {
+
+// Bump allocator for the temporary activations of a forward pass. The model
+// sizes it once from its configuration, and layers take their buffers from
+// it instead of the heap, so a decode step performs no allocations. Memory is
+// returned in LIFO order with Scope.
+class ScratchArena {
+public:
+    // Alignment of every buffer handed out, in bytes.
+    static constexpr size_t kAlignment = 64;
+
+    explicit ScratchArena(size_t bytes = 0);
+
+    ScratchArena(const ScratchArena&) = delete;
+    ScratchArena& operator=(const ScratchArena&) = delete;
+
+    // Return an aligned buffer of n elements; throw if the arena is exhausted.
+    float* alloc_floats(size_t n);
+    int* alloc_ints(size_t n);
+
+    // Bytes needed to hand out these buffer sizes (in floats), with padding.
+    static size_t bytes_for(std::initializer_list<size_t> float_counts);
+
+    size_t capacity() const;
+    size_t used() const;
+    // Largest used() seen so far
+    size_t high_water() const;
+
+    // Releases everything allocated after its construction when destroyed.
+    class Scope {
+    public:
+        explicit Scope(ScratchArena& arena);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        ScratchArena& arena;
+        size_t mark;
+    };
+
+private:
+    void* alloc_bytes(size_t n);
+
+    std::unique_ptr<unsigned char[]> buffer;
+    unsigned char* base; // buffer, aligned up
+    size_t size;
+    size_t offset;
+    size_t peak;
+};
+
+} // namespace DaisoML
+
+#endif //DAISOML_SCRATCH_H
@@ -0,0 +1,670 @@
+#include "server.h"
+#include "engine.h"
+#include "utils.h"
+
+#include <cctype>
+#include <cerrno>
+#include <cfloat>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <random>
+#include <thread>
+#include <unordered_map>
+
+#if !defined(_WIN32)
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace DaisoML {
+
+// Tokens of one request on their way from the generation thread to the
+// connection that streams them.
+struct Server::Stream {
+    std::mutex mutex;
+    std::condition_variable ready;
+    int id = -1; // engine request id, set once the request is submitted
+    std::deque<int> tokens;
+    bool finished = false;
+    std::string error;
+
+    void open(int request) {
+        std::lock_guard<std::mutex> lock(mutex);
+        id = request;
+        ready.notify_all();
+    }
+    void push(int token, bool last) {
+        std::lock_guard<std::mutex> lock(mutex);
+        tokens.push_back(token);
+        finished = last;
+        ready.notify_all();
+    }
+    void close(const std::string& message = std::string()) {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished = true;
+        error = message;
+        ready.notify_all();
+    }
+};
+
+namespace {
+
+// Request bodies are flat JSON objects; values are kept as their text
+// (strings unescaped, numbers and literals verbatim).
+bool parse_json_object(const std::string& text, std::map<std::string, std::string>& fields) {
+    size_t i = 0;
+    auto skip_ws = [&] {
+        while (i < text.size() && (text[i] == ' ' || text[i] == '\t' || text[i] == '\n' || text[i] == '\r')) ++i;
+    };
+    auto parse_string = [&](std::string& out) {
+        if (i >= text.size() || text[i] != '"') return false;
+        ++i;
+        while (i < text.size() && text[i] != '"') {
+            char c = text[i++];
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (i >= text.size()) return false;
+            c = text[i++];
+            switch (c) {
+                case 'n': out += '\n'; break;
+                case 't': out += '\t'; break;
+                case 'r': out += '\r'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'u': {
+                    if (i + 4 > text.size()) return false;
+                    const unsigned long cp = std::strtoul(text.substr(i, 4).c_str(), nullptr, 16);
+                    i += 4;
+                    // Basic multilingual plane only, encoded as UTF-8
+                    if (cp < 0x80) {
+                        out += (char)cp;
+                    } else if (cp < 0x800) {
+                        out += (char)(0xC0 | (cp >> 6));
+                        out += (char)(0x80 | (cp & 0x3F));
+                    } else {
+                        out += (char)(0xE0 | (cp >> 12));
+                        out += (char)(0x80 | ((cp >> 6) & 0x3F));
+                        out += (char)(0x80 | (cp & 0x3F));
+                    }
+                    break;
+                }
+                default: out += c; break; // \" \\ \/
+            }
+        }
+        if (i >= text.size()) return false;
+        ++i;
+        return true;
+    };
+
+    skip_ws();
+    if (i >= text.size() || text[i] != '{') return false;
+    ++i;
+    skip_ws();
+    if (i < text.size() && text[i] == '}') return true;
+    while (i < text.size()) {
+        std::string key, value;
+        skip_ws();
+        if (!parse_string(key)) return false;
+        skip_ws();
+        if (i >= text.size() || text[i] != ':') return false;
+        ++i;
+        skip_ws();
+        if (i < text.size() && text[i] == '"') {
+            if (!parse_string(value)) return false;
+        } else {
+            const size_t start = i;
+            while (i < text.size() && text[i] != ',' && text[i] != '}' && text[i] != ' ' && text[i] != '\n' &&
+                   text[i] != '\r' && text[i] != '\t') {
+                if (text[i] == '{' || text[i] == '[') return false; // nested values are not supported
+                ++i;
+            }
+            value = text.substr(start, i - start);
+            if (value.empty()) return false;
+        }
+        fields[key] = value;
+        skip_ws();
+        if (i < text.size() && text[i] == ',') {
+            ++i;
+            continue;
+        }
+        if (i < text.size() && text[i] == '}') return true;
+        return false;
+    }
+    return false;
+}
+
+std::string json_escape(const std::string& s) {
+    std::string out;
+    out.reserve(s.size() + 2);
+    for (unsigned char c : s) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    char buf[8];
+                    std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    out += buf;
+                } else {
+                    out += (char)c;
+                }
+        }
+    }
+    return out;
+}
+
+// Reads a field as a number; returns `fallback` if it is absent and throws if
+// it is not a number in float range.
+double number_field(const std::map<std::string, std::string>& fields, const std::string& key, double fallback) {
+    auto it = fields.find(key);
+    if (it == fields.end() || it->second == "null") return fallback;
+    char* end = nullptr;
+    const double value = std::strtod(it->second.c_str(), &end);
+    if (end == it->second.c_str() || *end != '\0' || !(std::fabs(value) <= FLT_MAX)) {
+        throw DaisoException("Field '" + key + "' must be a number.");
+    }
+    return value;
+}
+
+// Reads a field as an integer in [min_value, max_value]; returns `fallback` if
+// it is absent and throws if it is anything else.
+double integer_field(const std::map<std::string, std::string>& fields, const std::string& key, double fallback,
+                     double min_value, double max_value) {
+    const double value = number_field(fields, key, fallback);
+    if (!(value >= min_value && value <= max_value) || value != std::floor(value)) {
+        throw DaisoException("Field '" + key + "' must be an integer between " + std::to_string((long long)min_value) +
+                             " and " + std::to_string((unsigned long long)max_value) + ".");
+    }
+    return value;
+}
+
+// Reads a field as true or false; returns `fallback` if it is absent and
+// throws if it is anything else.
+bool bool_field(const std::map<std::string, std::string>& fields, const std::string& key, bool fallback) {
+    auto it = fields.find(key);
+    if (it == fields.end() || it->second == "null") return fallback;
+    if (it->second != "true" && it->second != "false") {
+        throw DaisoException("Field '" + key + "' must be true or false.");
+    }
+    return it->second == "true";
+}
+
+#if !defined(_WIN32)
+
+bool send_all(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        const ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        sent += (size_t)n;
+    }
+    return true;
+}
+
+bool send_response(int fd, int status, const std::string& reason, const std::string& body) {
+    return send_all(fd, "HTTP/1.1 " + std::to_string(status) + " " + reason +
+                            "\r\nContent-Type: application/json\r\nContent-Length: " + std::to_string(body.size()) +
+                            "\r\nConnection: close\r\n\r\n" + body);
+}
+
+bool send_error(int fd, int status, const std::string& reason, const std::string& message) {
+    return send_response(fd, status, reason, "{\"error\":\"" + json_escape(message) + "\"}");
+}
+
+// True if the client has closed its end of the connection. Does not block.
+// A client sends nothing after its request, so a readable socket with no data
+// left means end of stream.
+bool peer_closed(int fd) {
+    pollfd p{};
+    p.fd = fd;
+    p.events = POLLIN;
+#ifdef POLLRDHUP
+    p.events |= POLLRDHUP;
+#endif
+    if (::poll(&p, 1, 0) <= 0) return false;
+    short hangup = POLLHUP | POLLERR;
+#ifdef POLLRDHUP
+    hangup |= POLLRDHUP;
+#endif
+    if (p.revents & hangup) return true;
+    char c;
+    return (p.revents & POLLIN) && ::recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) == 0;
+}
+
+#endif
+
+} // namespace
+
+Server::Server(Model& model, const ServerOptions& options) : model(model), options(options) {}
+
+Server::~Server() {
+    stop();
+}
+
+void Server::request_cancel(int id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    cancellations.push_back(id);
+    work.notify_one();
+}
+
+void Server::generation_loop() {
+    Engine engine(model);
+    std::unordered_map<int, std::shared_ptr<Stream>> streams; // by engine request id
+    std::vector<Submission> incoming;
+    std::vector<int> cancelled;
+    std::vector<TokenEvent> events;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            work.wait(lock, [&] {
+                return stopping || !submissions.empty() || !cancellations.empty() || engine.has_work();
+            });
+            if (stopping) {
+                incoming.swap(submissions);
+                break;
+            }
+            incoming.swap(submissions);
+            cancelled.swap(cancellations);
+        }
+
+        // The batch only changes here, between steps
+        for (Submission& s : incoming) {
+            try {
+                const int id = engine.submit(s.prompt, s.max_tokens, s.sampler);
+                streams[id] = s.stream;
+                s.stream->open(id);
+            } catch (const std::exception& e) {
+                s.stream->close(e.what());
+            }
+        }
+        incoming.clear();
+        for (int id : cancelled) {
+            engine.cancel(id);
+            auto it = streams.find(id);
+            if (it != streams.end()) {
+                it->second->close();
+                streams.erase(it);
+            }
+        }
+        cancelled.clear();
+        running_requests = (int)engine.running();
+        queued_requests = (int)engine.queued();
+        if (!engine.has_work()) continue;
+
+        events.clear();
+        try {
+            engine.step(events);
+        } catch (const std::exception& e) {
+            // The step may have stopped halfway; drop every request
+            log(LogLevel::Error, std::string("Generation step failed: ") + e.what());
+            for (auto& entry : streams) {
+                engine.cancel(entry.first);
+                entry.second->close(e.what());
+            }
+            streams.clear();
+            continue;
+        }
+        generated_tokens += events.size();
+        running_requests = (int)engine.running();
+        queued_requests = (int)engine.queued();
+        for (const TokenEvent& e : events) {
+            auto it = streams.find(e.request);
+            if (it == streams.end()) continue;
+            it->second->push(e.token, e.finished);
+            if (e.finished) streams.erase(it);
+        }
+    }
+
+    for (Submission& s : incoming) {
+        s.stream->close("Server is shutting down.");
+    }
+    for (auto& entry : streams) {
+        entry.second->close("Server is shutting down.");
+    }
+}
+
+#if defined(_WIN32)
+
+void Server::run() {
+    throw DaisoException("Server mode is not supported on this platform.");
+}
+
+void Server::stop() {
+    stopping = true;
+}
+
+void Server::handle_connection(int) {}
+void Server::handle_completion(int, const std::string&) {}
+void Server::handle_cancel(int, const std::string&) {}
+
+#else
+
+void Server::run() {
+    // Writes to closed connections must fail with EPIPE instead of killing
+    // the process
+    signal(SIGPIPE, SIG_IGN);
+
+    int fd;
+    if (!options.socket_path.empty()) {
+        sockaddr_un addr{};
+        if (options.socket_path.size() >= sizeof(addr.sun_path)) {
+            throw DaisoException("Socket path is too long: " + options.socket_path);
+        }
+        addr.sun_family = AF_UNIX;
+        std::strcpy(addr.sun_path, options.socket_path.c_str());
+        fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) throw DaisoException("Could not create socket.");
+        ::unlink(options.socket_path.c_str()); // stale socket from an earlier run
+        if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+            ::close(fd);
+            throw DaisoException("Could not bind " + options.socket_path + ": " + std::strerror(errno));
+        }
+    } else {
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((uint16_t)options.port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) throw DaisoException("Could not create socket.");
+        const int one = 1;
+        ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+            ::close(fd);
+            throw DaisoException("Could not bind 127.0.0.1:" + std::to_string(options.port) + ": " +
+                                 std::strerror(errno));
+        }
+    }
+    if (::listen(fd, 64) < 0) {
+        ::close(fd);
+        throw DaisoException(std::string("listen failed: ") + std::strerror(errno));
+    }
+    listen_fd = fd;
+    log(options.socket_path.empty() ? "Listening on http://127.0.0.1:" + std::to_string(options.port)
+                                    : "Listening on unix:" + options.socket_path);
+
+    std::thread generator(&Server::generation_loop, this);
+    while (!stopping) {
+        const int client = ::accept(fd, nullptr, nullptr);
+        if (client < 0) {
+            if (stopping) break;
+            if (errno != EINTR) log(LogLevel::Warn, std::string("accept failed: ") + std::strerror(errno));
+            continue;
+        }
+        // A client that stalls mid-request must not hold its thread forever
+        timeval timeout{30, 0};
+        ::setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            connections++;
+        }
+        std::thread([this, client] {
+            try {
+                handle_connection(client);
+            } catch (const std::exception& e) {
+                log(LogLevel::Warn, std::string("Connection failed: ") + e.what());
+            }
+            ::close(client);
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--connections == 0) idle.notify_all();
+        }).detach();
+    }
+
+    // Shut down: the generation thread closes every open stream, which lets
+    // the connection threads finish.
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        work.notify_all();
+    }
+    generator.join();
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [&] { return connections == 0; });
+    }
+    ::close(fd);
+    listen_fd = -1;
+    if (!options.socket_path.empty()) ::unlink(options.socket_path.c_str());
+    log("Server stopped.");
+}
+
+void Server::stop() {
+    stopping = true;
+    const int fd = listen_fd;
+    if (fd >= 0) ::shutdown(fd, SHUT_RDWR); // wakes accept()
+}
+
+void Server::handle_connection(int fd) {
+    // Read the request head, then as much body as Content-Length announces
+    const size_t max_head = 64 * 1024;
+    const size_t max_body = 1 << 20;
+    std::string data;
+    size_t head_end;
+    char buf[4096];
+    while ((head_end = data.find("\r\n\r\n")) == std::string::npos) {
+        if (data.size() > max_head) {
+            send_error(fd, 431, "Request Header Fields Too Large", "Request head too large.");
+            return;
+        }
+        const ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        data.append(buf, (size_t)n);
+    }
+    const std::string head = data.substr(0, head_end);
+    std::string body = data.substr(head_end + 4);
+
+    const size_t line_end = head.find("\r\n");
+    const std::string request_line = head.substr(0, line_end);
+    const size_t sp1 = request_line.find(' ');
+    const size_t sp2 = request_line.find(' ', sp1 + 1);
+    if (sp1 == std::string::npos || sp2 == std::string::npos) {
+        send_error(fd, 400, "Bad Request", "Malformed request line.");
+        return;
+    }
+    const std::string method = request_line.substr(0, sp1);
+    const std::string path = request_line.substr(sp1 + 1, sp2 - sp1 - 1);
+
+    size_t content_length = 0;
+    size_t pos = line_end;
+    while (pos != std::string::npos && pos < head.size()) {
+        const size_t next = head.find("\r\n", pos + 2);
+        const std::string line = head.substr(pos + 2, next == std::string::npos ? std::string::npos : next - pos - 2);
+        const size_t colon = line.find(':');
+        if (colon != std::string::npos) {
+            std::string name = line.substr(0, colon);
+            for (char& c : name) c = (char)std::tolower((unsigned char)c);
+            if (name == "content-length") {
+                // Digits only, between optional spaces; anything else is an error
+                const size_t begin = line.find_first_not_of(" \t", colon + 1);
+                const size_t end = line.find_last_not_of(" \t");
+                const std::string value = begin == std::string::npos ? "" : line.substr(begin, end - begin + 1);
+                if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos) {
+                    send_error(fd, 400, "Bad Request", "Malformed Content-Length.");
+                    return;
+                }
+                // Longer values are over the body limit anyway
+                content_length = value.size() > 9 ? SIZE_MAX : std::strtoul(value.c_str(), nullptr, 10);
+            }
+        }
+        pos = next;
+    }
+    if (content_length > max_body) {
+        send_error(fd, 413, "Payload Too Large", "Request body too large.");
+        return;
+    }
+    while (body.size() < content_length) {
+        const ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        body.append(buf, (size_t)n);
+    }
+    body.resize(content_length);
+
+    if (method == "GET" && path == "/health") {
+        send_response(fd, 200, "OK", "{\"status\":\"ok\",\"running\":" + std::to_string(running_requests.load()) +
+                                         ",\"queued\":" + std::to_string(queued_requests.load()) +
+                                         ",\"generated_tokens\":" + std::to_string(generated_tokens.load()) + "}");
+    } else if (method == "POST" && path == "/v1/completions") {
+        handle_completion(fd, body);
+    } else if (method == "POST" && path == "/v1/cancel") {
+        handle_cancel(fd, body);
+    } else {
+        send_error(fd, 404, "Not Found", "No route for " + method + " " + path + ".");
+    }
+}
+
+void Server::handle_completion(int fd, const std::string& body) {
+    std::map<std::string, std::string> fields;
+    if (!parse_json_object(body, fields)) {
+        send_error(fd, 400, "Bad Request", "Body must be a flat JSON object.");
+        return;
+    }
+    auto prompt = fields.find("prompt");
+    if (prompt == fields.end()) {
+        send_error(fd, 400, "Bad Request", "Missing 'prompt'.");
+        return;
+    }
+
+    auto stream = std::make_shared<Stream>();
+    bool stream_tokens = true;
+    try {
+        stream_tokens = bool_field(fields, "stream", true);
+        const int max_tokens = (int)integer_field(fields, "max_tokens", options.default_max_tokens, 1, INT_MAX);
+        SamplerOptions sampling;
+        sampling.temperature = (float)number_field(fields, "temperature", sampling.temperature);
+        sampling.top_k = (int)integer_field(fields, "top_k", sampling.top_k, 0, INT_MAX);
+        sampling.top_p = (float)number_field(fields, "top_p", sampling.top_p);
+        sampling.min_p = (float)number_field(fields, "min_p", sampling.min_p);
+        sampling.repetition_penalty = (float)number_field(fields, "repetition_penalty", sampling.repetition_penalty);
+        sampling.frequency_penalty = (float)number_field(fields, "frequency_penalty", sampling.frequency_penalty);
+        sampling.presence_penalty = (float)number_field(fields, "presence_penalty", sampling.presence_penalty);
+        // Requests without a seed get a fresh one, so repeats differ
+        sampling.seed = fields.count("seed") ? (uint64_t)integer_field(fields, "seed", 0, 0, 0x1p64 - 0x1p11)
+                                             : ((uint64_t)std::random_device()() << 32) | std::random_device()();
+        Submission submission{model.getTokenizer().encode(prompt->second), max_tokens,
+                              Sampler(model.getConfig().vocab_size, sampling), stream};
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping) throw DaisoException("Server is shutting down.");
+        submissions.push_back(std::move(submission));
+        work.notify_one();
+    } catch (const std::exception& e) {
+        send_error(fd, 400, "Bad Request", e.what());
+        return;
+    }
+
+    // Wait until the generation thread has accepted or rejected the request
+    int id;
+    {
+        std::unique_lock<std::mutex> lock(stream->mutex);
+        stream->ready.wait(lock, [&] { return stream->id >= 0 || stream->finished; });
+        if (stream->id < 0) {
+            send_error(fd, 400, "Bad Request", stream->error);
+            return;
+        }
+        id = stream->id;
+    }
+
+    const Tokenizer& tokenizer = model.getTokenizer();
+    TokenStreamDecoder decoder(tokenizer);
+    if (stream_tokens &&
+        !send_all(fd, "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\n"
+                      "Connection: close\r\n\r\n")) {
+        request_cancel(id);
+        return;
+    }
+
+    std::vector<int> tokens;
+    std::vector<int> output;
+    std::string error;
+    bool finished = false;
+    while (!finished) {
+        {
+            // Wake up now and then even without tokens (e.g. while queued) to
+            // notice a client that went away
+            std::unique_lock<std::mutex> lock(stream->mutex);
+            stream->ready.wait_for(lock, std::chrono::milliseconds(100),
+                                   [&] { return !stream->tokens.empty() || stream->finished; });
+            tokens.assign(stream->tokens.begin(), stream->tokens.end());
+            stream->tokens.clear();
+            finished = stream->finished;
+            error = stream->error;
+        }
+        if (!finished && peer_closed(fd)) {
+            // Checked between tokens, so a non-streaming request is dropped
+            // too, not only when a send fails
+            request_cancel(id);
+            return;
+        }
+        if (!stream_tokens) {
+            output.insert(output.end(), tokens.begin(), tokens.end());
+            continue;
+        }
+        std::string chunk;
+        for (size_t i = 0; i < tokens.size(); ++i) {
+            // Text is cut at UTF-8 character boundaries; the last token takes the rest
+            std::string text = decoder.push(tokens[i]);
+            if (finished && i + 1 == tokens.size()) text += decoder.flush();
+            chunk += "data: {\"id\":" + std::to_string(id) + ",\"token\":" + std::to_string(tokens[i]) +
+                     ",\"text\":\"" + json_escape(text) + "\"}\n\n";
+        }
+        if (!chunk.empty() && !send_all(fd, chunk)) {
+            // The client went away; stop generating for it
+            request_cancel(id);
+            return;
+        }
+    }
+
+    if (stream_tokens) {
+        send_all(fd, error.empty() ? "data: [DONE]\n\n" : "data: {\"error\":\"" + json_escape(error) + "\"}\n\n");
+        return;
+    }
+    if (!error.empty()) {
+        send_error(fd, 500, "Internal Server Error", error);
+        return;
+    }
+    std::string list;
+    for (size_t i = 0; i < output.size(); ++i) {
+        if (i) list += ",";
+        list += std::to_string(output[i]);
+    }
+    send_response(fd, 200, "OK", "{\"id\":" + std::to_string(id) + ",\"tokens\":[" + list + "],\"text\":\"" +
+                                     json_escape(tokenizer.decode(output)) + "\"}");
+}
+
+void Server::handle_cancel(int fd, const std::string& body) {
+    std::map<std::string, std::string> fields;
+    if (!parse_json_object(body, fields) || fields.count("id") == 0) {
+        send_error(fd, 400, "Bad Request", "Expected {\"id\": <request id>}.");
+        return;
+    }
+    try {
+        request_cancel((int)integer_field(fields, "id", -1, 0, INT_MAX));
+    } catch (const std::exception& e) {
+        send_error(fd, 400, "Bad Request", e.what());
+        return;
+    }
+    send_response(fd, 200, "OK", "{\"cancelled\":true}");
+}
+
+#endif
+
+} // namespace DaisoML
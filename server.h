@@ -0,0 +1,98 @@
+#ifndef DAISOML_SERVER_H
+#define DAISOML_SERVER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "model.h"
+#include "sampler.h"
+
+namespace DaisoML {
+
+struct ServerOptions {
+    // Unix domain socket to listen on; when empty, 127.0.0.1:port is used.
+    std::string socket_path;
+    int port = 8080;
+    // Used when a request does not set max_tokens
+    int default_max_tokens = 128;
+};
+
+// Local inference server over HTTP/1.1.
+//
+// The model is loaded once by the caller; the server only schedules requests
+// onto it. Every connection runs on its own thread, which parses the request
+// and puts it on a queue. A single generation thread owns an Engine: it moves
+// queued requests and cancellations into it between steps, steps it, and
+// hands each produced token back to its connection, which streams it to the
+// client as a server-sent event. A client that disconnects before its request
+// finishes, streaming or not, has its request cancelled: connections check
+// for a hang-up between tokens.
+//
+//   POST /v1/completions  {"prompt": "...", "max_tokens": 64, "stream": true,
+//                          "temperature": 0.8, "top_k": 40, "top_p": 0.9, "min_p": 0,
+//                          "repetition_penalty": 1, "frequency_penalty": 0,
+//                          "presence_penalty": 0, "seed": 1}
+//       Streams  data: {"id":0,"token":42,"text":"*"}  per token, then
+//       data: [DONE]. With "stream": false the reply is one JSON object.
+//   POST /v1/cancel       {"id": 0}
+//   GET  /health          {"status":"ok","running":1,"queued":0,"generated_tokens":42}
+class Server {
+public:
+    Server(Model& model, const ServerOptions& options = ServerOptions());
+    ~Server();
+
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+
+    // Binds the socket and serves until stop() is called. Throws if the
+    // socket cannot be set up.
+    void run();
+    // Makes run() return after open requests are closed. Only touches an
+    // atomic flag and the listening socket, so it may be called from a
+    // signal handler.
+    void stop();
+
+private:
+    struct Stream;
+    struct Submission {
+        std::vector<int> prompt;
+        int max_tokens;
+        Sampler sampler;
+        std::shared_ptr<Stream> stream;
+    };
+
+    void generation_loop();
+    void handle_connection(int fd);
+    void handle_completion(int fd, const std::string& body);
+    void handle_cancel(int fd, const std::string& body);
+    // Queues a cancellation for the generation thread.
+    void request_cancel(int id);
+
+    Model& model;
+    ServerOptions options;
+    std::atomic<bool> stopping{false};
+    std::atomic<int> listen_fd{-1};
+
+    // Engine state for /health, published by the generation thread
+    std::atomic<int> running_requests{0};
+    std::atomic<int> queued_requests{0};
+    std::atomic<uint64_t> generated_tokens{0};
+
+    // Shared with the generation thread
+    std::mutex mutex;
+    std::condition_variable work;
+    std::vector<Submission> submissions;
+    std::vector<int> cancellations;
+
+    // Connection threads still running; run() waits for them to drain.
+    std::condition_variable idle;
+    int connections = 0;
+};
+
+} // namespace DaisoML
+
+#endif //DAISOML_SERVER_H
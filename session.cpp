@@ -0,0 +1,177 @@
+#include "session.h"
+#include "mapped_file.h"
+#include "utils.h"
+#include <cstring>
+#include <fstream>
+
+namespace DaisoML {
+
+namespace {
+
+uint64_t align_up(uint64_t offset) {
+    return (offset + DAISO_ALIGNMENT - 1) / DAISO_ALIGNMENT * DAISO_ALIGNMENT;
+}
+
+// Placement of one (layer, keys/values) section's rows and scales
+struct SectionLayout {
+    size_t row_bytes;     // one head's row in the file
+    size_t scales_offset; // Q8 scales, after the rows
+    size_t size;          // padded section size
+};
+
+SectionLayout section_layout(KVType type, size_t n_tokens, int n_heads, int head_dim) {
+    SectionLayout s;
+    s.row_bytes = (size_t)head_dim * kv_element_bytes(type);
+    s.scales_offset = align_up(n_tokens * n_heads * s.row_bytes);
+    const size_t scales_bytes = type == KVType::Q8 ? n_tokens * n_heads * sizeof(float) : 0;
+    s.size = align_up(s.scales_offset + scales_bytes);
+    return s;
+}
+
+bool same_model(const DaisoModelHeader& a, const DaisoModelHeader& b) {
+    return a.dim == b.dim && a.hidden_dim == b.hidden_dim && a.n_layers == b.n_layers && a.n_heads == b.n_heads &&
+           a.n_kv_heads == b.n_kv_heads && a.vocab_size == b.vocab_size && a.seq_len == b.seq_len;
+}
+
+} // namespace
+
+void write_session(const std::string& path, const DaisoModelHeader& model, const KVCache& cache, int seq,
+                   const std::vector<int>& tokens, KVType type) {
+    const size_t n = tokens.size();
+    if (n > (size_t)cache.length(seq)) {
+        throw DaisoException("Session has more tokens than the sequence has cached.");
+    }
+    const int n_heads = cache.n_kv_heads();
+    const int head_dim = cache.head_dim();
+    const int block_size = cache.block_size();
+    const KVType cache_type = cache.type();
+    const SectionLayout layout = section_layout(type, n, n_heads, head_dim);
+
+    DaisoSessionHeader h;
+    std::memset(&h, 0, sizeof(h));
+    h.magic = DAISO_SESSION_MAGIC;
+    h.version = DAISO_SESSION_VERSION;
+    h.kv_type = static_cast<uint32_t>(type);
+    h.n_tokens = (uint32_t)n;
+    h.data_offset = align_up(sizeof(h) + n * sizeof(int32_t));
+    h.section_size = layout.size;
+    h.model = model;
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        throw DaisoException("Cannot open session file for writing: " + path);
+    }
+    std::vector<int32_t> ids(tokens.begin(), tokens.end());
+    file.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    file.write(reinterpret_cast<const char*>(ids.data()), (std::streamsize)(ids.size() * sizeof(int32_t)));
+    const std::vector<char> zeros(DAISO_ALIGNMENT, 0);
+    file.write(zeros.data(), (std::streamsize)(h.data_offset - sizeof(h) - n * sizeof(int32_t)));
+
+    const std::vector<int>& blocks = cache.block_table(seq);
+    std::vector<uint8_t> section(layout.size);
+    std::vector<float> row(head_dim);
+    for (int layer = 0; layer < model.n_layers; ++layer) {
+        for (int kind = 0; kind < 2; ++kind) {
+            std::fill(section.begin(), section.end(), 0);
+            float* scales = reinterpret_cast<float*>(section.data() + layout.scales_offset);
+            for (size_t pos = 0; pos < n; ++pos) {
+                const int block = blocks[pos / block_size];
+                const size_t r = pos % block_size;
+                for (int head = 0; head < n_heads; ++head) {
+                    const uint8_t* src = (kind == 0 ? cache.keys(block, layer, head) : cache.values(block, layer, head)) +
+                                         r * cache.position_stride();
+                    float scale = 0.0f;
+                    if (cache_type == KVType::Q8) {
+                        scale = (kind == 0 ? cache.key_scales(block, layer, head)
+                                           : cache.value_scales(block, layer, head))[r * cache.scale_stride()];
+                    }
+                    const size_t index = pos * n_heads + head;
+                    uint8_t* dst = section.data() + index * layout.row_bytes;
+                    if (type == cache_type) {
+                        std::memcpy(dst, src, layout.row_bytes);
+                        if (type == KVType::Q8) scales[index] = scale;
+                    } else {
+                        kv_decode_row(cache_type, src, scale, head_dim, row.data());
+                        kv_encode_row(type, row.data(), head_dim, dst, type == KVType::Q8 ? &scales[index] : nullptr);
+                    }
+                }
+            }
+            file.write(reinterpret_cast<const char*>(section.data()), (std::streamsize)section.size());
+        }
+    }
+    if (!file) {
+        throw DaisoException("Failed to write session file: " + path);
+    }
+}
+
+std::vector<int> read_session(const std::string& path, const DaisoModelHeader& model, KVCache& cache, int seq) {
+    MappedFile file(path);
+    DaisoSessionHeader h;
+    if (file.size() < sizeof(h)) {
+        throw DaisoException("Invalid session file: too small.");
+    }
+    std::memcpy(&h, file.data(), sizeof(h));
+    if (h.magic != DAISO_SESSION_MAGIC) throw DaisoException("Invalid session file: magic number mismatch.");
+    if (h.version != DAISO_SESSION_VERSION) {
+        throw DaisoException("Unsupported session file version: " + std::to_string(h.version));
+    }
+    if (!same_model(h.model, model)) {
+        throw DaisoException("Session file was written for a different model configuration.");
+    }
+    if (h.kv_type > static_cast<uint32_t>(KVType::Q8) || h.n_tokens > (uint32_t)model.seq_len) {
+        throw DaisoException("Invalid session file: bad header.");
+    }
+    const KVType type = static_cast<KVType>(h.kv_type);
+    const size_t n = h.n_tokens;
+    const int n_heads = cache.n_kv_heads();
+    const int head_dim = cache.head_dim();
+    const SectionLayout layout = section_layout(type, n, n_heads, head_dim);
+    // Written so that a corrupt data_offset cannot overflow the bound
+    const uint64_t data_size = 2 * (uint64_t)model.n_layers * h.section_size;
+    if (h.section_size != layout.size || h.data_offset < sizeof(h) + n * sizeof(int32_t) ||
+        data_size > file.size() || h.data_offset > file.size() - data_size) {
+        throw DaisoException("Invalid session file: truncated or inconsistent sections.");
+    }
+    if (cache.length(seq) != 0) {
+        throw DaisoException("A session can only be restored into an empty sequence.");
+    }
+
+    std::vector<int> tokens(n);
+    std::memcpy(tokens.data(), file.data() + sizeof(h), n * sizeof(int32_t));
+    cache.resize(seq, (int)n);
+    try {
+        const size_t kv_dim = (size_t)n_heads * head_dim;
+        std::vector<float> k(kv_dim), v(kv_dim);
+        for (int layer = 0; layer < model.n_layers; ++layer) {
+            const uint8_t* keys = file.data() + h.data_offset + (2 * (size_t)layer) * h.section_size;
+            const uint8_t* values = keys + h.section_size;
+            const float* key_scales = reinterpret_cast<const float*>(keys + layout.scales_offset);
+            const float* value_scales = reinterpret_cast<const float*>(values + layout.scales_offset);
+            for (size_t pos = 0; pos < n; ++pos) {
+                const size_t first = pos * n_heads; // index of the position's first head row
+                if (type == cache.type()) {
+                    const bool q8 = type == KVType::Q8;
+                    cache.store_encoded(seq, layer, (int)pos, keys + first * layout.row_bytes,
+                                        values + first * layout.row_bytes, q8 ? key_scales + first : nullptr,
+                                        q8 ? value_scales + first : nullptr);
+                    continue;
+                }
+                for (int head = 0; head < n_heads; ++head) {
+                    const size_t index = first + head;
+                    const bool q8 = type == KVType::Q8;
+                    kv_decode_row(type, keys + index * layout.row_bytes, q8 ? key_scales[index] : 0.0f, head_dim,
+                                  k.data() + (size_t)head * head_dim);
+                    kv_decode_row(type, values + index * layout.row_bytes, q8 ? value_scales[index] : 0.0f,
+                                  head_dim, v.data() + (size_t)head * head_dim);
+                }
+                cache.store(seq, layer, (int)pos, k.data(), v.data());
+            }
+        }
+    } catch (...) {
+        cache.resize(seq, 0);
+        throw;
+    }
+    return tokens;
+}
+
+} // namespace DaisoML
@@ -0,0 +1,31 @@
+#ifndef DAISOML_SESSION_H
+#define DAISOML_SESSION_H
+
+#include <string>
+#include <vector>
+#include "file_format.h"
+#include "kv_cache.h"
+
+namespace DaisoML {
+
+// Session snapshots: the cached keys and values of one sequence, with the
+// tokens they belong to, parked in a file (layout in file_format.h) so a
+// conversation can be resumed later without prefilling it again.
+//
+// Rows are stored without the cache's block structure or padding, in `type`:
+// the cache's own type copies them as they are, while a smaller one (f16 or
+// q8 from an f32 cache) shrinks the file at the cost of rounding. Restoring
+// maps the file and copies the rows into the cache, converting only if the
+// types differ. Model::save_session() and Model::load_session() wrap these.
+
+// Writes positions 0 .. tokens.size() - 1 of `seq`.
+void write_session(const std::string& path, const DaisoModelHeader& model, const KVCache& cache, int seq,
+                   const std::vector<int>& tokens, KVType type);
+
+// Fills the empty sequence `seq` from a session file and returns its tokens.
+// Throws if the file was written for a different model configuration.
+std::vector<int> read_session(const std::string& path, const DaisoModelHeader& model, KVCache& cache, int seq);
+
+} // namespace DaisoML
+
+#endif //DAISOML_SESSION_H
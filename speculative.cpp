@@ -0,0 +1,261 @@
+#include "speculative.h"
+#include "model.h"
+#include "utils.h"
+#include <algorithm>
+
+namespace DaisoML {
+
+namespace {
+// Multiplier of the polynomial n-gram hash (odd, so powers never vanish)
+constexpr uint64_t kHashBase = 0x100000001B3ull;
+} // namespace
+
+NGramIndex::NGramIndex(int min_n, int max_n)
+    : min_n(min_n), max_n(max_n), hashes(max_n + 1, 0), index(max_n + 1) {
+    if (min_n < 1 || max_n < min_n) {
+        throw DaisoException("Invalid n-gram range for prompt lookup.");
+    }
+}
+
+void NGramIndex::clear() {
+    history.clear();
+    std::fill(hashes.begin(), hashes.end(), 0);
+    for (auto& map : index) {
+        map.clear();
+    }
+}
+
+void NGramIndex::append(int token) {
+    const size_t len = history.size();
+    for (int n = min_n; n <= max_n && (size_t)n <= len; ++n) {
+        // The n-gram ending at the previous token now has a successor
+        index[n][hashes[n]] = (uint32_t)len;
+    }
+    uint64_t power = 1; // kHashBase^(n - 1)
+    for (int n = 1; n <= max_n; ++n, power *= kHashBase) {
+        // Roll the window: drop the token that falls out, shift in the new one
+        uint64_t h = hashes[n];
+        if (len >= (size_t)n) h -= (uint64_t)(uint32_t)history[len - n] * power;
+        hashes[n] = h * kHashBase + (uint64_t)(uint32_t)token;
+    }
+    history.push_back(token);
+}
+
+int NGramIndex::propose(int k, std::vector<int>& out) const {
+    const size_t len = history.size();
+    for (int n = std::min<int>(max_n, (int)len); n >= min_n && k > 0; --n) {
+        const auto it = index[n].find(hashes[n]);
+        if (it == index[n].end()) continue;
+        const size_t next = it->second;
+        if (!std::equal(history.end() - n, history.end(), history.begin() + (next - n))) continue;
+        // Copy what followed the match. A copy that reaches the end of the
+        // history continues with its own output, so a repeating pattern
+        // yields full proposals.
+        const size_t start = out.size();
+        for (size_t j = next; j < next + (size_t)k; ++j) {
+            out.push_back(j < len ? history[j] : out[start + (j - len)]);
+        }
+        return k;
+    }
+    return 0;
+}
+
+double SpeculativeStats::acceptance_rate() const {
+    return drafted > 0 ? (double)accepted / (double)drafted : 0.0;
+}
+
+double SpeculativeStats::tokens_per_round() const {
+    return rounds > 0 ? (double)generated / (double)rounds : 0.0;
+}
+
+SpeculativeDecoder::SpeculativeDecoder(Model& target, Model& draft, int n_draft)
+    : target(target), draft(&draft), lookup(1, 1), n_draft(n_draft), vocab(target.getConfig().vocab_size),
+      max_positions(std::min(target.getConfig().seq_len, draft.getConfig().seq_len)) {
+    if (draft.getConfig().vocab_size != target.getConfig().vocab_size) {
+        throw DaisoException("Draft and target models must have the same vocabulary size.");
+    }
+    if (n_draft < 1) {
+        throw DaisoException("Speculative decoding needs at least one draft token per round.");
+    }
+    draft_probs.resize((size_t)n_draft * vocab);
+    target_probs.resize(vocab);
+    pending.reserve(n_draft + 1);
+}
+
+SpeculativeDecoder::SpeculativeDecoder(Model& target, int n_draft, int max_ngram)
+    : target(target), draft(nullptr), lookup(1, max_ngram), n_draft(n_draft),
+      vocab(target.getConfig().vocab_size), max_positions(target.getConfig().seq_len) {
+    if (n_draft < 1) {
+        throw DaisoException("Speculative decoding needs at least one draft token per round.");
+    }
+    target_probs.resize(vocab);
+    pending.reserve(n_draft + 1);
+}
+
+const SpeculativeStats& SpeculativeDecoder::stats() const {
+    return counters;
+}
+
+int SpeculativeDecoder::draw(const float* probs, float sum) {
+    const float r = std::uniform_real_distribution<float>(0.0f, sum)(rng);
+    float cumulative = 0.0f;
+    int last = 0;
+    for (size_t i = 0; i < vocab; ++i) {
+        if (probs[i] <= 0.0f) continue;
+        cumulative += probs[i];
+        last = (int)i;
+        if (r < cumulative) return last;
+    }
+    return last; // guards against rounding at the top end
+}
+
+int SpeculativeDecoder::draft_tokens(std::vector<int>& tokens, int k, const Sampler& sampler, int draft_seq,
+                                     int& draft_length) {
+    // The draft first catches up on the tokens it has not seen (normally
+    // just the last one), then runs one token at a time
+    const int n = (int)tokens.size();
+    Sampler draft_sampler = sampler;
+    pending.assign(tokens.begin() + draft_length, tokens.end());
+    const float* logits = draft->prefill(pending, draft_length, draft_seq)->data();
+    for (int i = 0; i < k; ++i) {
+        float* q = draft_probs.data() + (size_t)i * vocab;
+        draft_sampler.probabilities(logits, q);
+        const int token = draw(q, 1.0f);
+        draft_sampler.accept(token);
+        tokens.push_back(token);
+        if (i + 1 < k) logits = draft->forward(token, n + i, draft_seq)->data();
+    }
+    draft_length = n + k - 1;
+    return k;
+}
+
+std::vector<int> SpeculativeDecoder::generate(const std::vector<int>& prompt, int steps,
+                                              const SamplerOptions& sampling) {
+    log("Starting speculative generation...");
+    if (steps <= 0) return prompt;
+    // Like Model::generate, an empty prompt starts from token 0. That token
+    // stays in `tokens`, so positions and lookups count it, and is dropped
+    // from the result.
+    std::vector<int> tokens = prompt.empty() ? std::vector<int>{0} : prompt;
+    const std::vector<int> context = tokens;
+    if (context.size() >= (size_t)max_positions) {
+        throw DaisoException("Prompt exceeds the maximum sequence length.");
+    }
+    rng.seed(sampling.seed ^ 0x9E3779B97F4A7C15ull);
+
+    Sampler sampler(vocab, sampling);
+    for (int token : prompt) {
+        sampler.accept(token);
+    }
+    // Sequences are freed however generation ends, errors included
+    struct Release {
+        Model* model;
+        int seq;
+        ~Release() {
+            if (model) model->free_sequence(seq);
+        }
+    };
+    const int target_seq = target.create_sequence();
+    const Release release_target{&target, target_seq};
+    const int draft_seq = draft ? draft->create_sequence() : -1;
+    const Release release_draft{draft, draft_seq};
+
+    // The prompt goes through the models; the target's logits give the first
+    // token. From then on, the last token is fed at the start of each round.
+    tokens.push_back(sampler.sample(*target.prefill_prompt(context, target_seq)));
+    int draft_length = 0; // positions the draft model has cached
+    if (draft) {
+        draft->prefill_prompt(context, draft_seq);
+        draft_length = (int)context.size();
+    } else {
+        lookup.clear();
+        for (int token : tokens) {
+            lookup.append(token);
+        }
+    }
+    int generated = 1;
+    counters.generated++;
+
+    while (generated < steps) {
+        const int n = (int)tokens.size();
+        const int pos = n - 1; // position of the last token, not yet fed
+        if (pos >= max_positions) {
+            log("Reached max sequence length.");
+            break;
+        }
+        // A round yields at most k + 1 tokens and feeds positions pos .. pos + k
+        int k = std::min({n_draft, steps - generated - 1, max_positions - 1 - pos});
+
+        // 1. Propose up to k tokens; lookup may find fewer
+        if (k > 0) {
+            k = draft ? draft_tokens(tokens, k, sampler, draft_seq, draft_length) : lookup.propose(k, tokens);
+        }
+
+        // 2. Score the last token and all proposals in one target pass
+        pending.assign(tokens.begin() + pos, tokens.end());
+        tokens.resize(n);
+        const float* logits = target.prefill(pending, pos, target_seq, Logits::All)->data();
+
+        // 3. Accept proposals in order; the first rejection ends the round.
+        // A looked-up proposal has q = 1 for its token and 0 elsewhere.
+        int accepted = 0;
+        int next = -1;
+        for (int i = 0; i < k && next < 0; ++i) {
+            const int token = pending[i + 1];
+            const float* q = draft ? draft_probs.data() + (size_t)i * vocab : nullptr;
+            float* p = target_probs.data();
+            sampler.probabilities(logits + (size_t)i * vocab, p);
+            const float u = std::uniform_real_distribution<float>(0.0f, 1.0f)(rng);
+            if (u * (q ? q[token] : 1.0f) < p[token]) {
+                sampler.accept(token);
+                tokens.push_back(token);
+                accepted++;
+                continue;
+            }
+            // Resample from the part of p the drafter under-proposed
+            if (!q) p[token] = 0.0f;
+            float sum = 0.0f;
+            for (size_t j = 0; j < vocab; ++j) {
+                if (q) p[j] = std::max(p[j] - q[j], 0.0f);
+                sum += p[j];
+            }
+            if (sum <= 0.0f) {
+                // p and q agree up to rounding; p itself is the right draw
+                sampler.probabilities(logits + (size_t)i * vocab, p);
+                sum = 1.0f;
+            }
+            next = draw(p, sum);
+        }
+        if (next < 0) {
+            // Every proposal was kept: one more token from the last position
+            sampler.probabilities(logits + (size_t)k * vocab, target_probs.data());
+            next = draw(target_probs.data(), 1.0f);
+        }
+        sampler.accept(next);
+        tokens.push_back(next);
+
+        // 4. Drop the cache positions of rejected proposals
+        target.truncate_sequence(target_seq, n + accepted);
+        if (draft) {
+            draft_length = std::min(draft_length, n + accepted);
+            draft->truncate_sequence(draft_seq, draft_length);
+        } else {
+            for (int i = n; i < (int)tokens.size(); ++i) {
+                lookup.append(tokens[i]);
+            }
+        }
+
+        generated += accepted + 1;
+        counters.rounds++;
+        counters.drafted += k;
+        counters.accepted += accepted;
+        counters.generated += accepted + 1;
+    }
+
+    log("Generation finished: " + std::to_string(counters.accepted) + " of " + std::to_string(counters.drafted) +
+        " drafted tokens accepted so far.");
+    if (prompt.empty()) tokens.erase(tokens.begin());
+    return tokens;
+}
+
+} // namespace DaisoML
@@ -0,0 +1,109 @@
+#ifndef DAISOML_SPECULATIVE_H
+#define DAISOML_SPECULATIVE_H
+
+#include <cstdint>
+#include <random>
+#include <unordered_map>
+#include <vector>
+#include "sampler.h"
+
+namespace DaisoML {
+
+class Model;
+
+// Rolling-hash index of the n-grams of a token history, for drafting by
+// lookup. For each n in [min_n, max_n] it maps every n-gram to the position
+// right after its latest occurrence. Hashes are updated in O(1) per n as
+// tokens are appended; matches are confirmed against the tokens, so hash
+// collisions only cost a missed lookup.
+class NGramIndex {
+public:
+    NGramIndex(int min_n, int max_n);
+
+    void clear();
+    void append(int token);
+
+    // Finds the latest earlier occurrence of the longest suffix of the
+    // history (max_n tokens down to min_n) and appends the k tokens that
+    // followed it to `out`. Returns how many were appended (0 or k).
+    int propose(int k, std::vector<int>& out) const;
+
+private:
+    int min_n;
+    int max_n;
+    std::vector<int> history;
+    std::vector<uint64_t> hashes; // per n: hash of the last n tokens
+    std::vector<std::unordered_map<uint64_t, uint32_t>> index; // per n
+};
+
+// Counters of a SpeculativeDecoder, summed over its generate() calls.
+struct SpeculativeStats {
+    uint64_t rounds = 0;    // verification passes of the target model
+    uint64_t drafted = 0;   // tokens proposed
+    uint64_t accepted = 0;  // proposals the target kept
+    uint64_t generated = 0; // tokens produced, including the first one
+
+    // Share of proposals accepted
+    double acceptance_rate() const;
+    // Tokens produced per verification pass
+    double tokens_per_round() const;
+};
+
+// Speculative decoding.
+//
+// Each round proposes up to n_draft tokens, and the target model scores all
+// of them in a single multi-position pass, so the target's weights are
+// streamed once for several tokens. Proposals come either from a small
+// draft model, one token at a time, or from prompt lookup: continuing the
+// latest earlier occurrence of the text's last few tokens in the prompt and
+// the output so far, which costs no forward passes and pays off when the
+// output copies spans of the prompt.
+//
+// Proposal i is kept with probability min(1, p(x) / q(x)), p and q being the
+// target's and the drafter's distributions (q is one-hot for lookup); the
+// first rejected one is replaced by a draw from max(0, p - q), and if all
+// are kept a bonus token is drawn from the target's next distribution. The
+// output follows the same distribution as sampling the target alone (for
+// greedy sampling, the same tokens). Cache positions of rejected proposals
+// are dropped.
+//
+// A draft model must share the target's vocabulary. The models are used
+// from the calling thread only.
+class SpeculativeDecoder {
+public:
+    // Drafts with a second, smaller model
+    SpeculativeDecoder(Model& target, Model& draft, int n_draft = 4);
+    // Drafts by prompt lookup, matching n-grams of 1 to max_ngram tokens
+    explicit SpeculativeDecoder(Model& target, int n_draft = 8, int max_ngram = 3);
+
+    // Like Model::generate: returns the prompt followed by up to `steps`
+    // new tokens.
+    std::vector<int> generate(const std::vector<int>& prompt, int steps,
+                              const SamplerOptions& sampling = SamplerOptions());
+
+    const SpeculativeStats& stats() const;
+
+private:
+    // Draws a token from vocab probabilities (their sum need not be 1)
+    int draw(const float* probs, float sum);
+    // Appends up to k draft-model proposals to `tokens`, filling their q.
+    // `draft_length` is the number of positions the draft has cached.
+    int draft_tokens(std::vector<int>& tokens, int k, const Sampler& sampler, int draft_seq, int& draft_length);
+
+    Model& target;
+    Model* draft; // nullptr: prompt lookup
+    NGramIndex lookup;
+    int n_draft;
+    size_t vocab;
+    int max_positions; // the shorter seq_len of the two models
+    SpeculativeStats counters;
+    std::mt19937_64 rng;
+
+    std::vector<float> draft_probs; // [n_draft, vocab]: q of each model proposal
+    std::vector<float> target_probs;
+    std::vector<int> pending; // tokens fed to a model in one pass
+};
+
+} // namespace DaisoML
+
+#endif //DAISOML_SPECULATIVE_H
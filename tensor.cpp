@@ -1,5 +1,8 @@
 #include "tensor.h"
 #include "utils.h"
+#include "thread_pool.h"
+#include "kernels/kernels.h"
+#include "kernels/quant.h"
 #include <numeric>
 #include <stdexcept>
 #include <cmath>
@@ -7,17 +10,70 @@
 
 namespace DaisoML {
 
-Tensor::Tensor() : _size(0) {}
+const char* dtype_name(DType dtype) {
+    switch (dtype) {
+        case DType::F32: return "f32";
+        case DType::Q8_0: return "q8_0";
+        case DType::Q4_0: return "q4_0";
+    }
+    return "unknown";
+}
+
+size_t dtype_row_bytes(DType dtype, size_t cols) {
+    switch (dtype) {
+        case DType::F32: return cols * sizeof(float);
+        case DType::Q8_0: return cols / kernels::QK * sizeof(kernels::BlockQ8_0);
+        case DType::Q4_0: return cols / kernels::QK * sizeof(kernels::BlockQ4_0);
+    }
+    return 0;
+}
 
-Tensor::Tensor(const std::vector<size_t>& shape) : _shape(shape) {
-    _size = 1;
-    for (size_t dim : _shape) {
+Tensor::Tensor() : _data(nullptr), _size(0), _dtype(DType::F32), _is_view(false) {}
+
+static size_t shape_size(const std::vector<size_t>& shape) {
+    size_t size = 1;
+    for (size_t dim : shape) {
         if (dim == 0) { // Cannot have a dimension of size 0
              throw DaisoException("Tensor dimensions cannot be 0.");
         }
-        _size *= dim;
+        size *= dim;
+    }
+    return size;
+}
+
+// Quantized tensors must be 2D with whole blocks per row.
+static void check_quantized_shape(const std::vector<size_t>& shape, DType dtype) {
+    if (dtype == DType::F32) return;
+    if (shape.size() != 2 || shape[1] % kernels::QK != 0) {
+        throw DaisoException(std::string("A ") + dtype_name(dtype) +
+                             " tensor must be 2D with a multiple of 32 columns.");
+    }
+}
+
+Tensor::Tensor(const std::vector<size_t>& shape, DType dtype) : _shape(shape), _dtype(dtype), _is_view(false) {
+    _size = shape_size(_shape);
+    check_quantized_shape(_shape, dtype);
+    if (dtype == DType::F32) {
+        auto storage = std::make_shared<std::vector<float>>(_size, 0.0f);
+        _data = storage->data();
+        _storage = std::move(storage);
+    } else {
+        auto storage = std::make_shared<std::vector<uint8_t>>(nbytes(), 0);
+        _data = storage->data();
+        _storage = std::move(storage);
     }
-    _data = std::make_shared<std::vector<float>>(_size, 0.0f);
+}
+
+Tensor Tensor::view(const std::vector<size_t>& shape, void* data, std::shared_ptr<void> owner, DType dtype) {
+    Tensor t;
+    t._shape = shape;
+    t._size = shape_size(shape);
+    check_quantized_shape(shape, dtype);
+    t._data = data;
+    t._storage = std::move(owner);
+    t._dtype = dtype;
+    t._is_view = true;
+    return t;
 }
 
 const std::vector<size_t>& Tensor::shape() const {
@@ -28,12 +84,35 @@ size_t Tensor::size() const {
     return _size;
 }
 
+DType Tensor::dtype() const {
+    return _dtype;
+}
+
+size_t Tensor::nbytes() const {
+    if (_dtype == DType::F32 || _shape.empty()) return _size * sizeof(float);
+    return (_size / _shape.back()) * dtype_row_bytes(_dtype, _shape.back());
+}
+
 float* Tensor::data() {
-    return _data->data();
+    if (_dtype != DType::F32) throw DaisoException("data() requires an f32 tensor.");
+    return static_cast<float*>(_data);
 }
 
 const float* Tensor::data() const {
-    return _data->data();
+    if (_dtype != DType::F32) throw DaisoException("data() requires an f32 tensor.");
+    return static_cast<const float*>(_data);
+}
+
+void* Tensor::raw() {
+    return _data;
+}
+
+const void* Tensor::raw() const {
+    return _data;
+}
+
+bool Tensor::is_view() const {
+    return _is_view;
 }
 
 void Tensor::reshape(const std::vector<size_t>& new_shape) {
@@ -49,36 +128,36 @@ void Tensor::reshape(const std::vector<size_t>& new_shape) {
 
 float& Tensor::at(size_t i) {
     if (_shape.size() != 1) throw DaisoException("at(i) requires a 1D tensor.");
-    return (*_data)[i];
+    return data()[i];
 }
 const float& Tensor::at(size_t i) const {
     if (_shape.size() != 1) throw DaisoException("at(i) requires a 1D tensor.");
-    return (*_data)[i];
+    return data()[i];
 }
 
 float& Tensor::at(size_t i, size_t j) {
     if (_shape.size() != 2) throw DaisoException("at(i, j) requires a 2D tensor.");
-    return (*_data)[i * _shape[1] + j];
+    return data()[i * _shape[1] + j];
 }
 const float& Tensor::at(size_t i, size_t j) const {
     if (_shape.size() != 2) throw DaisoException("at(i, j) requires a 2D tensor.");
-    return (*_data)[i * _shape[1] + j];
+    return data()[i * _shape[1] + j];
 }
 
 float& Tensor::at(size_t i, size_t j, size_t k) {
     if (_shape.size() != 3) throw DaisoException("at(i, j, k) requires a 3D tensor.");
-    return (*_data)[i * _shape[1] * _shape[2] + j * _shape[2] + k];
+    return data()[i * _shape[1] * _shape[2] + j * _shape[2] + k];
 }
 const float& Tensor::at(size_t i, size_t j, size_t k) const {
     if (_shape.size() != 3) throw DaisoException("at(i, j, k) requires a 3D tensor.");
-    return (*_data)[i * _shape[1] * _shape[2] + j * _shape[2] + k];
+    return data()[i * _shape[1] * _shape[2] + j * _shape[2] + k];
 }
 
 
 // Implementations for tensor operations
 
 void matmul(Tensor& out, const Tensor& a, const Tensor& b) {
-    // Naive matrix multiplication for 2D tensors
+    // Matrix multiplication for 2D tensors: out = a @ b
     if (a.shape().size() != 2 || b.shape().size() != 2 || out.shape().size() != 2) {
         throw DaisoException("Matmul currently only supports 2D tensors.");
     }
@@ -90,13 +169,26 @@ void matmul(Tensor& out, const Tensor& a, const Tensor& b) {
         throw DaisoException("Matmul shape mismatch.");
     }
 
-    for (size_t i = 0; i < a_shape[0]; ++i) {
-        for (size_t j = 0; j < b_shape[1]; ++j) {
-            float sum = 0.0f;
-            for (size_t k = 0; k < a_shape[1]; ++k) {
-                sum += a.at(i, k) * b.at(k, j);
+    // Cache-blocked i-k-j order: each row of `out` is accumulated from rows of
+    // `b` with vectorized axpy, and `b` is walked in blocks that fit in L2.
+    const size_t M = a_shape[0], K = a_shape[1], N = b_shape[1];
+    const size_t k_block = 256;
+    const size_t n_block = 1024;
+    const auto& kt = kernels::active();
+    const float* a_data = a.data();
+    const float* b_data = b.data();
+    float* out_data = out.data();
+    std::fill(out_data, out_data + M * N, 0.0f);
+    for (size_t n0 = 0; n0 < N; n0 += n_block) {
+        const size_t nn = std::min(n_block, N - n0);
+        for (size_t k0 = 0; k0 < K; k0 += k_block) {
+            const size_t k1 = std::min(k0 + k_block, K);
+            for (size_t i = 0; i < M; ++i) {
+                float* out_row = out_data + i * N + n0;
+                for (size_t kk = k0; kk < k1; ++kk) {
+                    kt.axpy(out_row, a_data[i * K + kk], b_data + kk * N + n0, nn);
+                }
             }
-            out.at(i, j) = sum;
         }
     }
 }
@@ -105,8 +197,11 @@ void add(Tensor& out, const Tensor& a, const Tensor& b) {
     if (a.shape() != b.shape() || a.shape() != out.shape()) {
         throw DaisoException("Tensor addition shape mismatch.");
     }
+    float* o = out.data();
+    const float* pa = a.data();
+    const float* pb = b.data();
     for (size_t i = 0; i < a.size(); ++i) {
-        out.data()[i] = a.data()[i] + b.data()[i];
+        o[i] = pa[i] + pb[i];
     }
 }
 
@@ -144,8 +239,10 @@ void sigmoid(Tensor& out, const Tensor& a) {
     if (a.shape() != out.shape()) {
         throw DaisoException("Sigmoid shape mismatch.");
     }
+    float* o = out.data();
+    const float* pa = a.data();
     for (size_t i = 0; i < a.size(); ++i) {
-        out.data()[i] = 1.0f / (1.0f + std::exp(-a.data()[i]));
+        o[i] = 1.0f / (1.0f + std::exp(-pa[i]));
     }
 }
 
@@ -153,9 +250,220 @@ void element_wise_mul(Tensor& out, const Tensor& a, const Tensor& b) {
     if (a.shape() != b.shape() || a.shape() != out.shape()) {
         throw DaisoException("Element-wise multiplication shape mismatch.");
     }
+    float* o = out.data();
+    const float* pa = a.data();
+    const float* pb = b.data();
     for (size_t i = 0; i < a.size(); ++i) {
-        out.data()[i] = a.data()[i] * b.data()[i];
+        o[i] = pa[i] * pb[i];
+    }
+}
+
+float dot(const float* a, const float* b, size_t n) {
+    return kernels::active().dot(a, b, n);
+}
+
+void axpy(float* y, float alpha, const float* x, size_t n) {
+    kernels::active().axpy(y, alpha, x, n);
+}
+
+float dot_f16(const float* a, const uint16_t* b, size_t n) {
+    return kernels::active().dot_f16(a, b, n);
+}
+
+void axpy_f16(float* y, float alpha, const uint16_t* x, size_t n) {
+    kernels::active().axpy_f16(y, alpha, x, n);
+}
+
+float dot_i8(const float* a, const int8_t* b, size_t n) {
+    return kernels::active().dot_i8(a, b, n);
+}
+
+void axpy_i8(float* y, float alpha, const int8_t* x, size_t n) {
+    kernels::active().axpy_i8(y, alpha, x, n);
+}
+
+// Below this many multiply-adds a projection runs on the calling thread; the
+// cost of waking the pool would outweigh the work.
+static constexpr size_t kMinParallelWork = 1 << 15;
+
+// Row ranges handed to each thread are multiples of this, matching the row
+// blocking of the gemv/gemm kernels.
+static constexpr size_t kRowAlign = 16;
+
+// out[t * ldo + (r - r0)] = x[t] . w[r] for t in [0, n), r in [r0, r1): one
+// slice of weight rows against every activation row, for any weight dtype.
+// A single row uses the gemv kernels, which dot quantized weights in place;
+// otherwise quantized weights are expanded a small tile of rows at a time
+// into a per-thread buffer, so each weight row is dequantized once and reused
+// for all n activation rows.
+static void project_rows(const kernels::KernelTable& kt, float* out, size_t ldo, const Tensor& w, const float* x,
+                         size_t n, size_t r0, size_t r1) {
+    const size_t cols = w.shape()[1];
+    if (w.dtype() == DType::F32) {
+        if (n == 1) {
+            kt.gemv(out, w.data() + r0 * cols, x, r1 - r0, cols);
+        } else {
+            kt.gemm_nt(out, ldo, x, n, w.data() + r0 * cols, r1 - r0, cols);
+        }
+        return;
+    }
+    const size_t row_bytes = dtype_row_bytes(w.dtype(), cols);
+    const uint8_t* base = static_cast<const uint8_t*>(w.raw());
+    if (n == 1) {
+        auto dot_q = w.dtype() == DType::Q8_0 ? kt.dot_q8_0 : kt.dot_q4_0;
+        for (size_t r = r0; r < r1; ++r) {
+            out[r - r0] = dot_q(base + r * row_bytes, x, cols);
+        }
+        return;
+    }
+    const size_t tile_rows = 16;
+    thread_local std::vector<float> tile;
+    if (tile.size() < tile_rows * cols) tile.resize(tile_rows * cols);
+
+    auto dequantize = w.dtype() == DType::Q8_0 ? kernels::dequantize_row_q8_0 : kernels::dequantize_row_q4_0;
+    for (size_t r = r0; r < r1; r += tile_rows) {
+        const size_t nr = std::min(tile_rows, r1 - r);
+        for (size_t i = 0; i < nr; ++i) {
+            dequantize(base + (r + i) * row_bytes, tile.data() + i * cols, cols);
+        }
+        kt.gemm_nt(out + (r - r0), ldo, x, n, tile.data(), nr, cols);
+    }
+}
+
+// Runs fn(r0, r1) over [0, rows): on the calling thread for small products,
+// else split across the pool so each thread owns a slice of weight rows for
+// all activation rows, and every weight byte is still read exactly once.
+template <typename Fn>
+static void for_row_slices(size_t rows, size_t work, Fn&& fn) {
+    if (work < kMinParallelWork) {
+        fn(0, rows);
+        return;
+    }
+    parallel_for(rows, kRowAlign, fn);
+}
+
+// Weight rows a fused epilogue handles at a time: the gemm_nt cache block,
+// so the per-thread partial results stay small and hot.
+static size_t epilogue_rows(size_t cols) {
+    return (kernels::gemm_row_block(cols) + kRowAlign - 1) / kRowAlign * kRowAlign;
+}
+
+static void check_matrix(const Tensor& w, const char* op) {
+    if (w.shape().size() != 2) {
+        throw DaisoException(std::string(op) + " expects a 2D weight matrix.");
+    }
+}
+
+void matvec(float* out, const Tensor& w, const float* x) {
+    check_matrix(w, "matvec");
+    gemm(out, w, x, 1);
+}
+
+void gemm(float* out, const Tensor& w, const float* x, size_t n) {
+    check_matrix(w, "gemm");
+    const size_t rows = w.shape()[0];
+    const size_t cols = w.shape()[1];
+    const auto& kt = kernels::active();
+    for_row_slices(rows, n * rows * cols, [&](size_t r0, size_t r1) {
+        project_rows(kt, out + r0, rows, w, x, n, r0, r1);
+    });
+}
+
+void gemm_multi(float* const* outs, const Tensor* const* ws, size_t count, const float* x, size_t n) {
+    size_t total_rows = 0;
+    for (size_t i = 0; i < count; ++i) {
+        check_matrix(*ws[i], "gemm_multi");
+        if (ws[i]->shape()[1] != ws[0]->shape()[1]) {
+            throw DaisoException("gemm_multi weights must share their column count.");
+        }
+        total_rows += ws[i]->shape()[0];
+    }
+    if (count == 0) return;
+    const size_t cols = ws[0]->shape()[1];
+    const auto& kt = kernels::active();
+    // Rows of the stacked matrices; a slice may span two of them
+    for_row_slices(total_rows, n * total_rows * cols, [&](size_t g0, size_t g1) {
+        size_t first = 0;
+        for (size_t i = 0; i < count && first < g1; ++i) {
+            const size_t rows = ws[i]->shape()[0];
+            const size_t r0 = std::max(g0, first) - first;
+            const size_t r1 = std::min(g1, first + rows) - first;
+            if (r0 < r1) project_rows(kt, outs[i] + r0, rows, *ws[i], x, n, r0, r1);
+            first += rows;
+        }
+    });
+}
+
+void gemm_add(float* out, const Tensor& w, const float* x, size_t n) {
+    check_matrix(w, "gemm_add");
+    const size_t rows = w.shape()[0];
+    const size_t cols = w.shape()[1];
+    const auto& kt = kernels::active();
+    const size_t block = epilogue_rows(cols);
+    for_row_slices(rows, n * rows * cols, [&](size_t r0, size_t r1) {
+        thread_local std::vector<float> partial;
+        if (partial.size() < n * block) partial.resize(n * block);
+        for (size_t b0 = r0; b0 < r1; b0 += block) {
+            const size_t nb = std::min(block, r1 - b0);
+            project_rows(kt, partial.data(), nb, w, x, n, b0, b0 + nb);
+            for (size_t t = 0; t < n; ++t) {
+                float* o = out + t * rows + b0;
+                const float* p = partial.data() + t * nb;
+                for (size_t r = 0; r < nb; ++r) o[r] += p[r];
+            }
+        }
+    });
+}
+
+void gemm_swiglu(float* out, const Tensor& w_gate, const Tensor& w_up, const float* x, size_t n) {
+    check_matrix(w_gate, "gemm_swiglu");
+    check_matrix(w_up, "gemm_swiglu");
+    if (w_gate.shape() != w_up.shape()) {
+        throw DaisoException("gemm_swiglu gate and up projections must have the same shape.");
+    }
+    const size_t rows = w_gate.shape()[0];
+    const size_t cols = w_gate.shape()[1];
+    const auto& kt = kernels::active();
+    const size_t block = epilogue_rows(cols);
+    for_row_slices(rows, 2 * n * rows * cols, [&](size_t r0, size_t r1) {
+        thread_local std::vector<float> up;
+        if (up.size() < n * block) up.resize(n * block);
+        for (size_t b0 = r0; b0 < r1; b0 += block) {
+            const size_t nb = std::min(block, r1 - b0);
+            project_rows(kt, out + b0, rows, w_gate, x, n, b0, b0 + nb);
+            project_rows(kt, up.data(), nb, w_up, x, n, b0, b0 + nb);
+            for (size_t t = 0; t < n; ++t) {
+                float* h = out + t * rows + b0;
+                const float* u = up.data() + t * nb;
+                for (size_t r = 0; r < nb; ++r) {
+                    // silu(gate) * up
+                    h[r] = h[r] / (1.0f + std::exp(-h[r])) * u[r];
+                }
+            }
+        }
+    });
+}
+
+Tensor quantize(const Tensor& t, DType dtype) {
+    if (t.dtype() != DType::F32) {
+        throw DaisoException("quantize expects an f32 tensor.");
+    }
+    if (dtype == DType::F32) {
+        throw DaisoException("quantize expects a quantized target dtype.");
+    }
+    Tensor q(t.shape(), dtype);
+    const size_t cols = t.shape()[1];
+    const size_t row_bytes = dtype_row_bytes(dtype, cols);
+    auto quantize_row = dtype == DType::Q8_0 ? kernels::quantize_row_q8_0 : kernels::quantize_row_q4_0;
+    uint8_t* dst = static_cast<uint8_t*>(q.raw());
+    for (size_t r = 0; r < t.shape()[0]; ++r) {
+        quantize_row(t.data() + r * cols, dst + r * row_bytes, cols);
     }
+    return q;
+}
+
+const char* kernel_isa() {
+    return kernels::active().name;
 }
 
 } // namespace DaisoML
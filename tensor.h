@@ -3,16 +3,37 @@
 
 #include <vector>
 #include <cstddef>
+#include <cstdint>
 #include <memory>
 
 namespace DaisoML {
 
-// A basic multi-dimensional Tensor class for floating point numbers.
+// Element storage type. The block-quantized types (see kernels/quant.h) are
+// only used for 2D weight matrices; their shape is the logical [rows, cols]
+// and cols must be a multiple of the block size (32).
+enum class DType {
+    F32,
+    Q8_0, // 8-bit weights, one fp16 scale per 32 values
+    Q4_0, // 4-bit weights, one fp16 scale per 32 values
+};
+
+const char* dtype_name(DType dtype);
+// Bytes needed to store one row of `cols` elements.
+size_t dtype_row_bytes(DType dtype, size_t cols);
+
+// A basic multi-dimensional Tensor class for floating point numbers and
+// block-quantized weight matrices.
 class Tensor {
 public:
     // Constructors
     Tensor();
-    explicit Tensor(const std::vector<size_t>& shape);
+    explicit Tensor(const std::vector<size_t>& shape, DType dtype = DType::F32);
+
+    // Creates a non-owning view over existing memory (e.g. a memory-mapped
+    // model file). `owner` is kept alive for as long as any copy of the view
+    // exists. Views of read-only mappings must not be written to.
+    static Tensor view(const std::vector<size_t>& shape, void* data, std::shared_ptr<void> owner = nullptr,
+                       DType dtype = DType::F32);
 
     // Get the shape of the tensor
     const std::vector<size_t>& shape() const;
@@ -20,10 +41,21 @@ public:
     // Get the total number of elements
     size_t size() const;
 
-    // Get a pointer to the raw data
+    // Element type and size of the storage in bytes
+    DType dtype() const;
+    size_t nbytes() const;
+
+    // Get a pointer to the float data (F32 tensors only)
     float* data();
     const float* data() const;
 
+    // Get a pointer to the storage, whatever its type
+    void* raw();
+    const void* raw() const;
+
+    // True if the tensor does not own its memory
+    bool is_view() const;
+
     // Reshape the tensor (must have the same total size)
     void reshape(const std::vector<size_t>& new_shape);
 
@@ -38,8 +70,11 @@ public:
 
 private:
     std::vector<size_t> _shape;
-    std::shared_ptr<std::vector<float>> _data;
+    std::shared_ptr<void> _storage; // Owns (or keeps alive) the memory behind _data
+    void* _data;
     size_t _size;
+    DType _dtype;
+    bool _is_view;
 };
 
 // Tensor operations (will be implemented in tensor.cpp)
@@ -49,6 +84,47 @@ void softmax(Tensor& out, const Tensor& a);
 void sigmoid(Tensor& out, const Tensor& a);
 void element_wise_mul(Tensor& out, const Tensor& a, const Tensor& b);
 
+// Kernel-backed linear algebra. These dispatch at runtime to the fastest
+// implementation for the host CPU (scalar, AVX2, AVX-512 or NEON); see
+// kernels/kernels.h. Weight matrices are row-major [rows, cols] and may be
+// F32 or block-quantized; quantized rows are dequantized inside the dot
+// product, never materialized for matvec.
+
+// Returns sum(a[i] * b[i]).
+float dot(const float* a, const float* b, size_t n);
+// y += alpha * x
+void axpy(float* y, float alpha, const float* x, size_t n);
+// dot / axpy with the second operand stored as IEEE half or int8 (unscaled),
+// as used by compressed KV caches.
+float dot_f16(const float* a, const uint16_t* b, size_t n);
+void axpy_f16(float* y, float alpha, const uint16_t* x, size_t n);
+float dot_i8(const float* a, const int8_t* b, size_t n);
+void axpy_i8(float* y, float alpha, const int8_t* x, size_t n);
+// out[rows] = w @ x
+void matvec(float* out, const Tensor& w, const float* x);
+// out[n, rows] = x[n, cols] @ w^T. Processes several activation rows per pass
+// over the weights, which is what makes batched work cheaper than n matvecs.
+void gemm(float* out, const Tensor& w, const float* x, size_t n);
+
+// Fused projections. Each makes one thread-pool dispatch and one pass over
+// its weights, and applies its epilogue to a block of results while the
+// block is still in cache.
+// outs[i][n, rows_i] = x @ ws[i]^T for several weights of the same input
+// (e.g. Q, K and V).
+void gemm_multi(float* const* outs, const Tensor* const* ws, size_t count, const float* x, size_t n);
+// out[n, rows] += x @ w^T, i.e. a projection with its residual add.
+void gemm_add(float* out, const Tensor& w, const float* x, size_t n);
+// out[n, rows] = silu(x @ w_gate^T) * (x @ w_up^T), the SwiGLU gate and up
+// projections computed row-slice by row-slice with the activation applied on
+// the fly.
+void gemm_swiglu(float* out, const Tensor& w_gate, const Tensor& w_up, const float* x, size_t n);
+
+// Returns a block-quantized copy of the 2D F32 tensor `t`.
+Tensor quantize(const Tensor& t, DType dtype);
+
+// Name of the kernel implementation selected for this CPU.
+const char* kernel_isa();
+
 
 } // namespace DaisoML
 
@@ -0,0 +1,104 @@
+#include "loopback_client.h"
+#include "utils.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace DaisoML {
+
+LoopbackClient::LoopbackClient(const std::string& socket_path) : socket_path(socket_path) {}
+
+int LoopbackClient::connect(int timeout_ms) const {
+    sockaddr_un addr{};
+    if (socket_path.size() >= sizeof(addr.sun_path)) {
+        throw DaisoException("Socket path is too long: " + socket_path);
+    }
+    addr.sun_family = AF_UNIX;
+    std::strcpy(addr.sun_path, socket_path.c_str());
+
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (true) {
+        const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+        if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) return fd;
+        ::close(fd);
+        // The server may not have bound or started listening yet
+        if (std::chrono::steady_clock::now() >= deadline) return -1;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+}
+
+int LoopbackClient::send(const std::string& method, const std::string& target, const std::string& body) const {
+    return write_request(method + " " + target + " HTTP/1.1\r\nHost: localhost\r\nContent-Length: " +
+                         std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body);
+}
+
+int LoopbackClient::write_request(const std::string& request) const {
+    const int fd = connect();
+    if (fd < 0) {
+        throw DaisoException("Cannot connect to " + socket_path);
+    }
+    size_t sent = 0;
+    while (sent < request.size()) {
+        const ssize_t n = ::send(fd, request.data() + sent, request.size() - sent, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            ::close(fd);
+            throw DaisoException("Failed to send the request.");
+        }
+        sent += (size_t)n;
+    }
+    return fd;
+}
+
+HttpResponse LoopbackClient::request(const std::string& method, const std::string& target,
+                                     const std::string& body) const {
+    return read_reply(send(method, target, body));
+}
+
+HttpResponse LoopbackClient::send_raw(const std::string& raw) const {
+    return read_reply(write_request(raw));
+}
+
+HttpResponse LoopbackClient::read_reply(int fd) const {
+    // The server closes the connection after the reply
+    std::string data;
+    char buf[4096];
+    while (true) {
+        const ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        data.append(buf, (size_t)n);
+    }
+    ::close(fd);
+
+    const size_t head_end = data.find("\r\n\r\n");
+    if (data.compare(0, 9, "HTTP/1.1 ") != 0 || head_end == std::string::npos) {
+        throw DaisoException("Malformed reply: " + data.substr(0, 64));
+    }
+    HttpResponse response;
+    response.status = std::atoi(data.c_str() + 9);
+    response.body = data.substr(head_end + 4);
+    return response;
+}
+
+std::vector<std::string> LoopbackClient::events(const std::string& body) {
+    std::vector<std::string> out;
+    size_t pos = 0;
+    while ((pos = body.find("data: ", pos)) != std::string::npos) {
+        const size_t end = body.find("\n\n", pos);
+        if (end == std::string::npos) break;
+        out.push_back(body.substr(pos + 6, end - pos - 6));
+        pos = end + 2;
+    }
+    return out;
+}
+
+} // namespace DaisoML
@@ -0,0 +1,50 @@
+#ifndef DAISOML_LOOPBACK_CLIENT_H
+#define DAISOML_LOOPBACK_CLIENT_H
+
+#include <string>
+#include <vector>
+
+namespace DaisoML {
+
+struct HttpResponse {
+    int status = 0;
+    std::string body;
+};
+
+// Minimal HTTP/1.1 client for talking to a Server over its Unix domain
+// socket in tests. Every request uses a fresh connection, which the server
+// closes after its reply.
+class LoopbackClient {
+public:
+    explicit LoopbackClient(const std::string& socket_path);
+
+    // Connects, retrying until the server listens or `timeout_ms` passes;
+    // returns the socket, or -1.
+    int connect(int timeout_ms = 10000) const;
+
+    // Sends a request and reads the whole reply. Throws if the server cannot
+    // be reached or the reply is malformed.
+    HttpResponse request(const std::string& method, const std::string& target,
+                         const std::string& body = std::string()) const;
+    // Sends a request and returns the open connection without reading the
+    // reply; the caller closes it.
+    int send(const std::string& method, const std::string& target, const std::string& body) const;
+    // Sends `raw` verbatim as the whole request and reads the reply, for
+    // requests the other calls cannot produce.
+    HttpResponse send_raw(const std::string& raw) const;
+
+    // The JSON payloads of the `data:` lines of a server-sent event stream
+    static std::vector<std::string> events(const std::string& body);
+
+private:
+    // Sends a complete request on a fresh connection and returns it
+    int write_request(const std::string& request) const;
+    // Reads the reply until the server closes the connection, then closes it
+    HttpResponse read_reply(int fd) const;
+
+    std::string socket_path;
+};
+
+} // namespace DaisoML
+
+#endif //DAISOML_LOOPBACK_CLIENT_H
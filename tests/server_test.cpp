@@ -0,0 +1,163 @@
+// End-to-end test of the HTTP server over a Unix domain socket.
+//
+// Usage: server_test MODEL_PATH
+// Starts a Server on the model, talks to it with LoopbackClient, and exits
+// non-zero if any check fails.
+
+#include "loopback_client.h"
+#include "model.h"
+#include "server.h"
+#include "utils.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace DaisoML;
+
+static int failures = 0;
+
+#define CHECK(cond)                                                               \
+    do {                                                                          \
+        if (!(cond)) {                                                            \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                           \
+        }                                                                         \
+    } while (0)
+
+// The number after "key": in a flat JSON object, or -1
+static long json_number(const std::string& json, const std::string& key) {
+    const size_t pos = json.find("\"" + key + "\":");
+    if (pos == std::string::npos) return -1;
+    return std::strtol(json.c_str() + pos + key.size() + 3, nullptr, 10);
+}
+
+// The integers of the "tokens":[...] array
+static std::vector<int> json_tokens(const std::string& json) {
+    std::vector<int> out;
+    size_t pos = json.find("\"tokens\":[");
+    if (pos == std::string::npos) return out;
+    pos += 10;
+    while (pos < json.size() && json[pos] != ']') {
+        char* end = nullptr;
+        out.push_back((int)std::strtol(json.c_str() + pos, &end, 10));
+        pos = (size_t)(end - json.c_str());
+        if (pos < json.size() && json[pos] == ',') pos++;
+    }
+    return out;
+}
+
+// Polls /health until `done` holds for its reply, for up to `timeout_ms`
+static bool wait_for_health(const LoopbackClient& client, const std::function<bool(const std::string&)>& done,
+                            int timeout_ms) {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (std::chrono::steady_clock::now() < deadline) {
+        if (done(client.request("GET", "/health").body)) return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return false;
+}
+
+static void test_routes(const LoopbackClient& client) {
+    const HttpResponse health = client.request("GET", "/health");
+    CHECK(health.status == 200);
+    CHECK(health.body.find("\"status\":\"ok\"") != std::string::npos);
+    CHECK(json_number(health.body, "running") == 0);
+
+    CHECK(client.request("GET", "/nowhere").status == 404);
+    CHECK(client.request("POST", "/v1/completions", "{\"max_tokens\": 4}").status == 400);
+    CHECK(client.request("POST", "/v1/completions", "not json").status == 400);
+    CHECK(client.request("POST", "/v1/cancel", "{}").status == 400);
+}
+
+// Values that do not fit their fields are rejected, not truncated
+static void test_validation(const LoopbackClient& client) {
+    const std::string prompt = "{\"prompt\": \"Hello\", ";
+    CHECK(client.request("POST", "/v1/completions", prompt + "\"max_tokens\": 1e12}").status == 400);
+    CHECK(client.request("POST", "/v1/completions", prompt + "\"max_tokens\": 2.5}").status == 400);
+    CHECK(client.request("POST", "/v1/completions", prompt + "\"top_k\": -1e300}").status == 400);
+    CHECK(client.request("POST", "/v1/completions", prompt + "\"seed\": -1}").status == 400);
+    CHECK(client.request("POST", "/v1/completions", prompt + "\"stream\": \"no\"}").status == 400);
+    CHECK(client.request("POST", "/v1/cancel", "{\"id\": 1e12}").status == 400);
+
+    const std::string head = "POST /v1/completions HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n";
+    CHECK(client.send_raw(head + "Content-Length: abc\r\n\r\n{}").status == 400);
+    CHECK(client.send_raw(head + "Content-Length: -2\r\n\r\n{}").status == 400);
+    CHECK(client.send_raw(head + "Content-Length: 99999999999999999999\r\n\r\n").status == 413);
+}
+
+static void test_completions(const LoopbackClient& client) {
+    const std::string request = "{\"prompt\": \"Hello, my name is\", \"max_tokens\": 8, \"temperature\": 0";
+
+    const HttpResponse whole = client.request("POST", "/v1/completions", request + ", \"stream\": false}");
+    CHECK(whole.status == 200);
+    const std::vector<int> tokens = json_tokens(whole.body);
+    CHECK(tokens.size() == 8);
+
+    // Streaming the same greedy request yields the same tokens, one event
+    // each, then [DONE]
+    const HttpResponse streamed = client.request("POST", "/v1/completions", request + "}");
+    CHECK(streamed.status == 200);
+    const std::vector<std::string> events = LoopbackClient::events(streamed.body);
+    CHECK(events.size() == tokens.size() + 1);
+    for (size_t i = 0; i + 1 < events.size() && i < tokens.size(); ++i) {
+        CHECK(json_number(events[i], "token") == tokens[i]);
+    }
+    CHECK(!events.empty() && events.back() == "[DONE]");
+}
+
+// A client that hangs up on a non-streaming request gets it cancelled, even
+// though nothing is sent to it until the request finishes
+static void test_hangup(const LoopbackClient& client, int max_tokens) {
+    const long before = json_number(client.request("GET", "/health").body, "generated_tokens");
+    const int fd = client.send("POST", "/v1/completions",
+                               "{\"prompt\": \"Hello\", \"stream\": false, \"max_tokens\": " +
+                                   std::to_string(max_tokens) + "}");
+    CHECK(wait_for_health(client, [](const std::string& h) { return json_number(h, "running") == 1; }, 10000));
+    ::close(fd);
+    CHECK(wait_for_health(client, [](const std::string& h) { return json_number(h, "running") == 0; }, 30000));
+    const long generated = json_number(client.request("GET", "/health").body, "generated_tokens") - before;
+    CHECK(generated > 0 && generated < max_tokens);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::fprintf(stderr, "Usage: %s MODEL_PATH\n", argv[0]);
+        return 2;
+    }
+    set_log_level(LogLevel::Warn);
+    ModelOptions model_options;
+    model_options.max_batch = 4;
+    Model model(argv[1], model_options);
+
+    ServerOptions options;
+    options.socket_path = "/tmp/daiso_server_test_" + std::to_string(::getpid()) + ".sock";
+    Server server(model, options);
+    std::thread serving([&] { server.run(); });
+    const LoopbackClient client(options.socket_path);
+
+    try {
+        test_routes(client);
+        test_validation(client);
+        test_completions(client);
+        test_hangup(client, model.getConfig().seq_len - 8);
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "server_test: %s\n", e.what());
+        failures++;
+    }
+
+    server.stop();
+    serving.join();
+    if (failures > 0) {
+        std::fprintf(stderr, "server_test: %d check(s) failed\n", failures);
+        return 1;
+    }
+    std::printf("server_test: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,177 @@
+#include "thread_pool.h"
+#include "utils.h"
+#include <cstdlib>
+#include <memory>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+#include <immintrin.h>
+#define DAISO_CPU_RELAX() _mm_pause()
+#elif defined(__aarch64__)
+#define DAISO_CPU_RELAX() asm volatile("yield")
+#else
+#define DAISO_CPU_RELAX() std::this_thread::yield()
+#endif
+
+namespace DaisoML {
+
+// Iterations a parked worker spins before blocking on the condition variable.
+// Long enough to cover the gap between two projections of the same token.
+static constexpr int kSpinIterations = 1 << 14;
+
+// Iterations the caller spins at the end-of-job barrier before it starts
+// yielding its CPU to workers that have not finished yet.
+static constexpr int kBarrierSpins = 1 << 10;
+
+// Set while a thread is executing a range, so nested parallel_for calls run
+// inline instead of deadlocking on the pool.
+static thread_local bool in_parallel_region = false;
+
+static void pin_current_thread(int cpu) {
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu % CPU_SETSIZE, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    (void)cpu;
+#endif
+}
+
+ThreadPool::ThreadPool(int n_threads, bool pin_threads) {
+    if (n_threads <= 0) {
+        n_threads = static_cast<int>(std::thread::hardware_concurrency());
+        if (n_threads <= 0) n_threads = 1;
+    }
+    this->n_threads = n_threads;
+
+    const int n_cpus = static_cast<int>(std::thread::hardware_concurrency());
+    pin_threads = pin_threads && n_cpus > 0 && n_threads <= n_cpus;
+    // Workers start from the generation read here, not from whatever it is
+    // once they get scheduled: a job published before then must not be missed.
+    const unsigned seen = generation.load(std::memory_order_acquire);
+    workers.reserve(n_threads - 1);
+    for (int i = 1; i < n_threads; ++i) {
+        workers.emplace_back([this, i, seen, pin_threads] {
+            if (pin_threads) pin_current_thread(i);
+            worker_loop(i, seen);
+        });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        generation.fetch_add(1, std::memory_order_release);
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+int ThreadPool::num_threads() const {
+    return n_threads;
+}
+
+void ThreadPool::run_range(int thread_index) {
+    const size_t begin = thread_index * job_chunk;
+    if (begin >= job_n) return;
+    const size_t end = begin + job_chunk < job_n ? begin + job_chunk : job_n;
+    in_parallel_region = true;
+    job_fn(job_ctx, begin, end);
+    in_parallel_region = false;
+}
+
+void ThreadPool::run(TaskFn fn, void* ctx, size_t n, size_t align) {
+    if (n == 0) return;
+    if (align == 0) align = 1;
+    if (workers.empty() || in_parallel_region || n <= align) {
+        fn(ctx, 0, n);
+        return;
+    }
+
+    size_t chunk = (n + n_threads - 1) / n_threads;
+    chunk = (chunk + align - 1) / align * align;
+
+    job_fn = fn;
+    job_ctx = ctx;
+    job_n = n;
+    job_chunk = chunk;
+    pending.store(static_cast<int>(workers.size()), std::memory_order_relaxed);
+
+    // Publish the job, then wake any parked workers. Both this pair and the
+    // worker's sleepers/generation pair are sequentially consistent, so either
+    // the worker sees the new generation or we see it as a sleeper.
+    generation.fetch_add(1);
+    if (sleepers.load() > 0) {
+        { std::lock_guard<std::mutex> lock(mutex); }
+        wake.notify_all();
+    }
+
+    run_range(0);
+
+    // Barrier: wait for every worker to finish its range. After a short spin,
+    // yield so that a straggler sharing this CPU can run.
+    int spins = 0;
+    while (pending.load(std::memory_order_acquire) != 0) {
+        if (++spins < kBarrierSpins) {
+            DAISO_CPU_RELAX();
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void ThreadPool::worker_loop(int thread_index, unsigned seen) {
+    for (;;) {
+        int spins = 0;
+        while (generation.load(std::memory_order_acquire) == seen) {
+            if (++spins < kSpinIterations) {
+                DAISO_CPU_RELAX();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(mutex);
+            sleepers.fetch_add(1);
+            wake.wait(lock, [&] { return generation.load() != seen; });
+            sleepers.fetch_sub(1);
+            spins = 0;
+        }
+        seen = generation.load(std::memory_order_acquire);
+        if (stopping) return;
+
+        run_range(thread_index);
+        pending.fetch_sub(1, std::memory_order_acq_rel);
+    }
+}
+
+static std::unique_ptr<ThreadPool>& global_pool() {
+    static std::unique_ptr<ThreadPool> pool;
+    return pool;
+}
+
+ThreadPool& ThreadPool::global() {
+    auto& pool = global_pool();
+    if (!pool) {
+        int n_threads = 0;
+        if (const char* env = std::getenv("DAISO_THREADS")) {
+            n_threads = std::atoi(env);
+        }
+        pool.reset(new ThreadPool(n_threads));
+    }
+    return *pool;
+}
+
+void ThreadPool::set_global_threads(int n_threads, bool pin_threads) {
+    auto& pool = global_pool();
+    pool.reset();
+    pool.reset(new ThreadPool(n_threads, pin_threads));
+    log("Thread pool started with " + std::to_string(pool->num_threads()) + " threads.");
+}
+
+} // namespace DaisoML
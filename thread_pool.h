@@ -0,0 +1,88 @@
+#ifndef DAISOML_THREAD_POOL_H
+#define DAISOML_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace DaisoML {
+
+// A persistent pool of worker threads for data-parallel loops in the forward
+// pass. Workers are created once and then park between jobs: they spin
+// briefly (so back-to-back projections within a token hand off in
+// microseconds) before falling back to a condition variable. The calling
+// thread always takes part in the work, so a pool of N threads owns N - 1
+// workers. Each job ends in a barrier: parallel_for returns only after every
+// range has been processed. A pool serves one calling thread at a time.
+class ThreadPool {
+public:
+    // n_threads <= 0 selects std::thread::hardware_concurrency().
+    // When pin_threads is set, thread i is bound to CPU i (Linux only).
+    explicit ThreadPool(int n_threads = 0, bool pin_threads = true);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Number of threads taking part in a job, including the caller.
+    int num_threads() const;
+
+    // Splits [0, n) into one contiguous range per thread, with range
+    // boundaries rounded up to a multiple of `align`, and calls
+    // fn(begin, end) for each non-empty range. Calls made from inside a job
+    // run inline on the current thread.
+    template <typename F>
+    void parallel_for(size_t n, size_t align, F&& fn) {
+        using Fn = std::remove_reference_t<F>;
+        auto trampoline = [](void* ctx, size_t begin, size_t end) {
+            (*static_cast<Fn*>(ctx))(begin, end);
+        };
+        run(trampoline, const_cast<void*>(static_cast<const void*>(&fn)), n, align);
+    }
+
+    // Process-wide pool used by the kernels and layers. Defaults to the
+    // DAISO_THREADS environment variable, or all hardware threads.
+    static ThreadPool& global();
+
+    // Replaces the global pool. Must not be called while inference is running.
+    static void set_global_threads(int n_threads, bool pin_threads = true);
+
+private:
+    using TaskFn = void (*)(void* ctx, size_t begin, size_t end);
+
+    void run(TaskFn fn, void* ctx, size_t n, size_t align);
+    void run_range(int thread_index);
+    // `seen` is the generation current when the pool was created
+    void worker_loop(int thread_index, unsigned seen);
+
+    std::vector<std::thread> workers;
+    int n_threads;
+
+    // Current job; written by the caller before `generation` is bumped.
+    TaskFn job_fn = nullptr;
+    void* job_ctx = nullptr;
+    size_t job_n = 0;
+    size_t job_chunk = 0;
+
+    std::atomic<unsigned> generation{0};
+    std::atomic<int> pending{0};
+    std::atomic<int> sleepers{0};
+    bool stopping = false;
+    std::mutex mutex;
+    std::condition_variable wake;
+};
+
+// Shorthand for ThreadPool::global().parallel_for(...).
+template <typename F>
+void parallel_for(size_t n, size_t align, F&& fn) {
+    ThreadPool::global().parallel_for(n, align, std::forward<F>(fn));
+}
+
+} // namespace DaisoML
+
+#endif //DAISOML_THREAD_POOL_H
@@ -1,38 +1,381 @@
 #include "tokenizer.h"
+#include "file_format.h"
+#include "profile.h"
 #include "utils.h"
 
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <mutex>
+
 namespace DaisoML {
 
-Tokenizer::Tokenizer() : _vocab_size(0) {
-    log("Empty tokenizer created.");
+// Encodings of recently seen pre-tokens, shared by copies of a tokenizer.
+struct Tokenizer::Cache {
+    static constexpr size_t max_entries = 1 << 16;
+    static constexpr size_t max_piece = 64; // longer pieces are rare; not cached
+    std::mutex mutex;
+    std::unordered_map<std::string, std::vector<int>> pieces;
+};
+
+namespace {
+
+enum class CharClass { Letter, Digit, Space, Punct };
+
+CharClass char_class(unsigned char c) {
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c >= 0x80) return CharClass::Letter;
+    if (c >= '0' && c <= '9') return CharClass::Digit;
+    if (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f') return CharClass::Space;
+    return CharClass::Punct;
+}
+
+// Calls fn(begin, size) for each pre-token of `text`: a run of letters (any
+// non-ASCII byte counts as a letter, so UTF-8 words stay whole), digits or
+// punctuation, optionally preceded by one space; or a run of whitespace,
+// leaving the last space to the word after it.
+template <typename F>
+void split_pieces(const std::string& text, F&& fn) {
+    const size_t n = text.size();
+    size_t i = 0;
+    while (i < n) {
+        const size_t start = i;
+        if (text[i] == ' ' && i + 1 < n && char_class(text[i + 1]) != CharClass::Space) {
+            ++i;
+        }
+        const CharClass cls = char_class(text[i]);
+        if (cls != CharClass::Space) {
+            while (i < n && char_class(text[i]) == cls) ++i;
+        } else {
+            while (i < n && char_class(text[i]) == CharClass::Space &&
+                   !(text[i] == ' ' && i > start && i + 1 < n && char_class(text[i + 1]) != CharClass::Space)) {
+                ++i;
+            }
+        }
+        fn(text.data() + start, i - start);
+    }
+}
+
+uint64_t pair_key(int left, int right) {
+    return ((uint64_t)(uint32_t)left << 32) | (uint32_t)right;
+}
+
+} // namespace
+
+Tokenizer::Tokenizer() : _vocab_size(0), cache(std::make_shared<Cache>()) {
+    std::fill(std::begin(byte_tokens), std::end(byte_tokens), -1);
+}
+
+Tokenizer::Tokenizer(int vocab_size) : _vocab_size(vocab_size), cache(std::make_shared<Cache>()) {
+    const int n = std::min(vocab_size, 256);
+    vocab.resize(n);
+    for (int i = 0; i < n; ++i) {
+        vocab[i] = std::string(1, (char)i);
+    }
+    build_index();
+}
+
+Tokenizer::Tokenizer(const std::vector<std::string>& vocab, const std::vector<std::pair<int, int>>& merges)
+    : _vocab_size((int)vocab.size()), vocab(vocab), merge_list(merges), cache(std::make_shared<Cache>()) {
+    build_index();
+    for (int b = 0; b < 256; ++b) {
+        if (byte_tokens[b] < 0) {
+            throw DaisoException("Tokenizer vocabulary has no token for byte " + std::to_string(b) + ".");
+        }
+    }
+}
+
+void Tokenizer::build_index() {
+    std::fill(std::begin(byte_tokens), std::end(byte_tokens), -1);
+    std::unordered_map<std::string, int> ids;
+    ids.reserve(vocab.size());
+    for (size_t i = 0; i < vocab.size(); ++i) {
+        if (vocab[i].size() == 1 && byte_tokens[(unsigned char)vocab[i][0]] < 0) {
+            byte_tokens[(unsigned char)vocab[i][0]] = (int)i;
+        }
+        ids.emplace(vocab[i], (int)i); // first id wins for duplicates
+    }
+
+    merges.clear();
+    merges.reserve(merge_list.size());
+    for (size_t rank = 0; rank < merge_list.size(); ++rank) {
+        const int left = merge_list[rank].first;
+        const int right = merge_list[rank].second;
+        if (left < 0 || right < 0 || left >= (int)vocab.size() || right >= (int)vocab.size()) {
+            throw DaisoException("Tokenizer merge " + std::to_string(rank) + " refers to an unknown token.");
+        }
+        auto it = ids.find(vocab[left] + vocab[right]);
+        if (it == ids.end()) {
+            throw DaisoException("Tokenizer merge " + std::to_string(rank) + " produces a token not in the vocabulary.");
+        }
+        merges.emplace(pair_key(left, right), Merge{(int)rank, it->second}); // keeps the lowest rank
+    }
+}
+
+Tokenizer Tokenizer::deserialize(const std::vector<uint8_t>& data) {
+    size_t offset = 0;
+    // Sizes come from the file, so each is checked against the bytes left
+    // before anything is allocated for it
+    auto remaining = [&] { return data.size() - offset; };
+    auto read = [&](void* dst, size_t bytes) {
+        if (bytes > remaining()) {
+            throw DaisoException("Tokenizer section is truncated.");
+        }
+        std::memcpy(dst, data.data() + offset, bytes);
+        offset += bytes;
+    };
+
+    DaisoTokenizerHeader header;
+    read(&header, sizeof(header));
+    if (header.type != DAISO_TOKENIZER_BPE) {
+        throw DaisoException("Unsupported tokenizer type: " + std::to_string(header.type));
+    }
+    if ((uint64_t)header.n_tokens * sizeof(uint32_t) > remaining()) {
+        throw DaisoException("Tokenizer section is truncated.");
+    }
+    std::vector<std::string> vocab(header.n_tokens);
+    for (std::string& token : vocab) {
+        uint32_t length;
+        read(&length, sizeof(length));
+        if (length > remaining()) {
+            throw DaisoException("Tokenizer section is truncated.");
+        }
+        token.assign(reinterpret_cast<const char*>(data.data() + offset), length);
+        offset += length;
+    }
+    if ((uint64_t)header.n_merges * 2 * sizeof(int32_t) > remaining()) {
+        throw DaisoException("Tokenizer section is truncated.");
+    }
+    std::vector<std::pair<int, int>> merges(header.n_merges);
+    for (auto& merge : merges) {
+        int32_t pair[2];
+        read(pair, sizeof(pair));
+        merge = {pair[0], pair[1]};
+    }
+    return Tokenizer(vocab, merges);
+}
+
+std::vector<uint8_t> Tokenizer::serialize() const {
+    DaisoTokenizerHeader header = {};
+    header.type = DAISO_TOKENIZER_BPE;
+    header.n_tokens = (uint32_t)vocab.size();
+    header.n_merges = (uint32_t)merge_list.size();
+
+    std::vector<uint8_t> data;
+    auto write = [&](const void* src, size_t bytes) {
+        const uint8_t* p = static_cast<const uint8_t*>(src);
+        data.insert(data.end(), p, p + bytes);
+    };
+    write(&header, sizeof(header));
+    for (const std::string& token : vocab) {
+        const uint32_t length = (uint32_t)token.size();
+        write(&length, sizeof(length));
+        write(token.data(), token.size());
+    }
+    for (const auto& merge : merge_list) {
+        const int32_t pair[2] = {merge.first, merge.second};
+        write(pair, sizeof(pair));
+    }
+    return data;
 }
 
-Tokenizer::Tokenizer(int vocab_size) : _vocab_size(vocab_size) {
-    log("Tokenizer initialized with vocab size: " + std::to_string(vocab_size));
+Tokenizer Tokenizer::train(const std::string& corpus, int vocab_size) {
+    std::vector<std::string> vocab(256);
+    for (int b = 0; b < 256; ++b) {
+        vocab[b] = std::string(1, (char)b);
+    }
+    std::vector<std::pair<int, int>> merges;
+
+    // Distinct pre-tokens with their counts, as token sequences
+    std::map<std::string, int> counts;
+    split_pieces(corpus, [&](const char* p, size_t n) { counts[std::string(p, n)]++; });
+    std::vector<std::pair<std::vector<int>, int>> words;
+    for (const auto& entry : counts) {
+        std::vector<int> ids(entry.first.begin(), entry.first.end());
+        for (int& id : ids) id = (unsigned char)id;
+        words.push_back({ids, entry.second});
+    }
+
+    while ((int)vocab.size() < vocab_size) {
+        std::map<std::pair<int, int>, int> pairs;
+        for (const auto& word : words) {
+            for (size_t i = 0; i + 1 < word.first.size(); ++i) {
+                pairs[{word.first[i], word.first[i + 1]}] += word.second;
+            }
+        }
+        // Most frequent pair; ties go to the smallest ids, so training is deterministic
+        auto best = pairs.end();
+        for (auto it = pairs.begin(); it != pairs.end(); ++it) {
+            if (best == pairs.end() || it->second > best->second) best = it;
+        }
+        if (best == pairs.end() || best->second < 2) break;
+
+        const int left = best->first.first;
+        const int right = best->first.second;
+        const int id = (int)vocab.size();
+        vocab.push_back(vocab[left] + vocab[right]);
+        merges.push_back({left, right});
+        for (auto& word : words) {
+            std::vector<int>& ids = word.first;
+            size_t out = 0;
+            for (size_t i = 0; i < ids.size(); ++i) {
+                if (i + 1 < ids.size() && ids[i] == left && ids[i + 1] == right) {
+                    ids[out++] = id;
+                    ++i;
+                } else {
+                    ids[out++] = ids[i];
+                }
+            }
+            ids.resize(out);
+        }
+    }
+    return Tokenizer(vocab, merges);
+}
+
+void Tokenizer::encode_piece(const char* data, size_t size, std::vector<int>& out) const {
+    if (size == 1) {
+        out.push_back(byte_tokens[(unsigned char)data[0]]);
+        return;
+    }
+
+    // Symbols form a linked list; merged-away symbols get id -1
+    struct Symbol {
+        int id;
+        int prev;
+        int next;
+    };
+    struct Candidate {
+        int rank;
+        int left;  // symbol index
+        int right; // symbol index
+        int left_id;
+        int right_id;
+        bool operator>(const Candidate& o) const {
+            return rank != o.rank ? rank > o.rank : left > o.left;
+        }
+    };
+    // Per-thread buffers, so encoding does not allocate once warmed up
+    thread_local std::vector<Symbol> symbols;
+    thread_local std::vector<Candidate> queue; // min-heap on (rank, position)
+    symbols.resize(size);
+    for (size_t i = 0; i < size; ++i) {
+        symbols[i] = {byte_tokens[(unsigned char)data[i]], (int)i - 1, i + 1 < size ? (int)i + 1 : -1};
+    }
+
+    queue.clear();
+    auto try_pair = [&](int left) {
+        if (left < 0) return;
+        const int right = symbols[left].next;
+        if (right < 0) return;
+        auto it = merges.find(pair_key(symbols[left].id, symbols[right].id));
+        if (it != merges.end()) {
+            queue.push_back({it->second.rank, left, right, symbols[left].id, symbols[right].id});
+            std::push_heap(queue.begin(), queue.end(), std::greater<Candidate>());
+        }
+    };
+    for (size_t i = 0; i + 1 < size; ++i) {
+        try_pair((int)i);
+    }
+
+    while (!queue.empty()) {
+        std::pop_heap(queue.begin(), queue.end(), std::greater<Candidate>());
+        const Candidate c = queue.back();
+        queue.pop_back();
+        // Skip pairs that an earlier merge has changed
+        Symbol& left = symbols[c.left];
+        if (left.id != c.left_id || left.next != c.right || symbols[c.right].id != c.right_id) continue;
+
+        Symbol& right = symbols[c.right];
+        left.id = merges.find(pair_key(c.left_id, c.right_id))->second.result;
+        left.next = right.next;
+        if (right.next >= 0) symbols[right.next].prev = c.left;
+        right.id = -1;
+        try_pair(left.prev);
+        try_pair(c.left);
+    }
+
+    for (int i = 0; i >= 0; i = symbols[i].next) {
+        out.push_back(symbols[i].id);
+    }
 }
 
 std::vector<int> Tokenizer::encode(const std::string& text) const {
-    // This is a dummy implementation. It doesn't actually tokenize.
-    log("Encoding text: '" + text + "' (dummy implementation).");
-    std::vector<int> tokens;
-    for (char c : text) {
-        tokens.push_back(static_cast<int>(c)); // Simple char-to-int
+    if (vocab.empty()) {
+        throw DaisoException("Tokenizer has no vocabulary.");
     }
+    DAISO_PROFILE_SCOPE(ProfileOp::Tokenize, -1, text.size());
+    std::vector<int> tokens;
+    tokens.reserve(text.size() / 3 + 1);
+    split_pieces(text, [&](const char* p, size_t n) {
+        if (n > Cache::max_piece) {
+            encode_piece(p, n, tokens);
+            return;
+        }
+        std::string key(p, n);
+        {
+            std::lock_guard<std::mutex> lock(cache->mutex);
+            auto it = cache->pieces.find(key);
+            if (it != cache->pieces.end()) {
+                tokens.insert(tokens.end(), it->second.begin(), it->second.end());
+                return;
+            }
+        }
+        const size_t first = tokens.size();
+        encode_piece(p, n, tokens);
+        std::lock_guard<std::mutex> lock(cache->mutex);
+        if (cache->pieces.size() >= Cache::max_entries) {
+            cache->pieces.clear();
+        }
+        cache->pieces.emplace(std::move(key), std::vector<int>(tokens.begin() + first, tokens.end()));
+    });
     return tokens;
 }
 
 std::string Tokenizer::decode(const std::vector<int>& tokens) const {
-    // This is a dummy implementation.
-    log("Decoding tokens (dummy implementation).");
     std::string text;
     for (int token : tokens) {
-        text += static_cast<char>(token);
+        text += token_bytes(token);
     }
     return text;
 }
 
+const std::string& Tokenizer::token_bytes(int token) const {
+    static const std::string empty;
+    return token >= 0 && token < (int)vocab.size() ? vocab[token] : empty;
+}
+
 int Tokenizer::vocab_size() const {
     return _vocab_size;
 }
 
+size_t Tokenizer::n_merges() const {
+    return merge_list.size();
+}
+
+TokenStreamDecoder::TokenStreamDecoder(const Tokenizer& tokenizer) : tokenizer(tokenizer) {}
+
+std::string TokenStreamDecoder::push(int token) {
+    pending += tokenizer.token_bytes(token);
+    // Find where a trailing, incomplete UTF-8 sequence starts, if any
+    size_t cut = pending.size();
+    for (size_t back = 1; back <= 4 && back <= pending.size(); ++back) {
+        const unsigned char c = (unsigned char)pending[pending.size() - back];
+        if ((c & 0xC0) == 0x80) continue; // continuation byte
+        if (c >= 0xC0) {
+            const size_t length = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : 2;
+            if (length > back) cut = pending.size() - back;
+        }
+        break;
+    }
+    std::string ready = pending.substr(0, cut);
+    pending.erase(0, cut);
+    return ready;
+}
+
+std::string TokenStreamDecoder::flush() {
+    std::string rest;
+    rest.swap(pending);
+    return rest;
+}
+
 } // namespace DaisoML
@@ -1,31 +1,90 @@
 #ifndef DAISOML_TOKENIZER_H
 #define DAISOML_TOKENIZER_H
 
-#include <vector>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace DaisoML {
 
-// A placeholder for a tokenizer. A real implementation would be much more complex,
-// likely using something like Byte-Pair Encoding (BPE) or SentencePiece.
+// Byte-level BPE tokenizer.
+//
+// Text is first split into pre-tokens (a word with its leading space, a run
+// of digits, a run of punctuation, or whitespace). Each pre-token starts as
+// one token per byte and is merged with a priority queue: the adjacent pair
+// with the lowest merge rank is joined first, and merges are looked up in a
+// hash table keyed by the pair of token ids. Pre-tokens repeat a lot in
+// practice, so their encodings are cached. encode() and decode() are safe to
+// call from several threads.
+//
+// The vocabulary and merges are stored in the model file (see
+// file_format.h). Files without them get a raw byte tokenizer: token i is
+// byte i and nothing is merged.
 class Tokenizer {
 public:
     Tokenizer();
+    // Raw byte tokenizer for models without a stored vocabulary
     explicit Tokenizer(int vocab_size);
+    // `vocab[i]` holds the bytes of token i; merges are (left, right) token
+    // ids in rank order. Every single byte must be in the vocabulary.
+    Tokenizer(const std::vector<std::string>& vocab, const std::vector<std::pair<int, int>>& merges);
+
+    // Reads / writes the tokenizer section of a model file.
+    static Tokenizer deserialize(const std::vector<uint8_t>& data);
+    std::vector<uint8_t> serialize() const;
 
+    // Learns up to vocab_size - 256 merges from `corpus` (most frequent
+    // adjacent pair first). Used by offline tools.
+    static Tokenizer train(const std::string& corpus, int vocab_size);
 
     // Convert text to a sequence of token IDs
     std::vector<int> encode(const std::string& text) const;
 
     // Convert a sequence of token IDs to text
     std::string decode(const std::vector<int>& tokens) const;
+    // Bytes of one token (empty for ids outside the vocabulary)
+    const std::string& token_bytes(int token) const;
 
     int vocab_size() const;
+    size_t n_merges() const;
 
 private:
-    // In a real scenario, this would be a map from string to int.
-    // We'll use a simple placeholder.
+    struct Merge {
+        int rank;
+        int result;
+    };
+    struct Cache;
+
+    void build_index();
+    // Appends the tokens of one pre-token
+    void encode_piece(const char* data, size_t size, std::vector<int>& out) const;
+
     int _vocab_size;
+    std::vector<std::string> vocab;
+    std::vector<std::pair<int, int>> merge_list;
+    int byte_tokens[256];
+    std::unordered_map<uint64_t, Merge> merges; // (left << 32 | right) -> merge
+    std::shared_ptr<Cache> cache;
+};
+
+// Turns a stream of tokens into printable text. A token can end in the middle
+// of a multi-byte UTF-8 character; such bytes are held back until the
+// character is complete, so every piece returned can be shown on its own.
+class TokenStreamDecoder {
+public:
+    explicit TokenStreamDecoder(const Tokenizer& tokenizer);
+
+    // Returns the text that became complete with this token (may be empty).
+    std::string push(int token);
+    // Returns any held-back bytes, e.g. at the end of a generation.
+    std::string flush();
+
+private:
+    const Tokenizer& tokenizer;
+    std::string pending;
 };
 
 } // namespace DaisoML
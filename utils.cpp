@@ -1,11 +1,149 @@
 #include "utils.h"
-#include <iostream>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <thread>
 
 namespace DaisoML {
 
+namespace {
+
+const char* level_tag(LogLevel level) {
+    switch (level) {
+        case LogLevel::Debug: return "[DEBUG] ";
+        case LogLevel::Info: return "[LOG] ";
+        case LogLevel::Warn: return "[WARN] ";
+        case LogLevel::Error: return "[ERROR] ";
+        case LogLevel::Off: break;
+    }
+    return "";
+}
+
+LogLevel initial_level() {
+    if (const char* env = std::getenv("DAISO_LOG_LEVEL")) {
+        try {
+            return log_level_from_name(env);
+        } catch (const std::exception&) {
+            std::fprintf(stderr, "[WARN] Unknown DAISO_LOG_LEVEL '%s', using info.\n", env);
+        }
+    }
+    return LogLevel::Info;
+}
+
+std::atomic<int> current_level{static_cast<int>(initial_level())};
+
+// Queue drained by a writer thread. The sink is never destroyed, so threads
+// may log during static destruction; what is still queued at exit is written
+// by flush_log() from an atexit handler.
+class LogSink {
+public:
+    static LogSink& instance() {
+        static LogSink* sink = new LogSink();
+        return *sink;
+    }
+
+    void push(std::string line) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (queue.size() >= max_queued) {
+                dropped++;
+                return;
+            }
+            queue.push_back(std::move(line));
+        }
+        ready.notify_one();
+    }
+
+    void flush() {
+        std::unique_lock<std::mutex> lock(mutex);
+        write_all(lock);
+        // Wait for lines the writer thread has taken but not yet written
+        idle.wait(lock, [&] { return !writing; });
+        std::fflush(stderr);
+    }
+
+private:
+    static constexpr size_t max_queued = 8192;
+
+    LogSink() {
+        std::thread(&LogSink::run, this).detach();
+        std::atexit([] { flush_log(); });
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            ready.wait(lock, [&] { return !queue.empty() || dropped > 0; });
+            write_all(lock);
+        }
+    }
+
+    // Writes the queue with the lock released, so producers never wait on I/O.
+    void write_all(std::unique_lock<std::mutex>& lock) {
+        while (!queue.empty() || dropped > 0) {
+            std::deque<std::string> batch;
+            batch.swap(queue);
+            const size_t lost = dropped;
+            dropped = 0;
+            writing = true;
+            lock.unlock();
+            for (const std::string& line : batch) {
+                std::fputs(line.c_str(), stderr);
+            }
+            if (lost > 0) {
+                std::fprintf(stderr, "[WARN] %zu log messages dropped.\n", lost);
+            }
+            lock.lock();
+            writing = false;
+            idle.notify_all();
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::condition_variable idle;
+    std::deque<std::string> queue;
+    size_t dropped = 0;
+    bool writing = false;
+};
+
+} // namespace
+
 void log(const std::string& message) {
-    // In a real application, this could write to a file, etc.
-    std::cout << "[LOG] " << message << std::endl;
+    log(LogLevel::Info, message);
+}
+
+void log(LogLevel level, const std::string& message) {
+    if (!log_enabled(level)) return;
+    LogSink::instance().push(level_tag(level) + message + "\n");
+}
+
+void set_log_level(LogLevel level) {
+    current_level.store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+LogLevel log_level() {
+    return static_cast<LogLevel>(current_level.load(std::memory_order_relaxed));
+}
+
+bool log_enabled(LogLevel level) {
+    return level != LogLevel::Off && static_cast<int>(level) >= current_level.load(std::memory_order_relaxed);
+}
+
+LogLevel log_level_from_name(const std::string& name) {
+    if (name == "debug") return LogLevel::Debug;
+    if (name == "info") return LogLevel::Info;
+    if (name == "warn") return LogLevel::Warn;
+    if (name == "error") return LogLevel::Error;
+    if (name == "off") return LogLevel::Off;
+    throw DaisoException("Unknown log level: " + name + " (expected debug, info, warn, error or off)");
+}
+
+void flush_log() {
+    LogSink::instance().flush();
 }
 
 } // namespace DaisoML
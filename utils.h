@@ -6,8 +6,29 @@
 
 namespace DaisoML {
 
-// A simple logging utility
-void log(const std::string& message);
+// Severity of a log message. Messages below the current level are dropped
+// before they are formatted into the queue.
+enum class LogLevel {
+    Debug,
+    Info,
+    Warn,
+    Error,
+    Off,
+};
+
+// Logging. Messages are queued and written to stderr by a background thread,
+// so a caller never waits on the terminal; if the queue is full the message
+// is dropped and counted. The level starts at Info, or DAISO_LOG_LEVEL
+// (debug, info, warn, error, off).
+void log(const std::string& message); // Info
+void log(LogLevel level, const std::string& message);
+void set_log_level(LogLevel level);
+LogLevel log_level();
+bool log_enabled(LogLevel level);
+// Parses a level name as accepted by DAISO_LOG_LEVEL; throws otherwise.
+LogLevel log_level_from_name(const std::string& name);
+// Writes out everything queued so far. Also runs at exit.
+void flush_log();
 
 // A custom exception class for our application
 class DaisoException : public std::runtime_error {
@@ -15,9 +36,6 @@ public:
     explicit DaisoException(const std::string& message) : std::runtime_error(message) {}
 };
 
-// Add more utility function declarations here
-// For example, file reading, timing, etc.
-
 } // namespace DaisoML
 
 #endif //DAISOML_UTILS_H